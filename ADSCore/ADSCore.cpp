@@ -37,9 +37,20 @@
         q(1) = 1.0f;
         w = Matrix::zeros(3,1);
         gyrb = Matrix::zeros(3,1);
+        quest_iter = 0;
+        #if defined(ADSCore_USE_ECLIPSE) && !defined(ADSCore_USE_GND)
+        illumination = 1;
+        #endif
+        #ifdef ADSCore_USE_OBSERVATION_MANAGER
+        q_valid = false;
+        q_pred[0] = 1;
+        q_pred[1] = q_pred[2] = q_pred[3] = 0;
+        #endif
         for(int i = 0; i < ADSCore_NSENSOR; i++){       // Initializing the vector to zero
-            sbod[i] = Matrix::zeros(3,1);
-            seci[i] = Matrix::zeros(3,1);
+            for(int j = 0; j < 3; j++){
+                sbod[i][j] = 0;
+                seci[i][j] = 0;
+            }
         }
     }
 
@@ -54,9 +65,20 @@
         q(1) = 1.0f;
         w = Matrix::zeros(3,1);
         gyrb = Matrix::zeros(3,1);
+        quest_iter = 0;
+        #if defined(ADSCore_USE_ECLIPSE) && !defined(ADSCore_USE_GND)
+        illumination = 1;
+        #endif
+        #ifdef ADSCore_USE_OBSERVATION_MANAGER
+        q_valid = false;
+        q_pred[0] = 1;
+        q_pred[1] = q_pred[2] = q_pred[3] = 0;
+        #endif
         for(int i = 0; i < ADSCore_NSENSOR; i++){       // Initializing the vector to zero
-            sbod[i] = Matrix::zeros(3,1);
-            seci[i] = Matrix::zeros(3,1);
+            for(int j = 0; j < 3; j++){
+                sbod[i][j] = 0;
+                seci[i][j] = 0;
+            }
         }
     }
 
@@ -72,9 +94,20 @@
         q(1) = 1.0f;
         w = Matrix::zeros(3,1);
         gyrb = Matrix::zeros(3,1);
+        quest_iter = 0;
+        #if defined(ADSCore_USE_ECLIPSE) && !defined(ADSCore_USE_GND)
+        illumination = 1;
+        #endif
+        #ifdef ADSCore_USE_OBSERVATION_MANAGER
+        q_valid = false;
+        q_pred[0] = 1;
+        q_pred[1] = q_pred[2] = q_pred[3] = 0;
+        #endif
         for(int i = 0; i < ADSCore_NSENSOR; i++){       // Initializing the vector to zero
-            sbod[i] = Matrix::zeros(3,1);
-            seci[i] = Matrix::zeros(3,1);
+            for(int j = 0; j < 3; j++){
+                sbod[i][j] = 0;
+                seci[i][j] = 0;
+            }
         }
     }
 
@@ -97,16 +130,42 @@
         #endif
     }
 
+    #ifdef ADSCore_USE_SGP4
+    int ADSCore::initOrbit(const char *line1, const char *line2, int date[6]){
+        int error = orbit.setTLE(line1, line2);
+        #ifdef ADSCore_USE_PRINTF
+        if(error != AstroLib::SGP4_OK){
+            printf("Could not load the TLE: error %d\r\n", error);
+        }
+        #endif
+        orbit.setJulianDate(AstroLib::JulianDate(date[0],date[1],date[2],date[3],date[4],(float)date[5]));
+        return error;
+    }
+    #else
     void ADSCore::initOrbit(float parameters[6], int date[6]){
         orbit.setJulianDate(AstroLib::JulianDate(date[0],date[1],date[2],date[3],date[4],(float)date[5]));
         // Ground setting[lattitude    , longitude    , altitude     ,  mag_N       ,  mag_E       ,   mg_D       ]
         orbit.setOrbit   (parameters[0], parameters[1], parameters[2], parameters[3], parameters[4], parameters[5]);
     }
+    #endif
+
+    #if defined(ADSCore_USE_MAG_GRID) && !defined(ADSCore_USE_GND)
+    int ADSCore::initMagGrid(const float *table, int size){
+        int valid = mag_grid.load(table, size);
+        #ifdef ADSCore_USE_PRINTF
+        if(!valid){
+            printf("Could not load the magnetic field grid\r\n");
+        }
+        #endif
+        orbit.setMagGrid(valid ? &mag_grid : 0);
+        return valid;
+    }
+    #endif
 
 
     void ADSCore::initQuest(float sigma_mag, float sigma_sun){
-        omega[0] = sigma_mag;
-        omega[1] = sigma_sun;
+        omega[0] = 1.0f / sigma_mag;
+        omega[1] = 1.0f / sigma_sun;
     }
 
     void ADSCore::initKalman(float sigma_q_eta, float sigma_q_epsilon, float sigma_gyr, float dt, Matrix I_sat, Matrix q_init, Matrix w_init){
@@ -167,16 +226,26 @@
 
     Matrix ADSCore::getGyrb() const{ return gyrb; }
 
-    Matrix ADSCore::getSensorBody(int n){ return sbod[n]; }
+    Matrix ADSCore::getSensorBody(int n){ return Matrix(3, 1, sbod[n]); }
 
-    Matrix ADSCore::getSensorECI(int n){ return seci[n]; }
+    Matrix ADSCore::getSensorECI(int n){ return Matrix(3, 1, seci[n]); }
 
     const Filters::KalmanFilter& ADSCore::getKalman() const{ return kalman; }
 
+    int ADSCore::getQuestIterations() const{ return quest_iter; }
+    #if defined(ADSCore_USE_ECLIPSE) && !defined(ADSCore_USE_GND)
+    float ADSCore::getIllumination() const{ return illumination; }
+    #endif
+    #ifdef ADSCore_USE_OBSERVATION_MANAGER
+    Estimators::ObservationManager& ADSCore::getObservationManager(){ return obs_manager; }
+    #endif
+
     #ifdef ADSCore_USE_GND
     const AstroLib::Ground& ADSCore::getOrbit() const{ return orbit; }
+    #elif defined(ADSCore_USE_SGP4)
+    const AstroLib::SGP4& ADSCore::getOrbit() const{ return orbit; }
     #else
-    AstroLib::Orbit& ADSCore::getOrbit() const{ return orbit; }
+    const AstroLib::Orbit& ADSCore::getOrbit() const{ return orbit; }
     #endif
 
 //Updaters
@@ -185,8 +254,113 @@
     }
 
     Matrix ADSCore::update(Matrix w_rw_prev, Matrix T_bf_prev, Matrix T_rw_prev){
+        float *s_eci[ADSCore_NSENSOR];
+        float *s_body[ADSCore_NSENSOR];
+        float prior[ADSCore_NSENSOR];      // Weights of the sensors available at this step
+        float weights[ADSCore_NSENSOR];    // Weights of the observations available at this step
+        float quat[4];
+        int nobs = 0;               // Number of observations available at this step
+
+        #ifdef ADSCore_USE_OBSERVATION_MANAGER
+        float dt = (time.read_us() - last_update)/1000000.0f;
+        #endif
         fetchSensors();
-        Estimators::QUEST(&q, ADSCore_NSENSOR, seci, sbod, omega, ADSCore_TOLERANCE);
+        for(int i = 0; i < ADSCore_NSENSOR; i++){
+            prior[i] = omega[i];
+        }
+        #if defined(ADSCore_USE_ECLIPSE) && !defined(ADSCore_USE_GND)
+        if(illumination < ADSCore_ECLIPSE_THRESHOLD){
+            // In the Earth shadow, the Sun sensor only sees the albedo
+            prior[1] = 0;
+        }
+        #endif
+        #ifdef ADSCore_USE_OBSERVATION_MANAGER
+        // Scoring of the observations against the predicted attitude, the rejected ones get a null weight
+        float *all_eci[ADSCore_NSENSOR];
+        float *all_body[ADSCore_NSENSOR];
+        for(int i = 0; i < ADSCore_NSENSOR; i++){
+            all_eci[i] = seci[i];
+            all_body[i] = sbod[i];
+        }
+        // The prediction follows the gyrometer since the last fix, so that a rotation is not taken for an outlier
+        for(int i = 0; i < 3; i++){
+            vecf[i] = gyrb(i+1);
+        }
+        Estimators::propagateQuaternion(q_pred, vecf, dt);
+        obs_manager.process(weights, ADSCore_NSENSOR, all_eci, all_body, prior, q_valid ? q_pred : 0, 2);
+        #else
+        for(int i = 0; i < ADSCore_NSENSOR; i++){
+            weights[i] = prior[i];
+        }
+        #endif
+        for(int i = 0; i < ADSCore_NSENSOR; i++){
+            if(weights[i] > 0){
+                s_eci[nobs] = seci[i];
+                s_body[nobs] = sbod[i];
+                weights[nobs] = weights[i];
+                nobs++;
+            }
+        }
+        if(nobs < 2){
+            // Not enough observations to determine the attitude (e.g. in eclipse)
+            #ifdef ADSCore_USE_OBSERVATION_MANAGER
+            // The last fix is followed with the gyrometer until the next one
+            if(q_valid){
+                for(int i = 0; i < 4; i++){
+                    q(i+1) = q_pred[i];
+                }
+            }
+            #endif
+            // Without the prediction, the last estimate is kept
+            last_update = time.read_us();
+            return q;
+        }
+        #ifdef ADSCore_USE_OBSERVATION_MANAGER
+        q_valid = true;
+        #endif
+
+        #ifdef ADSCore_USE_TRIAD
+        if(nobs == 2){
+            // Two observations: TRIAD needs no iterative solve
+            Estimators::TRIAD(quat, s_eci, s_body, weights);
+            quest_iter = 0;
+        }
+        else
+        #endif
+        {
+            quest_iter = Estimators::QUEST(quat, nobs, s_eci, s_body, weights, ADSCore_TOLERANCE, ADSCore_SOLVER, ADSCore_MAX_ITER);
+        }
+        for(int i = 0; i < 4; i++){
+            q(i+1) = quat[i];
+            #ifdef ADSCore_USE_OBSERVATION_MANAGER
+            q_pred[i] = quat[i];
+            #endif
+        }
+
+        #ifdef ADSCore_USE_QUEST_COVARIANCE
+        // Measurement noise of the quaternion from the weights and the geometry of the observations
+        // (a new geometry releases a gain frozen by the steady-state mode of the filter)
+        float P_att[9];
+        float P_quat[16];
+        Matrix kalman_r = kalman.getMeasurementNoise();
+        #ifdef ADSCore_USE_TRIAD
+        if(nobs == 2){
+            // TRIAD trusts the anchor entirely, its error is larger than the one of QUEST
+            Estimators::TRIADCovariance(P_att, s_body, weights);
+        }
+        else
+        #endif
+        {
+            Estimators::QUESTCovariance(P_att, nobs, s_body, weights);
+        }
+        Estimators::quaternionCovariance(P_quat, quat, P_att);
+        for(int i = 0; i < 4; i++){
+            for(int j = 0; j < 4; j++){
+                kalman_r(i+1, j+1) = P_quat[i*4+j];
+            }
+        }
+        kalman.setMeasurementNoise(kalman_r);
+        #endif
         // kalman.filter(q, gyrb, time.read_us() - last_update, w_rw_prev, T_bf_prev, T_rw_prev);
         // q = kalman.getQuaternion();
         // w = kalman.getAngularRate();
@@ -197,31 +371,36 @@
     void ADSCore::fetchSensors(){
         // Earth Centered Inertial frame model
         orbit.update((time.read_us() - last_update)/1000000.0f);
-        orbit.getMagVector(vecf);
-        seci[0] = Matrix(3,1, vecf);
-        orbit.getSunVector(vecf);
-        seci[1] = Matrix(3,1, vecf);
+        orbit.getMagVector(seci[0]);
+        orbit.getSunVector(seci[1]);
 
-        // Sun Sensor
-        sun.getSunVector(vecf);
-        sbod[1] = Matrix(3,1,vecf);
+        // Sun Sensor (not read in eclipse)
+        #if defined(ADSCore_USE_ECLIPSE) && !defined(ADSCore_USE_GND)
+        float r_sat[3];
+        orbit.getPositionVector(r_sat);
+        illumination = AstroLib::Orbit::conicalShadow(r_sat, seci[1]);
+        if(illumination >= ADSCore_ECLIPSE_THRESHOLD){
+            sun.getSunVector(sbod[1]);
+        }
+        #else
+        sun.getSunVector(sbod[1]);
+        #endif
 
         // IMU
         if(imu.readByte(MPU9150_ADDRESS, INT_STATUS) & 0x01) {  // On interrupt, check if data ready interrupt
             imu.getGyro(vecf);  // Read the x/y/z adc values
             gyrb = Matrix(3,1,vecf);
             gyrb *= DEG2RAD;
-            imu.getMag(vecf);  // Read the x/y/z adc values
-            sbod[0] = Matrix(3,1,vecf);
+            imu.getMag(sbod[0]);  // Read the x/y/z adc values
             #ifdef ADSCore_USE_GND
                 // Replacing the sun vector by the Earth gravity
-                imu.getAccel(vecf);
-                sbod[1] = Matrix(3,1,vecf);
+                imu.getAccel(sbod[1]);
             #endif
         }
         #ifdef ADSCore_USE_GND
             // Replacing the sun vector by the Earth gravity
-            seci[1] = Matrix::zeros(3, 1);
-            seci[1](3) = 1.0f;
+            seci[1][0] = 0.0f;
+            seci[1][1] = 0.0f;
+            seci[1][2] = 1.0f;
         #endif
     }
\ No newline at end of file
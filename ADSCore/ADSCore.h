@@ -58,7 +58,16 @@
 
 #define ADSCore_NSENSOR 2               ///< The number of sensor used for Quest algorithm
 #define ADSCore_TOLERANCE 1e-5          ///< The tolerance of the Quest algorithm
+#define ADSCore_SOLVER Estimators::QUEST_ANALYTIC   ///< The eigen value solver of the Quest algorithm (closed-form for 2 sensors)
+#define ADSCore_MAX_ITER QUEST_MAX_ITERATIONS       ///< The maximum number of iterations of the Quest solver
 #define ADSCore_USE_GND                 ///< Trigger the use of the Ground model instead of the orbital model
+//#define ADSCore_USE_SGP4              ///< Use the SGP4 propagator initialized from a TLE instead of the two-body orbital model
+//#define ADSCore_USE_MAG_GRID          ///< Interpolate the magnetic field in a precomputed grid instead of the model (not with the Ground model)
+#define ADSCore_USE_ECLIPSE             ///< Drop the Sun sensor when the satellite is in the Earth shadow (not with the Ground model)
+#define ADSCore_ECLIPSE_THRESHOLD 0.5f  ///< Illumination (fraction of the solar disk) below which the Sun sensor is dropped
+#define ADSCore_USE_TRIAD               ///< Use the TRIAD algorithm instead of Quest when exactly two observations are available
+#define ADSCore_USE_QUEST_COVARIANCE    ///< Feed the covariance of the attitude measurement to the Kalman filter at each step
+#define ADSCore_USE_OBSERVATION_MANAGER ///< Down-weight or drop the observations inconsistent with the predicted attitude before Quest
 #define ADSCore_USE_PRINTF              ///< Enable the use of debug printf inside the object
 
 #include "mbed.h"
@@ -84,7 +93,8 @@
  * frame while models are used to provide the same measurements in the ECI frame.
  * 
  * The QuEst algorithm is used to find the best rotation quaternion that links each pair
- * of body-ECI vectors.
+ * of body-ECI vectors. When exactly two observations are available, the TRIAD algorithm
+ * is used instead (see ADSCore_USE_TRIAD).
  * 
  * Then a Kalman Filter is applied to the output quaterion to filter out any noise according
  * to the dynamic model of the satellite.
@@ -138,13 +148,39 @@ public:
      * [latitude, longitude, altitude, mag_North, mag_East, mag_Down] for Ground version
      * @param date The starting date in the format [2019, 12, 31, 23, 59, 59]
      */
+    #ifdef ADSCore_USE_SGP4
+    /**
+     * @brief
+     * Initialize the SGP4 orbit model with the given date and Two-Line Elements
+     * @param line1 The first line of the TLE
+     * @param line2 The second line of the TLE
+     * @param date The starting date in the format [2019, 12, 31, 23, 59, 59]
+     * @return AstroLib::SGP4_OK if successful, an AstroLib::SGP4Error otherwise
+     */
+    int initOrbit(const char *line1, const char *line2, int date[6]);
+    #else
     void initOrbit(float parameters[6], int date[6]);
+    #endif
+
+    #if defined(ADSCore_USE_MAG_GRID) && !defined(ADSCore_USE_GND)
+    /**
+     * @brief
+     * Uses a precomputed grid for the Earth magnetic field of the orbit model
+     * @param table The grid, usually stored in flash (see AstroLib::MagGrid)
+     * @param size The number of words in the table
+     * @return 1 if the grid is valid, 0 otherwise (the model is then used)
+     */
+    int initMagGrid(const float *table, int size);
+    #endif
 
     /**
      * @brief
      * Sets the variances of the sensors for the Quest algorithm
-     * @param sigma_mag The variance of the magnetometer
-     * @param sigma_sun The variance of the Sun sensor
+     * @details
+     * The weight of each sensor is the inverse of its variance, so that the covariance
+     * of the attitude measurement can be computed (see ADSCore_USE_QUEST_COVARIANCE)
+     * @param sigma_mag The variance of the magnetometer (rad^2)
+     * @param sigma_sun The variance of the Sun sensor (rad^2)
      */
     void initQuest(float sigma_mag, float sigma_sun);
 
@@ -220,6 +256,33 @@ public:
      */
     const Filters::KalmanFilter& getKalman() const;
 
+    /**
+     * @brief
+     * Gets the number of iterations used by the Quest solver at the last update
+     * @return The number of iterations (at most ADSCore_MAX_ITER, 0 when TRIAD was used)
+     */
+    int getQuestIterations() const;
+
+    #if defined(ADSCore_USE_ECLIPSE) && !defined(ADSCore_USE_GND)
+    /**
+     * @brief
+     * Gets the illumination of the satellite at the last update
+     * @details
+     * Below ADSCore_ECLIPSE_THRESHOLD, the Sun sensor is neither read nor used.
+     * @return The illumination, from 0 in the umbra to 1 in full sunlight
+     */
+    float getIllumination() const;
+    #endif
+
+    #ifdef ADSCore_USE_OBSERVATION_MANAGER
+    /**
+     * @brief
+     * Gets the observation manager to tune the thresholds or read the residuals
+     * @return The observation manager object reference
+     */
+    Estimators::ObservationManager& getObservationManager();
+    #endif
+
     #ifdef ADSCore_USE_GND
     /**
      * @brief
@@ -227,13 +290,20 @@ public:
      * @return The Ground object reference
      */
     const AstroLib::Ground& getOrbit() const;
+    #elif defined(ADSCore_USE_SGP4)
+    /**
+     * @brief
+     * Gets the SGP4 object reference for external access
+     * @return The SGP4 object reference
+     */
+    const AstroLib::SGP4& getOrbit() const;
     #else
     /**
      * @brief
      * Gets the Orbit object reference for external access
      * @return The Orbit object reference
      */
-    AstroLib::Orbit& getOrbit() const;
+    const AstroLib::Orbit& getOrbit() const;
     #endif
 
 ///@name Updaters
@@ -241,6 +311,10 @@ public:
      * @brief
      * Updates the attitude of the spacecraft by combining the output the different
      * sensors and filtering the resulting attitude measurement.
+     * @details
+     * With less than two usable observations (e.g. the Sun sensor in eclipse), the
+     * attitude of the last fix propagated with the gyrometer is returned with
+     * ADSCore_USE_OBSERVATION_MANAGER, the last fix is held otherwise.
      * @return The attitude quaternion
      */
     Matrix update();
@@ -250,6 +324,9 @@ public:
      * Updates the attitude of the spacecraft by combining the output the different
      * sensors and filtering the resulting attitude measurement knowing the action
      * of the Control system
+     * @details
+     * The attitude is propagated or held as in update() when less than two observations
+     * are usable.
      * @param w_rw_prev The rotation speed of the reaction wheels (rad/s)
      * @param T_bf_prev The torque applied by the Control actuactors that are NOT the reaction wheels
      * @param T_rw_prev The torque applied by the reaction wheels
@@ -272,9 +349,14 @@ private:
 
     #ifdef ADSCore_USE_GND
     AstroLib::Ground orbit;         ///< The "ground" version of Orbit for lab testing
+    #elif defined(ADSCore_USE_SGP4)
+    AstroLib::SGP4 orbit;           ///< The SGP4 orbit of the satellite
     #else
     AstroLib::Orbit orbit;          ///< The orbit of the satellite
     #endif
+    #if defined(ADSCore_USE_MAG_GRID) && !defined(ADSCore_USE_GND)
+    AstroLib::MagGrid mag_grid;     ///< The grid of the Earth magnetic field
+    #endif
 
     Filters::KalmanFilter kalman;
 
@@ -283,10 +365,19 @@ private:
 
     float vecf[3];                  ///< Temporary array storage for vectors    
     Matrix gyrb;                    ///< Gyrometer output   
-    Matrix sbod[ADSCore_NSENSOR];   ///< The array of Matrices of the body frame measurements
-    Matrix seci[ADSCore_NSENSOR];   ///< The array of Matrices of the ECi  frame measurements
+    float sbod[ADSCore_NSENSOR][3]; ///< The array of the body frame measurements
+    float seci[ADSCore_NSENSOR][3]; ///< The array of the ECI  frame measurements
 
     float last_update;              ///< Time since last update
     float omega[ADSCore_NSENSOR];   ///< Weight of the sensor for Quest
+    int quest_iter;                 ///< Number of iterations of the Quest solver at the last update
+    #if defined(ADSCore_USE_ECLIPSE) && !defined(ADSCore_USE_GND)
+    float illumination;             ///< Illumination of the satellite at the last update (0 in eclipse, 1 in sunlight)
+    #endif
+    #ifdef ADSCore_USE_OBSERVATION_MANAGER
+    Estimators::ObservationManager obs_manager; ///< Outlier rejection of the observations
+    bool q_valid;                   ///< Whether q has been estimated at least once (and can be used as a prediction)
+    float q_pred[4];                ///< The attitude of the last fix propagated with the gyrometer (prediction of the screening)
+    #endif
 }; // End class ADSCore
 #endif // ADSCORE_H
\ No newline at end of file
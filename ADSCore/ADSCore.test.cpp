@@ -64,8 +64,13 @@ int ADSTest(){
     
     float sigma_gyr = 0.5, sigma_mag = 0.1;     // Covariance of the IMU sensors
     float sigma_sun = 0.5;                      // Covariance of the sun sensor
+    #ifdef ADSCore_USE_GND
     // Ground setting     [lattitude, longitude, altitude,  mag_N  ,  mag_E ,   mg_D  ]
     float parameters[6] = {55.86515 , -4.25763 ,   0.0f  , 17.3186f, -.6779f, 46.8663f};
+    #else
+    // Orbit setting      [semi-major axis, eccentricity, inclination, RAAN, perigee, true anomaly]
+    float parameters[6] = {6878000.0f, 0.001f, 51.6f*DEG2RAD, 0.0f, 0.0f, 0.0f};
+    #endif
     int date[6] = {year, month, day, hours, minutes, (int)seconds};
     float sigma_eta = 0.1, sigma_epsilon = 0.1; // Covariance of the quest process
 
@@ -88,14 +93,47 @@ int ADSTest(){
     int last_iteration = t.read_us();        // In us
     int loop_time = 0;                          // In us
 
+// - Eclipse                                    //
+    #if defined(ADSCore_USE_ECLIPSE) && !defined(ADSCore_USE_GND)
+    // The Sun sensor is dropped in the Earth shadow: the attitude follows the gyrometer
+    // (with ADSCore_USE_OBSERVATION_MANAGER) until the exit, where the jump to the first
+    // fix is the drift accumulated during the eclipse
+    int in_eclipse = ads.getIllumination() < ADSCore_ECLIPSE_THRESHOLD;
+    int eclipse_start = t.read_ms();
+    float q_eclipse[4];
+    #ifndef ADSCore_USE_SGP4
+    AstroLib::Orbit eclipse_orbit = ads.getOrbit();
+    float eclipse_entry, eclipse_exit;
+    eclipse_orbit.predictEclipse(&eclipse_entry, &eclipse_exit);
+    printf("Eclipse | predicted entry %7.1f s | exit %7.1f s\r\n", eclipse_entry, eclipse_exit);
+    #endif
+    #endif
+
 // Loop                                         //
     printf("Program initialized\r\nStarting loop:\n\r");
     while(1){
+        #if defined(ADSCore_USE_ECLIPSE) && !defined(ADSCore_USE_GND)
+        q = ads.getQ();
+        for(int i = 0; i < 4; i++){
+            q_eclipse[i] = q(i+1);
+        }
+        #endif
         loop_time = t.read_us();
 
         ads.update();
 
         loop_time = t.read_us() - loop_time; // Measure the execution time of the process
+        #if defined(ADSCore_USE_ECLIPSE) && !defined(ADSCore_USE_GND)
+        if((ads.getIllumination() < ADSCore_ECLIPSE_THRESHOLD) != in_eclipse){
+            in_eclipse = !in_eclipse;
+            q = ads.getQ();
+            float dot = fabs(q(1)*q_eclipse[0] + q(2)*q_eclipse[1] + q(3)*q_eclipse[2] + q(4)*q_eclipse[3]);
+            printf("Eclipse | %s after %7.1f s | illumination %5.3f | attitude jump %f deg\r\n",
+                    in_eclipse ? "entry" : "exit ", (t.read_ms() - eclipse_start)/1000.0f, ads.getIllumination(),
+                    2*acos((dot > 1) ? 1 : dot)*RAD2DEG);
+            eclipse_start = t.read_ms();
+        }
+        #endif
         last_iteration = t.read_us();        // Save the date of last update
         seconds+=(t.read_us()-last_iteration)/1000000.0f; // Update the global time
         if(seconds >= 60.0f){
@@ -22,19 +22,24 @@
  */
 
 #include "AstroLib.h"
+#ifdef ASTROLIB_USE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 using namespace AstroLib;
 // ------------------- Julian Date -------------------//
 // Constructors
-    JulianDate::JulianDate():_day(0),_frac(0){}
-
-    JulianDate::JulianDate(long day, float frac):_day(day),_frac(frac){
-        // check that the day and fractional day are correct
-        if (fabs(_frac) >= 1.0f) {
-            float dtt = floor(_frac);
-            _day  += dtt;
-            _frac -= dtt;
-        }
+    JulianDate::JulianDate():_day(0),_ns(0){}
+
+    JulianDate::JulianDate(long day, float frac):_day(day),_ns(0){
+        // Whole days of the fraction go to the day
+        float dtt = floor(frac);
+        _day += (long)dtt;
+        _ns = fracToNanoseconds(frac - dtt);
+        normalize();
     }
 
     JulianDate::JulianDate(int yr, int mo, int d, int h, int mi, float s){
@@ -42,34 +47,23 @@ using namespace AstroLib;
                         (long)floor((7 * (yr + floor((mo + 9) / 12.0f))) * 0.25f) +
                         (long)floor(275 * mo / 9.0f) +
                         d + 1721013;  // alternatively use - 678987.0 to go to mjd directly
-        _frac =   (s + mi * 60.0f + h * 3600.0f) / 86400.0f + 0.5f;
-        
-        // check that the day and fractional day are correct
-        if (fabs(_frac) >= 1.0f) {
-            float dtt = floor(_frac);
-            _day  += dtt;
-            _frac -= dtt;
-        }
+        // The julian day starts at noon
+        _ns = (int64_t)(h * 3600L + mi * 60L + 43200L) * 1000000000LL + toNanoseconds(s);
+        normalize();
     }
 
 // Operators
     void JulianDate::operator+=(const JulianDate& rhs){
-        this->_day +=  rhs._day;
-        this->_frac += rhs._frac;
-        if (fabs(this->_frac) >= 1.0f) {
-            float dtt = floor(this->_frac);
-            this->_day  += dtt;
-            this->_frac -= dtt;
-        }
+        this->_day += rhs._day;
+        this->_ns  += rhs._ns;
+        normalize();
     }
 
     void JulianDate::operator+=(float rhs){
-        this->_frac += rhs;
-        if (fabs(this->_frac) >= 1.0f) {
-            float dtt = floor(this->_frac);
-            this->_day  += dtt;
-            this->_frac -= dtt;
-        }
+        float dtt = floor(rhs);
+        this->_day += (long)dtt;
+        this->_ns  += fracToNanoseconds(rhs - dtt);
+        normalize();
     }
 
     void JulianDate::operator+=(int rhs){
@@ -80,6 +74,8 @@ using namespace AstroLib;
         this->_day += rhs;
     }
 
+    // The friend operators belong to the namespace
+    namespace AstroLib{
     JulianDate operator+(const JulianDate& lhs, const JulianDate& rhs){
         JulianDate tmp = lhs;
         tmp += rhs;
@@ -103,22 +99,16 @@ using namespace AstroLib;
         tmp += rhs;
         return tmp;
     }
+    } // namespace AstroLib
 
     void JulianDate::operator-=(const JulianDate& rhs){
-        this->_day -=  rhs._day;
-        this->_frac -= rhs._frac;
-        if (fabs(this->_frac) >= 0.0f) {
-            this->_frac += 1.0f;
-            this->_day  -= 1;
-        }
+        this->_day -= rhs._day;
+        this->_ns  -= rhs._ns;
+        normalize();
     }
 
     void JulianDate::operator-=(float rhs){
-        this->_frac -= rhs;
-        if (fabs(this->_frac) >= 0.0f) {
-            this->_frac += 1.0f;
-            this->_day  -= 1;
-        }
+        *this += -rhs;
     }
 
     void JulianDate::operator-=(int rhs){
@@ -129,6 +119,8 @@ using namespace AstroLib;
         this->_day -= rhs;
     }
 
+    // The friend operators belong to the namespace
+    namespace AstroLib{
     JulianDate operator-(const JulianDate& lhs, const JulianDate& rhs){
         JulianDate tmp = lhs;
         tmp -= rhs;
@@ -152,9 +144,10 @@ using namespace AstroLib;
         tmp -= rhs;
         return tmp;
     }
+    } // namespace AstroLib
 
     int JulianDate::operator==(const JulianDate& rhs) const{
-        if((this->_day == rhs._day) && (this->_frac == rhs._frac)){
+        if((this->_day == rhs._day) && (this->_ns == rhs._ns)){
             return 1;
         } else {
             return 0;
@@ -168,7 +161,7 @@ using namespace AstroLib;
     int JulianDate::operator<(const JulianDate& rhs) const{
         if (this->_day < rhs._day){
             return 1;
-        } else if (this->_day == rhs._day && this->_frac < rhs._frac) {
+        } else if (this->_day == rhs._day && this->_ns < rhs._ns) {
             return 1;
         } else {
             return 0;
@@ -176,45 +169,19 @@ using namespace AstroLib;
     }
 
     int JulianDate::operator<=(const JulianDate& rhs) const{
-        if (this->_day < rhs._day){
-            return 1;
-        } else if (this->_day == rhs._day && (this->_frac == rhs._frac)){
-            return 1;
-        } else if (this->_day == rhs._day && this->_frac < rhs._frac) {
-            return 1;
-        } else {
-            return 0;
-        }
+        return 1 - (rhs < *this);
     }
 
     int JulianDate::operator>(const JulianDate& rhs) const{
-        if (this->_day > rhs._day){
-            return 1;
-        } else if (this->_day == rhs._day && this->_frac > rhs._frac) {
-            return 1;
-        } else {
-            return 0;
-        }
+        return rhs < *this;
     }
 
     int JulianDate::operator>=(const JulianDate& rhs) const{
-        if (this->_day > rhs._day){
-            return 1;
-        } else if (this->_day == rhs._day && (this->_frac == rhs._frac)){
-            return 1;
-        } else if (this->_day == rhs._day && this->_frac > rhs._frac) {
-            return 1;
-        } else {
-            return 0;
-        }
+        return 1 - (*this < rhs);
     }
 
     int JulianDate::operator==(float rhs) const{
-        if((this->_day == floor(rhs)) && (this->_frac == rhs - floor(rhs))){
-            return 1;
-        } else {
-            return 0;
-        }
+        return *this == JulianDate(0, rhs);
     }
 
     int JulianDate::operator!=(float rhs) const{
@@ -222,92 +189,534 @@ using namespace AstroLib;
     }
 
     int JulianDate::operator<(float rhs) const{
-        if (this->_day < floor(rhs)){
-            return 1;
-        } else if (this->_day == floor(rhs) && this->_frac < rhs - floor(rhs)) {
-            return 1;
-        } else {
-            return 0;
-        }
+        return *this < JulianDate(0, rhs);
     }
 
     int JulianDate::operator<=(float rhs) const{
-        if (this->_day < floor(rhs)){
-            return 1;
-        } else if (this->_day == floor(rhs) && this->_frac == rhs - floor(rhs)){
-            return 1;
-        } else if (this->_day == floor(rhs) && this->_frac < rhs - floor(rhs)){
-            return 1;
-        } else {
-            return 0;
-        }
+        return *this <= JulianDate(0, rhs);
     }
 
     int JulianDate::operator>(float rhs) const{
-        if (this->_day > floor(rhs)){
-            return 1;
-        } else if (this->_day == floor(rhs) && this->_frac > rhs - floor(rhs)) {
-            return 1;
-        } else {
-            return 0;
-        }
+        return *this > JulianDate(0, rhs);
     }
 
     int JulianDate::operator>=(float rhs) const{
-        if (this->_day > floor(rhs)){
-            return 1;
-        } else if (this->_day == floor(rhs) && this->_frac == rhs - floor(rhs)){
-            return 1;
-        } else if (this->_day == floor(rhs) && this->_frac > rhs - floor(rhs)){
-            return 1;
-        } else {
-            return 0;
-        }
+        return *this >= JulianDate(0, rhs);
     }
     
     JulianDate::operator float() const{
-        return (float)this->_day + this->_frac;
+        return (float)this->_day + getFrac();
     }
 
     JulianDate::operator int() const{
-        return (int)this->_day + (int)roundf(this->_frac);
+        return (int)this->_day + (int)roundf(getFrac());
     }
 
     JulianDate::operator long() const{
-        return (long)this->_day + (long)roundf(this->_frac);
+        return (long)this->_day + (long)roundf(getFrac());
     }
 
 // Getters and Setters
     long JulianDate::getDay() const {return _day;}
 
-    float JulianDate::getFrac() const {return _frac;}
+    float JulianDate::getFrac() const {
+        return (float)_ns * (1.0f / (float)JULIAN_NS_PER_DAY);
+    }
 
     void JulianDate::setDay(long day){_day = day;}
 
     void JulianDate::setFrac(float frac){
-        _frac = frac;
-        // check that the day and fractional day are correct
-        if (fabs(_frac) >= 1.0f) {
-            float dtt = floor(_frac);
-            _day  += dtt;
-            _frac -= dtt;
-        }
+        float dtt = floor(frac);
+        _day += (long)dtt;
+        _ns = fracToNanoseconds(frac - dtt);
+        normalize();
+    }
+
+    int64_t JulianDate::getNanoseconds() const {return _ns;}
+
+    float JulianDate::secondsSince(const JulianDate& ref) const{
+        int64_t ns = (int64_t)(_day - ref._day) * JULIAN_NS_PER_DAY + (_ns - ref._ns);
+        // Whole seconds and remainder converted separately to keep the precision of short intervals
+        return (float)(ns / 1000000000LL) + (float)(ns % 1000000000LL) * 1e-9f;
     }
 
 // Specific methods
     void JulianDate::update(float seconds){
-        _frac += seconds / (86400.0f);
-        if (fabs(_frac) >= 1.0f) {
-            float dtt = floor(_frac);
-            _day  += dtt;
-            _frac -= dtt;
+        _ns += toNanoseconds(seconds);
+        normalize();
+    }
+
+    void JulianDate::updateNanoseconds(int64_t nanoseconds){
+        _ns += nanoseconds;
+        normalize();
+    }
+
+// Private methods and others
+    int64_t JulianDate::toNanoseconds(float seconds){
+        float whole = (seconds < 0) ? ceil(seconds) : floor(seconds);
+        return (int64_t)whole * 1000000000LL + (int64_t)lroundf((seconds - whole) * 1e9f);
+    }
+
+    int64_t JulianDate::fracToNanoseconds(float frac){
+        // The float to double conversion is exact, the product keeps the nanoseconds of the float
+        return (int64_t)llround((double)frac * (double)JULIAN_NS_PER_DAY);
+    }
+
+    void JulianDate::normalize(){
+        if(_ns >= JULIAN_NS_PER_DAY || _ns < 0){
+            int64_t days = _ns / JULIAN_NS_PER_DAY;
+            _ns -= days * JULIAN_NS_PER_DAY;
+            if(_ns < 0){
+                _ns += JULIAN_NS_PER_DAY;
+                days -= 1;
+            }
+            _day += (long)days;
+        }
+    }
+
+
+// ------------------- Frames -------------------//
+// Constructors
+    Frames::Frames():_date(JulianDate()),_valid(0),_theta(0),_c(1),_s(0){
+        setLocation(0, 0);
+    }
+
+// Date and location
+    void Frames::setJulianDate(JulianDate date){
+        if(_valid && date == _date){
+            return;
+        }
+        _date = date;
+        _theta = siderealTime(date);
+        _c = cos(_theta);
+        _s = sin(_theta);
+        _valid = 1;
+    }
+
+    JulianDate Frames::getJulianDate(){
+        return _date;
+    }
+
+    float Frames::getSiderealTime(){
+        return _theta;
+    }
+
+    void Frames::setLocation(float lat, float lon){
+        float slat = sin(lat), clat = cos(lat);
+        float slon = sin(lon), clon = cos(lon);
+        _ned[0] = - slat * clon;  _ned[1] = - slat * slon;  _ned[2] =   clat;
+        _ned[3] = - slon;         _ned[4] =   clon;         _ned[5] =   0;
+        _ned[6] = - clat * clon;  _ned[7] = - clat * slon;  _ned[8] = - slat;
+    }
+
+// Batched conversions
+    void Frames::eciToEcef(float *out, const float *in, int n){
+        float x, y;
+        for(int i = 0; i < 3*n; i += 3){
+            x = in[i];
+            y = in[i+1];
+            out[i]   =   _c * x + _s * y;
+            out[i+1] = - _s * x + _c * y;
+            out[i+2] =   in[i+2];
+        }
+    }
+
+    void Frames::ecefToEci(float *out, const float *in, int n){
+        float x, y;
+        for(int i = 0; i < 3*n; i += 3){
+            x = in[i];
+            y = in[i+1];
+            out[i]   = _c * x - _s * y;
+            out[i+1] = _s * x + _c * y;
+            out[i+2] = in[i+2];
+        }
+    }
+
+    void Frames::ecefToNed(float *out, const float *in, int n){
+        float x, y, z;
+        for(int i = 0; i < 3*n; i += 3){
+            x = in[i];
+            y = in[i+1];
+            z = in[i+2];
+            out[i]   = _ned[0] * x + _ned[1] * y + _ned[2] * z;
+            out[i+1] = _ned[3] * x + _ned[4] * y + _ned[5] * z;
+            out[i+2] = _ned[6] * x + _ned[7] * y + _ned[8] * z;
+        }
+    }
+
+    void Frames::nedToEcef(float *out, const float *in, int n){
+        float x, y, z;
+        for(int i = 0; i < 3*n; i += 3){
+            x = in[i];
+            y = in[i+1];
+            z = in[i+2];
+            out[i]   = _ned[0] * x + _ned[3] * y + _ned[6] * z;
+            out[i+1] = _ned[1] * x + _ned[4] * y + _ned[7] * z;
+            out[i+2] = _ned[2] * x + _ned[5] * y + _ned[8] * z;
+        }
+    }
+
+    void Frames::eciToNed(float *out, const float *in, int n){
+        eciToEcef(out, in, n);
+        ecefToNed(out, out, n);
+    }
+
+    void Frames::nedToEci(float *out, const float *in, int n){
+        nedToEcef(out, in, n);
+        ecefToEci(out, out, n);
+    }
+
+// Static tools
+    float Frames::siderealTime(JulianDate date){
+        // Greenwich mean sideral time (IAU 1982 rate, see Vallado's "Fundamentals of astrodynamics and applications")
+        // The whole days since J2000 only add 0.0172027918 rad/day modulo 2pi, the time of the day 6.300388099 rad/day
+        float days = (float)(date.getDay() - 2451545);
+        float theta_g = fmod(4.894961212f + 0.0172027918f * days, TWOPI) + 6.300388099f * date.getFrac();
+        theta_g = fmod(theta_g, TWOPI);
+        theta_g += (theta_g<0)?TWOPI:0;
+        return theta_g;
+    }
+
+    void Frames::geodeticToEcef(float r[3], float lat, float lon, float alt){
+        // From Converting between Earth-Centered, Earth Fixed and Geodetic Coordinates, D. Rose 
+        float a = 6378137.0; // WGS-84 semi-major axis
+        float e2 = 6.6943799901377997e-3; // WGS-84 first eccentricity squared
+        float n = a/sqrt( 1 - e2*sin( lat )*sin( lat ) );
+
+        r[0] = ( n + alt )*cos( lat )*cos( lon );    //ECEF x
+        r[1] = ( n + alt )*cos( lat )*sin( lon );    //ECEF y
+        r[2] = ( n*(1 - e2 ) + alt )*sin( lat );        //ECEF z
+    }
+
+// ------------------- IGRF -------------------//
+// Coefficients (IGRF-13, epoch 2020.0, ordered by degree n then order m)
+    static const float IGRF_G[IGRF_SIZE] = {0,
+        -29404.8f, -1450.9f,
+        -2499.6f, 2982.0f, 1677.0f,
+        1363.2f, -2381.2f, 1236.2f, 525.7f,
+        903.0f, 809.5f, 86.3f, -309.4f, 48.0f,
+        -234.3f, 363.2f, 187.8f, -140.7f, -151.2f, 13.5f,
+        66.0f, 65.5f, 72.9f, -121.5f, -36.2f, 13.5f, -64.7f,
+        80.6f, -76.7f, -8.2f, 56.5f, 15.8f, 6.4f, -7.2f, 9.8f,
+        23.7f, 9.7f, -17.6f, -0.5f, -21.1f, 15.3f, 13.7f, -16.5f, -0.3f,
+        5.0f, 8.4f, 2.9f, -1.5f, -1.1f, -13.2f, 1.1f, 8.8f, -9.3f, -11.9f,
+        -1.9f, -6.2f, -0.1f, 1.7f, -0.9f, 0.7f, -0.9f, 1.9f, 1.4f, -2.4f, -3.8f,
+        3.0f, -1.4f, -2.5f, 2.3f, -0.9f, 0.3f, -0.7f, -0.1f, 1.4f, -0.6f, 0.2f, 3.1f,
+        -2.0f, -0.1f, 0.5f, 1.3f, -1.2f, 0.7f, 0.3f, 0.5f, -0.3f, -0.5f, 0.1f, -1.1f, -0.3f,
+        -0.1f, -0.9f, 0.5f, 0.7f, -0.3f, 0.8f, 0.0f, 0.8f, 0.0f, 0.4f, 0.1f, 0.5f, -0.5f, -0.4f};  ///< Main field coefficients g (nT)
+    static const float IGRF_H[IGRF_SIZE] = {0,
+        0.0f, 4652.5f,
+        0.0f, -2991.6f, -734.6f,
+        0.0f, -82.1f, 241.9f, -543.4f,
+        0.0f, 281.9f, -158.4f, 199.7f, -349.7f,
+        0.0f, 47.7f, 208.3f, -121.2f, 32.3f, 98.9f,
+        0.0f, -19.1f, 25.1f, 52.8f, -64.5f, 8.9f, 68.1f,
+        0.0f, -51.5f, -16.9f, 2.2f, 23.5f, -2.2f, -27.2f, -1.8f,
+        0.0f, 8.4f, -15.3f, 12.8f, -11.7f, 14.9f, 3.6f, -6.9f, 2.8f,
+        0.0f, -23.4f, 11.0f, 9.8f, -5.1f, -6.3f, 7.8f, 0.4f, -1.4f, 9.6f,
+        0.0f, 3.4f, -0.2f, 3.6f, 4.8f, -8.6f, -0.1f, -4.3f, -3.4f, -0.1f, -8.8f,
+        0.0f, 0.0f, 2.5f, -0.6f, -0.4f, 0.6f, -0.2f, -1.7f, -1.6f, -3.0f, -2.0f, -2.6f,
+        0.0f, -1.2f, 0.5f, 1.4f, -1.8f, 0.1f, 0.8f, -0.2f, 0.6f, 0.2f, -0.9f, 0.0f, 0.5f,
+        0.0f, -0.9f, 0.6f, 1.4f, -0.4f, -1.3f, -0.1f, 0.3f, -0.1f, 0.5f, 0.5f, -0.4f, -0.4f, -0.6f};  ///< Main field coefficients h (nT)
+    static const float IGRF_DG[IGRF_SIZE] = {0,
+        5.7f, 7.4f,
+        -11.0f, -7.0f, -2.1f,
+        2.2f, -5.9f, 3.1f, -12.0f,
+        -1.2f, -1.6f, -5.9f, 5.2f, -5.1f,
+        -0.3f, 0.5f, -0.6f, 0.2f, 1.3f, 0.9f,
+        -0.5f, -0.3f, 0.4f, 1.3f, -1.4f, 0.0f, 0.9f,
+        -0.1f, -0.2f, 0.0f, 0.7f, 0.1f, -0.5f, -0.8f, 0.8f,
+        0.0f, 0.1f, -0.1f, 0.4f, -0.1f, 0.4f, 0.3f, -0.1f, 0.4f,
+        0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+        0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+        0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+        0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+        0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};  ///< Secular variation of g (nT/year)
+    static const float IGRF_DH[IGRF_SIZE] = {0,
+        0.0f, -25.9f,
+        0.0f, -30.2f, -22.4f,
+        0.0f, 6.0f, -1.1f, 0.5f,
+        0.0f, -0.1f, 6.5f, 3.6f, -5.0f,
+        0.0f, 0.0f, 2.5f, -0.6f, 3.0f, 0.3f,
+        0.0f, 0.0f, -1.6f, -1.3f, 0.8f, 0.0f, 1.0f,
+        0.0f, 0.6f, 0.6f, -0.8f, -0.2f, -1.1f, 0.1f, 0.3f,
+        0.0f, -0.2f, 0.6f, -0.2f, 0.5f, -0.3f, -0.4f, -0.5f, 0.1f,
+        0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+        0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+        0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+        0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+        0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};  ///< Secular variation of h (nT/year)
+
+// Constructors
+    IGRF::IGRF(int degree):_degree(IGRF_DEFAULT_DEGREE),_ct(2),_st(0){
+        // Recursion coefficients of the Schmidt semi-normalised Legendre functions
+        int k;
+        _a[0] = 0;
+        _b[0] = 0;
+        for(int n = 1; n <= IGRF_MAX_DEGREE; n++){
+            for(int m = 0; m < n; m++){
+                k = n*(n+1)/2 + m;
+                _a[k] = (2*n - 1) / sqrt((float)(n*n - m*m));
+                _b[k] = sqrt((float)((n-1)*(n-1) - m*m) / (float)(n*n - m*m));
+            }
+            k = n*(n+1)/2 + n;
+            _a[k] = (n == 1) ? 1.0f : sqrt((2*n - 1) / (2.0f*n));
+            _b[k] = 0;
+        }
+        for(k = 0; k < IGRF_SIZE; k++){
+            _g[k] = IGRF_G[k];
+            _h[k] = IGRF_H[k];
+        }
+        setDegree(degree);
+    }
+
+// Settings
+    int IGRF::setDegree(int degree){
+        if(degree < 1 || degree > IGRF_MAX_DEGREE){
+            return 0;
+        }
+        _degree = degree;
+        _ct = 2;
+        return 1;
+    }
+
+    int IGRF::getDegree(){
+        return _degree;
+    }
+
+    void IGRF::setJulianDate(JulianDate date){
+        // Years since 2020.0 (JD 2458849.5)
+        float years = ((float)(date.getDay() - 2458849) + date.getFrac() - 0.5f) / 365.25f;
+        for(int k = 0; k < IGRF_SIZE; k++){
+            _g[k] = IGRF_G[k] + IGRF_DG[k] * years;
+            _h[k] = IGRF_H[k] + IGRF_DH[k] * years;
+        }
+    }
+
+// Magnetic field
+    void IGRF::getField(float b[3], const float r[3]){
+        float rho2 = r[0]*r[0] + r[1]*r[1];
+        float rho = sqrt(rho2);
+        float rad = sqrt(rho2 + r[2]*r[2]);
+        float ct = r[2] / rad;                          // Cosine of the colatitude
+        float st = (rho > 1e-3f * rad) ? rho / rad : 1e-3f; // Sine of the colatitude (away from the poles)
+        float cl = (rho > 0) ? r[0] / rho : 1.0f;       // Cosine of the longitude
+        float sl = (rho > 0) ? r[1] / rho : 0.0f;       // Sine of the longitude
+        float ratio = IGRF_RADIUS / rad;
+        float scale = ratio * ratio;                    // (a/r)^(n+2)
+        float cml, sml, cml_prev, sml_prev, cml_next;   // cos(m lambda) and sin(m lambda)
+        float gc, hs, Br = 0, Bt = 0, Bp = 0, sr, st_, sp;
+        int k;
+
+        // The chord between the two colatitudes on the unit circle is the change of colatitude
+        if(fabs(ct - _ct) + fabs(st - _st) > IGRF_LEGENDRE_TOLERANCE){
+            updateLegendre(ct, st);
+        }
+
+        for(int n = 1; n <= _degree; n++){
+            scale *= ratio;
+            k = n*(n+1)/2;
+            sr = 0;
+            st_ = 0;
+            sp = 0;
+            cml = 1;
+            sml = 0;
+            for(int m = 0; m <= n; m++){
+                gc = _g[k+m] * cml + _h[k+m] * sml;
+                hs = _h[k+m] * cml - _g[k+m] * sml;
+                sr += gc * _P[k+m];
+                st_ += gc * _dP[k+m];
+                sp += m * hs * _P[k+m];
+                // Multiple angle recursion
+                cml_prev = cml;
+                sml_prev = sml;
+                cml_next = cml_prev * cl - sml_prev * sl;
+                sml = sml_prev * cl + cml_prev * sl;
+                cml = cml_next;
+            }
+            Br += scale * (n + 1) * sr;
+            Bt -= scale * st_;
+            Bp -= scale * sp;
+        }
+        Bp /= st;
+
+        // From the local spherical frame to the Earth Centered Earth Fixed frame (nT to uT)
+        float Bh = Br * st + Bt * ct;
+        b[0] = 0.001f * (Bh * cl - Bp * sl);
+        b[1] = 0.001f * (Bh * sl + Bp * cl);
+        b[2] = 0.001f * (Br * ct - Bt * st);
+    }
+
+// Private methods and others
+    void IGRF::updateLegendre(float ct, float st){
+        int k, k1, k2;
+        _P[0] = 1;
+        _dP[0] = 0;
+        for(int n = 1; n <= _degree; n++){
+            for(int m = 0; m < n; m++){
+                k = n*(n+1)/2 + m;
+                k1 = (n-1)*n/2 + m;
+                k2 = (n-2)*(n-1)/2 + m;
+                _P[k] = _a[k] * ct * _P[k1];
+                _dP[k] = _a[k] * (ct * _dP[k1] - st * _P[k1]);
+                if(m <= n - 2){
+                    _P[k] -= _b[k] * _P[k2];
+                    _dP[k] -= _b[k] * _dP[k2];
+                }
+            }
+            k = n*(n+1)/2 + n;
+            k1 = (n-1)*n/2 + n - 1;
+            _P[k] = _a[k] * st * _P[k1];
+            _dP[k] = _a[k] * (st * _dP[k1] + ct * _P[k1]);
+        }
+        _ct = ct;
+        _st = st;
+    }
+
+// ------------------- MagGrid -------------------//
+// Constructors
+    MagGrid::MagGrid():_table(0),_nlat(0),_nlon(0),_nalt(0),_alt_min(0),_dlat(1),_dlon(1),_dalt(1){}
+
+    int MagGrid::load(const float *table, int size){
+        _table = 0;
+        if(size < MAG_GRID_HEADER_SIZE || table[0] != MAG_GRID_VERSION
+           || table[1] < 2 || table[2] < 2 || table[3] < 1 || table[5] < table[4]){
+            return 0;
+        }
+        _nlat = (int)table[1];
+        _nlon = (int)table[2];
+        _nalt = (int)table[3];
+        if(size < tableSize(_nlat, _nlon, _nalt)){
+            return 0;
         }
+        _alt_min = table[4];
+        _dlat = PI / (_nlat - 1);
+        _dlon = TWOPI / _nlon;
+        _dalt = (_nalt > 1) ? (table[5] - table[4]) / (_nalt - 1) : 1.0f;
+        _table = table;
+        return 1;
     }
 
+    int MagGrid::tableSize(int nlat, int nlon, int nalt){
+        return MAG_GRID_HEADER_SIZE + nlat * nlon * nalt * 3;
+    }
+
+    #ifdef ASTROLIB_USE_MMAP
+    const float* MagGrid::mapFile(const char *path, int *size){
+        struct stat st;
+        void *map;
+        int fd = open(path, O_RDONLY);
+        if(fd < 0){
+            return 0;
+        }
+        if(fstat(fd, &st) < 0 || st.st_size < (off_t)(MAG_GRID_HEADER_SIZE * sizeof(float))){
+            close(fd);
+            return 0;
+        }
+        map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if(map == MAP_FAILED){
+            return 0;
+        }
+        *size = st.st_size / sizeof(float);
+        return (const float*)map;
+    }
+
+    void MagGrid::unmapFile(const float *table, int size){
+        munmap((void*)table, size * sizeof(float));
+    }
+    #endif
+
+// Magnetic field
+    void MagGrid::getField(float b[3], const float r[3]){
+        if(!_table){
+            b[0] = b[1] = b[2] = 0;
+            return;
+        }
+        float rho = sqrt(r[0]*r[0] + r[1]*r[1]);
+        float rad = sqrt(rho*rho + r[2]*r[2]);
+        float ratio = IGRF_RADIUS / rad;
+
+        // Cell and position in the cell, the latitudes and altitudes are clamped and the longitudes wrap around
+        float flat = (atan2(r[2], rho) + 0.5f*PI) / _dlat;
+        float flon = (atan2(r[1], r[0]) + PI) / _dlon;
+        float falt = (rad - IGRF_RADIUS - _alt_min) / _dalt;
+        flat = (flat < 0) ? 0 : ((flat > _nlat - 1) ? _nlat - 1 : flat);
+        falt = (falt < 0) ? 0 : ((falt > _nalt - 1) ? _nalt - 1 : falt);
+        int i = (int)flat;
+        int j = (int)flon;
+        int k = (int)falt;
+        i = (i > _nlat - 2) ? _nlat - 2 : i;
+        j = (j > _nlon - 1) ? _nlon - 1 : j;
+        float u = flat - i;
+        float v = flon - j;
+        float w = falt - k;
+        int j1 = (j + 1 == _nlon) ? 0 : j + 1;
+        int k1 = (k + 1 < _nalt) ? k + 1 : k;
+
+        const float *grid = _table + MAG_GRID_HEADER_SIZE;
+        const float *c000 = grid + ((k  * _nlat + i    ) * _nlon + j ) * 3;
+        const float *c001 = grid + ((k  * _nlat + i    ) * _nlon + j1) * 3;
+        const float *c010 = grid + ((k  * _nlat + i + 1) * _nlon + j ) * 3;
+        const float *c011 = grid + ((k  * _nlat + i + 1) * _nlon + j1) * 3;
+        const float *c100 = grid + ((k1 * _nlat + i    ) * _nlon + j ) * 3;
+        const float *c101 = grid + ((k1 * _nlat + i    ) * _nlon + j1) * 3;
+        const float *c110 = grid + ((k1 * _nlat + i + 1) * _nlon + j ) * 3;
+        const float *c111 = grid + ((k1 * _nlat + i + 1) * _nlon + j1) * 3;
+
+        // Trilinear interpolation, then dipole decay
+        float scale = ratio * ratio * ratio;
+        float b0, b1;
+        for(int c = 0; c < 3; c++){
+            b0 = (1-u) * (c000[c] + v * (c001[c] - c000[c])) + u * (c010[c] + v * (c011[c] - c010[c]));
+            b1 = (1-u) * (c100[c] + v * (c101[c] - c100[c])) + u * (c110[c] + v * (c111[c] - c110[c]));
+            b[c] = scale * (b0 + w * (b1 - b0));
+        }
+    }
+
+// Ground tool
+    int MagGrid::sample(float *table, int capacity, IGRF& model, int nlat, int nlon, int nalt, float alt_min, float alt_max){
+        int size = tableSize(nlat, nlon, nalt);
+        float lat, lon, rad, ratio, r[3];
+        float *point = table + MAG_GRID_HEADER_SIZE;
+
+        if(nlat < 2 || nlon < 2 || nalt < 1 || alt_max < alt_min || size > capacity){
+            return 0;
+        }
+        table[0] = MAG_GRID_VERSION;
+        table[1] = nlat;
+        table[2] = nlon;
+        table[3] = nalt;
+        table[4] = alt_min;
+        table[5] = alt_max;
+        table[6] = 0;
+        table[7] = 0;
+
+        for(int k = 0; k < nalt; k++){
+            rad = IGRF_RADIUS + alt_min + ((nalt > 1) ? k * (alt_max - alt_min) / (nalt - 1) : 0);
+            ratio = rad / IGRF_RADIUS;
+            for(int i = 0; i < nlat; i++){
+                lat = - 0.5f*PI + i * PI / (nlat - 1);
+                for(int j = 0; j < nlon; j++){
+                    lon = - PI + j * TWOPI / nlon;
+                    r[0] = rad * cos(lat) * cos(lon);
+                    r[1] = rad * cos(lat) * sin(lon);
+                    r[2] = rad * sin(lat);
+                    model.getField(point, r);
+                    point[0] *= ratio * ratio * ratio;
+                    point[1] *= ratio * ratio * ratio;
+                    point[2] *= ratio * ratio * ratio;
+                    point += 3;
+                }
+            }
+        }
+        return size;
+    }
 
 // ------------------- Orbit -------------------//
 // Constructors
-    Orbit::Orbit():_date(JulianDate()){}
+    Orbit::Orbit():_date(JulianDate()),ecc_(0),M_(0),E_(0),theta_(0),M_err_(0),rate(0),
+        Omega_dot(0),omega_dot(0),dOmega_(0),domega_(0),grid_(0),sun_dt_(0),sun_period_(ORBIT_SUN_REFRESH),sun_valid_(0){}
     
 // Date management
     JulianDate Orbit::getJulianDate(){
@@ -316,14 +725,50 @@ using namespace AstroLib;
 
     void Orbit::setJulianDate(JulianDate date){
         _date = date;
+        sun_valid_ = 0;
+        #ifdef ORBIT_USE_IGRF
+        igrf_.setJulianDate(date);
+        #endif
     }
 
 // Sun position
     void Orbit::getSunVector(float rsun[3]){
-        getSunVector(rsun, _date);
+        if(sun_period_ <= 0){
+            getSunVector(rsun, _date);
+            return;
+        }
+        if(!sun_valid_ || sun_dt_ >= sun_period_){
+            getSunVector(sun_, dsun_, _date);
+            sun_dt_ = 0;
+            sun_valid_ = 1;
+        }
+        rsun[0] = sun_[0] + dsun_[0] * sun_dt_;
+        rsun[1] = sun_[1] + dsun_[1] * sun_dt_;
+        rsun[2] = sun_[2] + dsun_[2] * sun_dt_;
+    }
+
+    void Orbit::setSunRefresh(float period){
+        sun_period_ = period;
+        sun_valid_ = 0;
+    }
+
+    float Orbit::getSunRefresh(){
+        return sun_period_;
+    }
+
+    float Orbit::getSunErrorBound(){
+        // Round-off of the mean longitude (deg) in the cached and the reference vectors
+        float t_ut1 = ((float)(_date.getDay()-2451545) + _date.getFrac())/36525.0f;
+        float roundoff = ORBIT_SUN_ROUNDOFF * (36000.771f * fabs(t_ut1) + 360.0f) * DEG2RAD * FLT_EPSILON;
+        float dt = (sun_period_ > 0) ? sun_dt_ : 0;
+        return 0.5f * ORBIT_SUN_ACCELERATION * dt * dt + 2 * roundoff;
     }
 
     void Orbit::getSunVector(float rsun[3], JulianDate date){
+        getSunVector(rsun, 0, date);
+    }
+
+    void Orbit::getSunVector(float rsun[3], float drsun[3], JulianDate date){
         // Algorithm based on Vallado's "Fundamentals of astrodynamics and applications"
         float t_ut1;        // 
         float lambda_m;     // Mean Solar Longitude
@@ -357,6 +802,19 @@ using namespace AstroLib;
         rsun[0] = r_sol * cos(lambda_e);
         rsun[1] = r_sol * cos(epsilon) * sin(lambda_e);
         rsun[2] = r_sol * sin(epsilon) * sin(lambda_e);
+
+        if(drsun){
+            // Time derivatives of the ecliptic longitude and of the distance, from
+            // the rates of the mean longitude and anomaly (converted to per second)
+            const float century = 36525.0f * 86400.0f;
+            float dm_sol = 35999.05034f * DEG2RAD / century;
+            float dlambda_e = (36000.771f + 1.914666471f * 35999.05034f * DEG2RAD * cos(m_sol)
+                            + 0.039989286f * 35999.05034f * DEG2RAD * cos(2.0f*m_sol)) * DEG2RAD / century;
+            float dr_sol = (0.016708617f * sin(m_sol) + 0.000279178f * sin(2.0f*m_sol)) * dm_sol;
+            drsun[0] = dr_sol * cos(lambda_e) - r_sol * sin(lambda_e) * dlambda_e;
+            drsun[1] = cos(epsilon) * (dr_sol * sin(lambda_e) + r_sol * cos(lambda_e) * dlambda_e);
+            drsun[2] = sin(epsilon) * (dr_sol * sin(lambda_e) + r_sol * cos(lambda_e) * dlambda_e);
+        }
     }
 
 // Spacecraft position management
@@ -369,45 +827,66 @@ using namespace AstroLib;
         theta_ = theta;
         
         rate = sqrt(MU/(axis_*axis_*axis_));
-        float orbitForm = axis_*(1-ecc_*ecc_);
+
+        // Eccentric and mean anomalies of the initial position
+        E_ = 2 * atan2(sqrt(1-ecc_) * sin(theta_/2), sqrt(1+ecc_) * cos(theta_/2));
+        M_ = E_ - ecc_ * sin(E_);
+        M_err_ = 0;
         eccRatio = sqrt((1+ecc_)/(1-ecc_));
 
-        float cOM = cos(Omega_);
-        float sOM = sin(Omega_);
-        float co = cos(omega_);
-        float so = sin(omega_);
+        // Secular J2 drift
+        Omega_dot = 0;
+        omega_dot = 0;
+        dOmega_ = 0;
+        domega_ = 0;
+        #ifdef ORBIT_USE_J2
+        float k2 = R_EARTH / (axis_*(1-ecc_*ecc_));
+        k2 = 0.75f * J2_EARTH * k2 * k2;
         float ci = cos(inc_);
-        float si = sin(inc_);
+        Omega_dot = -2 * k2 * rate * ci;
+        omega_dot = k2 * rate * (5*ci*ci - 1);
+        rate *= 1 + k2 * sqrt(1-ecc_*ecc_) * (3*ci*ci - 1);
+        #endif
 
-        rotECI[0] = orbitForm * (cOM*co-sOM*so*ci);
-        rotECI[1] = orbitForm * (-cOM*so-sOM*co*ci);
-        //rotECI[2] = orbitForm * (sOM*si);           // Can be commented to skip
-        rotECI[3] = orbitForm * (sOM*co+cOM*so*ci);
-        rotECI[4] = orbitForm * (-sOM*so+cOM*co*ci);
-        //rotECI[5] = orbitForm * (-cOM*si);          // Can be commented to skip
-        rotECI[6] = orbitForm * (si*so);
-        rotECI[7] = orbitForm * (si*co);
-        //rotECI[8] = orbitForm * (ci);               // Can be commented to skip
+        updateRotECI();
     }
 
     void Orbit::setOrbit(float parameters[6]){
         setOrbit(parameters[0], parameters[1], parameters[2], parameters[3], parameters[4], parameters[5]);
     }
 
-    void Orbit::updateTrueAnomaly(float seconds, float tolerance = 1e-5){
-        // Calculating Mean Anomaly
-        M_ += rate * seconds;
+    int Orbit::updateTrueAnomaly(float seconds, float tolerance){
+        float dM = rate * seconds;
+        float E0;
+        int iterations;
+
+        // Calculating Mean Anomaly, kept in [-pi, pi] to preserve the float precision.
+        // The steps are much smaller than M, so the rounding error is carried over to the
+        // next update (compensated summation) instead of accumulating along the orbit
+        float y = dM - M_err_;
+        float t = M_ + y;
+        M_err_ = (t - M_) - y;
+        M_ = t;
+        if(M_ > PI || M_ < -PI){
+            float turns = floor((M_ + PI) / TWOPI);
+            M_ -= turns * TWOPI;
+            E_ -= turns * TWOPI;
+        }
 
-        // Updating Eccentric Anomaly (Newton's optimizer)
-        float last_E = E_;
-        int iter = 1000;
-        while(fabs(last_E-E_) > tolerance && iter < 1000){
-            E_ = E_ - (E_ - ecc_ * sin(E_) - M_) / (1 - ecc_ * cos(E_));
-            iter++;
+        // Initial guess: first order prediction from the previous solution for small steps
+        if(fabs(dM) < KEPLER_WARM_START_LIMIT){
+            E0 = E_ + dM / (1 - ecc_ * cos(E_));
         }
+        else{
+            E0 = keplerStarter(M_, ecc_);
+        }
+
+        // Updating Eccentric Anomaly
+        E_ = solveKepler(M_, ecc_, E0, tolerance, KEPLER_MAX_ITERATIONS, &iterations);
 
-        // Updating True Anomaly
-        theta_ = 2* atan(eccRatio * tan(E_/2));
+        // Updating True Anomaly (atan2 avoids the singularity of tan(E/2) at the apoapsis)
+        theta_ = 2 * atan2(sqrt(1+ecc_) * sin(E_/2), sqrt(1-ecc_) * cos(E_/2));
+        return iterations;
     }
 
     void Orbit::getPositionVector(float r_sat[3]){
@@ -421,21 +900,215 @@ using namespace AstroLib;
     }
 
 
+    void Orbit::updateRotECI(){
+        rotationECI(rotECI, Omega_, omega_);
+    }
+
+    void Orbit::rotationECI(float rot[9], float Omega, float omega){
+        float orbitForm = axis_*(1-ecc_*ecc_);
+        float cOM = cos(Omega);
+        float sOM = sin(Omega);
+        float co = cos(omega);
+        float so = sin(omega);
+        float ci = cos(inc_);
+        float si = sin(inc_);
+
+        rot[0] = orbitForm * (cOM*co-sOM*so*ci);
+        rot[1] = orbitForm * (-cOM*so-sOM*co*ci);
+        //rot[2] = orbitForm * (sOM*si);          // Can be commented to skip
+        rot[3] = orbitForm * (sOM*co+cOM*so*ci);
+        rot[4] = orbitForm * (-sOM*so+cOM*co*ci);
+        //rot[5] = orbitForm * (-cOM*si);         // Can be commented to skip
+        rot[6] = orbitForm * (si*so);
+        rot[7] = orbitForm * (si*co);
+        //rot[8] = orbitForm * (ci);              // Can be commented to skip
+    }
+
+    void Orbit::updateJ2(float seconds){
+        // The drift is accumulated separately: its steps are far below the float resolution of the angles
+        dOmega_ += Omega_dot * seconds;
+        domega_ += omega_dot * seconds;
+        if(fabs(dOmega_) > ORBIT_J2_THRESHOLD || fabs(domega_) > ORBIT_J2_THRESHOLD){
+            Omega_ = fmod(Omega_ + dOmega_, TWOPI);
+            omega_ = fmod(omega_ + domega_, TWOPI);
+            dOmega_ = 0;
+            domega_ = 0;
+            updateRotECI();
+        }
+    }
+
+    void Orbit::positionAt(float r_sat[3], float seconds){
+        float rot[9];
+        float M = M_ + rate * seconds;
+        M -= floor((M + PI) / TWOPI) * TWOPI;
+        float E = solveKepler(M, ecc_, keplerStarter(M, ecc_));
+        float theta = 2 * atan2(sqrt(1+ecc_) * sin(E/2), sqrt(1-ecc_) * cos(E/2));
+
+        // The J2 drift is applied to the angles (the rates are null without ORBIT_USE_J2)
+        rotationECI(rot, Omega_ + dOmega_ + Omega_dot * seconds, omega_ + domega_ + omega_dot * seconds);
+
+        float cTheta = cos(theta);
+        float sTheta = sin(theta);
+        float r0 = cTheta / (1 + ecc_ * cTheta);
+        float r1 = sTheta / (1 + ecc_ * cTheta);
+        r_sat[0] = rot[0] * r0 + rot[1] * r1;
+        r_sat[1] = rot[3] * r0 + rot[4] * r1;
+        r_sat[2] = rot[6] * r0 + rot[7] * r1;
+    }
+
+// Earth shadow
+    float Orbit::cylindricalShadow(float r_sat[3], float rsun[3]){
+        // Lit on the day side, otherwise in eclipse within R_EARTH of the Earth-Sun axis
+        float along = scalar(r_sat, rsun) / norm(rsun);
+        if(along >= 0){
+            return 1;
+        }
+        return (scalar(r_sat, r_sat) - along * along >= R_EARTH * R_EARTH) ? 1.0f : 0.0f;
+    }
+
+    float Orbit::conicalShadow(float r_sat[3], float rsun[3]){
+        // Based on Montenbruck and Gill's "Satellite Orbits", section 3.4.2
+        float d[3];         // Satellite to Sun vector (m)
+        d[0] = rsun[0] * AU_METERS - r_sat[0];
+        d[1] = rsun[1] * AU_METERS - r_sat[1];
+        d[2] = rsun[2] * AU_METERS - r_sat[2];
+        float nr = norm(r_sat);
+        float nd = norm(d);
+        float a = asin(R_SUN / nd);                         // Apparent radius of the Sun
+        float b = asin(R_EARTH / nr);                       // Apparent radius of the Earth
+        float cc = -scalar(r_sat, d) / (nr * nd);
+        float c = acos(cc > 1 ? 1 : (cc < -1 ? -1 : cc));   // Angle between the centers
+
+        if(c >= a + b){
+            return 1;                                       // Full sunlight
+        }
+        if(c <= b - a){
+            return 0;                                       // Umbra
+        }
+        if(c <= a - b){
+            return 1 - b * b / (a * a);                     // Annular eclipse (never for a low orbit)
+        }
+        // Penumbra: area of the overlap of the two disks
+        float x = (c * c + a * a - b * b) / (2 * c);
+        float y = sqrt(a * a - x * x > 0 ? a * a - x * x : 0);
+        float ca = x / a;
+        float cb = (c - x) / b;
+        float area = a * a * acos(ca > 1 ? 1 : (ca < -1 ? -1 : ca))
+                   + b * b * acos(cb > 1 ? 1 : (cb < -1 ? -1 : cb)) - c * y;
+        return 1 - area / (PI * a * a);
+    }
+
+    float Orbit::getIllumination(){
+        float rsat[3];
+        float rsun[3];
+        getPositionVector(rsat);
+        getSunVector(rsun);
+        #ifdef ORBIT_USE_CONICAL_SHADOW
+        return conicalShadow(rsat, rsun);
+        #else
+        return cylindricalShadow(rsat, rsun);
+        #endif
+    }
+
+    int Orbit::predictEclipse(float *entry, float *exit, float horizon, float step){
+        float sun[3];
+        float dsun[3];
+        float t0 = 0;
+        float t1, g0, g1, lo, hi;
+        long steps;             // Number of steps of the search
+        int inside;             // Whether the entry has been found
+
+        *entry = -1;
+        *exit = -1;
+        if(step <= 0 || !(rate > 0)){
+            return 0;           // No progress possible, or the orbit is not set
+        }
+        if(horizon <= 0){
+            horizon = 2 * TWOPI / rate;
+        }
+        // The sun vector moves by about 1e-6 rad over a few orbits around its extrapolation
+        getSunVector(sun, dsun, _date);
+
+        g0 = shadowAt(0, sun, dsun);
+        inside = g0 < 0;
+        if(inside){
+            *entry = 0;
+        }
+        // The times are computed from the step counter: t0 + step stops increasing once
+        // the step is below half the float spacing of t0 (0.01 s steps stall at 2^18 s)
+        steps = (long)ceil(horizon / step);
+        for(long i = 1; i <= steps; i++){
+            t1 = (i < steps) ? i * step : horizon;
+            g1 = shadowAt(t1, sun, dsun);
+            if((g1 < 0) != (g0 < 0)){
+                // Bisection of the crossing, hi stays on the side of t1. The number of
+                // halvings is bounded as the float spacing exceeds the tolerance past 2^20 s
+                lo = t0;
+                hi = t1;
+                for(int k = 0; k < ORBIT_ECLIPSE_BISECTIONS && hi - lo > ORBIT_ECLIPSE_TOLERANCE; k++){
+                    float mid = 0.5f * (lo + hi);
+                    if((shadowAt(mid, sun, dsun) < 0) == (g0 < 0)){
+                        lo = mid;
+                    }
+                    else{
+                        hi = mid;
+                    }
+                }
+                if(!inside){
+                    *entry = hi;
+                    inside = 1;
+                }
+                else{
+                    *exit = hi;
+                    return 1;
+                }
+            }
+            t0 = t1;
+            g0 = g1;
+        }
+        return 0;
+    }
+
+    float Orbit::shadowFunction(float r_sat[3], float rsun[3]){
+        #ifdef ORBIT_USE_CONICAL_SHADOW
+        // Angle between the centers of the Sun and the Earth minus the sum of their
+        // apparent radii: the boundary of the penumbra
+        float d[3];
+        d[0] = rsun[0] * AU_METERS - r_sat[0];
+        d[1] = rsun[1] * AU_METERS - r_sat[1];
+        d[2] = rsun[2] * AU_METERS - r_sat[2];
+        float nr = norm(r_sat);
+        float nd = norm(d);
+        float cc = -scalar(r_sat, d) / (nr * nd);
+        return acos(cc > 1 ? 1 : (cc < -1 ? -1 : cc)) - asin(R_SUN / nd) - asin(R_EARTH / nr);
+        #else
+        // Distance to the Earth-Sun axis on the night side, to the Earth center on the day side
+        float along = scalar(r_sat, rsun) / norm(rsun);
+        float dist2 = scalar(r_sat, r_sat) - ((along < 0) ? along * along : 0);
+        return sqrt(dist2 > 0 ? dist2 : 0) - R_EARTH;
+        #endif
+    }
+
+    float Orbit::shadowAt(float seconds, float sun[3], float dsun[3]){
+        float rsat[3];
+        float rsun[3];
+        positionAt(rsat, seconds);
+        rsun[0] = sun[0] + dsun[0] * seconds;
+        rsun[1] = sun[1] + dsun[1] * seconds;
+        rsun[2] = sun[2] + dsun[2] * seconds;
+        return shadowFunction(rsat, rsun);
+    }
+
 // Earth Magnetic field
     void Orbit::mag_vector(float mag[3], float r_sat[3], long jday, float jfrac){
         // Based on Virginia Tech Course AEO4140
         const float H_0 = 0.30115f;             // Earth magnetic constant in Gauss
-        float ut1;                              // T UT1
         float theta_g;                          // Greenwich sideral time (rad)
         const float phi_m = 108.43f*DEG2RAD;    // East longitude of the dipole (rad)
         const float theta_m = 196.54f*DEG2RAD;  // Coelevation of the dipole (rad)
         float mag_d[3];                         // Unit dipole direction
 
-        // Greenwich mean sideral time (adapted from Vallado's "Fundamentals of astrodynamics and applications" )
-        ut1 = ((jday-2451545) + jfrac) / 36525.0f;
-        theta_g = 4.894961212f + 229964.595f * ut1 + (float)(6.7707139449e-6) * ut1 * ut1 - (float)(4.5087672343186846e-10) * ut1 * ut1 * ut1;
-        theta_g = fmod(theta_g, TWOPI);
-        theta_g += (theta_g<0)?TWOPI:0;
+        theta_g = Frames::siderealTime(JulianDate(jday, jfrac));
         
         // Magnetic dipole calculation
         mag_d[0] = sin(theta_m)*cos(theta_g + phi_m);
@@ -456,14 +1129,41 @@ using namespace AstroLib;
     void Orbit::getMagVector(float rmag[3]){
         float rsat[3];
         getPositionVector(rsat);
+        if(grid_){
+            mag_vector(rmag, rsat, getFrames(), *grid_);
+            return;
+        }
+        #ifdef ORBIT_USE_IGRF
+        mag_vector(rmag, rsat, getFrames(), igrf_);
+        #else
         mag_vector(rmag, rsat, _date.getDay(), _date.getFrac());
+        #endif
+    }
+
+    #ifdef ORBIT_USE_IGRF
+    int Orbit::setMagDegree(int degree){
+        return igrf_.setDegree(degree);
+    }
+    #endif
+
+    void Orbit::setMagGrid(MagGrid *grid){
+        grid_ = grid;
+    }
+
+    Frames& Orbit::getFrames(){
+        frames_.setJulianDate(_date);
+        return frames_;
     }
 
 // Private methods and others
 
     void Orbit::update(float seconds){
         _date.update(seconds);
+        sun_dt_ += seconds;
         updateTrueAnomaly(seconds);
+        #ifdef ORBIT_USE_J2
+        updateJ2(seconds);
+        #endif
     }
 
     float Orbit::norm(float vec[3]){
@@ -481,6 +1181,36 @@ using namespace AstroLib;
         vec[1]      = hyp * sin(azimuth);
     }
 
+    float Orbit::solveKepler(float M, float ecc, float E0, float tolerance, int max_iter, int *iterations){
+        float E = E0;
+        float step;
+        int iter = 0;
+
+        // Newton's method
+        do{
+            step = (E - ecc * sin(E) - M) / (1 - ecc * cos(E));
+            E -= step;
+            iter++;
+        }while(fabs(step) > tolerance && iter < max_iter);
+
+        if(iterations){
+            *iterations = iter;
+        }
+        return E;
+    }
+
+    float Orbit::keplerStarter(float M, float ecc){
+        // Markley's cubic approximation, symmetric in M
+        float Ma = fabs(M);
+        float alpha = (3*PI*PI + 1.6f*PI*(PI - Ma)/(1 + ecc)) / (PI*PI - 6);
+        float d = 3*(1 - ecc) + alpha*ecc;
+        float q = 2*alpha*d*(1 - ecc) - Ma*Ma;
+        float r = 3*alpha*d*(d - 1 + ecc)*Ma + Ma*Ma*Ma;
+        float w = pow(fabs(r) + sqrt(q*q*q + r*r), 2.0f/3.0f);
+        float E = (2*r*w/(w*w + w*q + q*q) + Ma) / d;
+        return (M < 0) ? -E : E;
+    }
+
 // ------------------- Ground -------------------//
 // Constructors
     Ground::Ground():_date(JulianDate()){}
@@ -551,14 +1281,7 @@ using namespace AstroLib;
     }
 
     void Ground::getPositionVector(float rsat[3]){
-        // From Converting between Earth-Centered, Earth Fixed and Geodetic Coordinates, D. Rose 
-        float a = 6378137.0; // WGS-84 semi-major axis
-        float e2 = 6.6943799901377997e-3; // WGS-84 first eccentricity squared
-        float n = a/sqrt( 1 - e2*sin( _lat )*sin( _lat ) );
-
-        rsat[0] = ( n + _alt )*cos( _lat )*cos( _lon );    //ECEF x
-        rsat[1] = ( n + _alt )*cos( _lat )*sin( _lon );    //ECEF y
-        rsat[2] = ( n*(1 - e2 ) + _alt )*sin( _lat );        //ECEF z
+        Frames::geodeticToEcef(rsat, _lat, _lon, _alt);
     }
 
 // Earth magnetic field
@@ -578,4 +1301,517 @@ using namespace AstroLib;
         vec[0]      = hyp * cos(azimuth);
         vec[1]      = hyp * sin(azimuth);
         vec[2]      =     - sin(elevation);
-    }
\ No newline at end of file
+    }
+// ------------------- SGP4 -------------------//
+// Constants (WGS-72, as used to generate the Two-Line Elements)
+    static const sgp4_real SGP4_RE   = 6378.135;             // Earth radius (km)
+    static const sgp4_real SGP4_XKE  = 0.0743669161331734;   // sqrt(mu) in earth radii^1.5 / min
+    static const sgp4_real SGP4_J2   = 0.001082616;
+    static const sgp4_real SGP4_J3   = -0.00000253881;
+    static const sgp4_real SGP4_J4   = -0.00000165597;
+    static const sgp4_real SGP4_TWOPI = 6.283185307179586;
+
+// Helpers
+    /**
+     * Copies the 'len' characters of a TLE line starting at the 1-based column 'col'
+     * into a null-terminated buffer (at most 15 characters)
+     */
+    static void tleField(char buffer[16], const char *line, int col, int len){
+        for(int i = 0; i < len && i < 15; i++){
+            buffer[i] = line[col - 1 + i];
+        }
+        buffer[(len < 15) ? len : 15] = '\0';
+    }
+
+    /**
+     * Parses a TLE field with an implied leading decimal point and a power of ten
+     * exponent, such as " 13844-3" = 0.13844e-3
+     */
+    static sgp4_real tleExponent(const char *field){
+        char mantissa[16] = "0.";
+        int n = 2;
+        int i = 0;
+        sgp4_real sign = 1;
+        int exponent;
+
+        while(field[i] == ' '){
+            i++;
+        }
+        if(field[i] == '-' || field[i] == '+'){
+            sign = (field[i] == '-') ? -1 : 1;
+            i++;
+        }
+        while(field[i] >= '0' && field[i] <= '9' && n < 15){
+            mantissa[n++] = field[i++];
+        }
+        mantissa[n] = '\0';
+        exponent = atoi(field + i);
+        return sign * (sgp4_real)atof(mantissa) * std::pow((sgp4_real)10, (sgp4_real)exponent);
+    }
+
+// Constructors
+    SGP4::SGP4():_date(JulianDate()),_epoch(JulianDate()),_tsince(0),_tsince_err(0),_error(SGP4_TLE_ERROR),_grid(0){
+        for(int i = 0; i < 3; i++){
+            _r[i] = 0;
+            _v[i] = 0;
+        }
+    }
+
+// Date management
+    JulianDate SGP4::getJulianDate(){
+        return _date;
+    }
+
+    void SGP4::setJulianDate(JulianDate date){
+        _date = date;
+        // Time since epoch in minutes, the days and the fractions are subtracted separately to keep the precision
+        _tsince = (sgp4_real)(_date.getDay() - _epoch.getDay()) * 1440 + ((sgp4_real)_date.getFrac() - (sgp4_real)_epoch.getFrac()) * 1440;
+        _tsince_err = 0;
+        #ifdef ORBIT_USE_IGRF
+        _igrf.setJulianDate(date);
+        #endif
+        propagate(_tsince);
+    }
+
+    void SGP4::update(float seconds){
+        _date.update(seconds);
+        // The time since epoch is accumulated on its own with compensated summation, as the
+        // rounding of the day fraction of the date would add up to seconds within hours
+        sgp4_real y = (sgp4_real)seconds / 60 - _tsince_err;
+        sgp4_real t = _tsince + y;
+        _tsince_err = (t - _tsince) - y;
+        _tsince = t;
+        propagate(_tsince);
+    }
+
+// Sun position
+    void SGP4::getSunVector(float rsun[3]){
+        Orbit::getSunVector(rsun, _date);
+    }
+
+// Spacecraft position management
+    int SGP4::setTLE(const char *line1, const char *line2){
+        char field[16];
+        int year, doy;
+        sgp4_real frac, no_kozai;
+
+        _error = SGP4_TLE_ERROR;
+        if(strlen(line1) < 63 || strlen(line2) < 63 || line1[0] != '1' || line2[0] != '2'){
+            return _error;
+        }
+
+        // Line 1: epoch and drag term
+        tleField(field, line1, 19, 2);
+        year = atoi(field);
+        year += (year < 57) ? 2000 : 1900;
+        tleField(field, line1, 21, 3);
+        doy = atoi(field);
+        tleField(field, line1, 24, 9);      // Fraction of the day with its decimal point
+        frac = atof(field);
+        tleField(field, line1, 54, 8);
+        _bstar = tleExponent(field);
+
+        // Line 2: mean elements
+        tleField(field, line2, 9, 8);
+        _inclo = atof(field) * SGP4_TWOPI / 360;
+        tleField(field, line2, 18, 8);
+        _nodeo = atof(field) * SGP4_TWOPI / 360;
+        tleField(field, line2, 27, 7);
+        _ecco = atof(field) * (sgp4_real)1e-7;
+        tleField(field, line2, 35, 8);
+        _argpo = atof(field) * SGP4_TWOPI / 360;
+        tleField(field, line2, 44, 8);
+        _mo = atof(field) * SGP4_TWOPI / 360;
+        tleField(field, line2, 53, 11);
+        no_kozai = atof(field) * SGP4_TWOPI / 1440;     // rev/day to rad/min
+        if(no_kozai <= 0 || _ecco >= 1){
+            return _error;
+        }
+
+        // Epoch: midnight of the first of January plus the day of year
+        _epoch = JulianDate(year, 1, 1, 0, 0, 0.0f);
+        _epoch = JulianDate(_epoch.getDay() + doy - 1, _epoch.getFrac());
+        _epoch += (float)frac;
+
+        // Initialization of the model (sgp4init and initl of the reference implementation)
+        sgp4_real eccsq  = _ecco * _ecco;
+        sgp4_real omeosq = 1 - eccsq;
+        sgp4_real rteosq = std::sqrt(omeosq);
+        sgp4_real cosio  = std::cos(_inclo);
+        sgp4_real cosio2 = cosio * cosio;
+        sgp4_real sinio  = std::sin(_inclo);
+
+        // Un-Kozai the mean motion
+        sgp4_real ak   = std::pow(SGP4_XKE / no_kozai, (sgp4_real)2 / 3);
+        sgp4_real d1   = (sgp4_real)0.75 * SGP4_J2 * (3 * cosio2 - 1) / (rteosq * omeosq);
+        sgp4_real del  = d1 / (ak * ak);
+        sgp4_real adel = ak * (1 - del * del - del * ((sgp4_real)1 / 3 + 134 * del * del / 81));
+        del = d1 / (adel * adel);
+        _no = no_kozai / (1 + del);
+
+        _ao = std::pow(SGP4_XKE / _no, (sgp4_real)2 / 3);
+        sgp4_real po   = _ao * omeosq;
+        sgp4_real con42 = 1 - 5 * cosio2;
+        _con41 = -con42 - cosio2 - cosio2;
+        sgp4_real posq = po * po;
+        sgp4_real rp   = _ao * (1 - _ecco);
+
+        if(SGP4_TWOPI / _no >= 225){
+            _error = SGP4_DEEP_SPACE;
+            return _error;
+        }
+
+        // Atmospheric density parameters, modified for low perigees
+        sgp4_real ss     = 78 / SGP4_RE + 1;
+        sgp4_real qzms2t = std::pow((120 - 78) / SGP4_RE, (sgp4_real)4);
+        sgp4_real sfour  = ss;
+        sgp4_real qzms24 = qzms2t;
+        sgp4_real perige = (rp - 1) * SGP4_RE;
+        _isimp = (rp < 220 / SGP4_RE + 1) ? 1 : 0;
+        if(perige < 156){
+            sfour = perige - 78;
+            if(perige < 98){
+                sfour = 20;
+            }
+            qzms24 = std::pow((120 - sfour) / SGP4_RE, (sgp4_real)4);
+            sfour = sfour / SGP4_RE + 1;
+        }
+
+        sgp4_real pinvsq = 1 / posq;
+        sgp4_real tsi    = 1 / (_ao - sfour);
+        _eta = _ao * _ecco * tsi;
+        sgp4_real etasq  = _eta * _eta;
+        sgp4_real eeta   = _ecco * _eta;
+        sgp4_real psisq  = std::fabs(1 - etasq);
+        sgp4_real coef   = qzms24 * std::pow(tsi, (sgp4_real)4);
+        sgp4_real coef1  = coef / std::pow(psisq, (sgp4_real)3.5);
+        sgp4_real cc2    = coef1 * _no * (_ao * (1 + (sgp4_real)1.5 * etasq + eeta * (4 + etasq))
+                         + (sgp4_real)0.375 * SGP4_J2 * tsi / psisq * _con41 * (8 + 3 * etasq * (8 + etasq)));
+        _cc1 = _bstar * cc2;
+        sgp4_real cc3 = 0;
+        if(_ecco > (sgp4_real)1e-4){
+            cc3 = -2 * coef * tsi * (SGP4_J3 / SGP4_J2) * _no * sinio / _ecco;
+        }
+        _x1mth2 = 1 - cosio2;
+        _cc4 = 2 * _no * coef1 * _ao * omeosq * (_eta * (2 + (sgp4_real)0.5 * etasq) + _ecco * ((sgp4_real)0.5 + 2 * etasq)
+             - SGP4_J2 * tsi / (_ao * psisq) * (-3 * _con41 * (1 - 2 * eeta + etasq * ((sgp4_real)1.5 - (sgp4_real)0.5 * eeta))
+             + (sgp4_real)0.75 * _x1mth2 * (2 * etasq - eeta * (1 + etasq)) * std::cos(2 * _argpo)));
+        _cc5 = 2 * coef1 * _ao * omeosq * (1 + (sgp4_real)2.75 * (etasq + eeta) + eeta * etasq);
+
+        // Secular rates of the mean anomaly, argument of perigee and node
+        sgp4_real cosio4 = cosio2 * cosio2;
+        sgp4_real temp1  = (sgp4_real)1.5 * SGP4_J2 * pinvsq * _no;
+        sgp4_real temp2  = (sgp4_real)0.5 * temp1 * SGP4_J2 * pinvsq;
+        sgp4_real temp3  = (sgp4_real)-0.46875 * SGP4_J4 * pinvsq * pinvsq * _no;
+        _mdot    = _no + (sgp4_real)0.5 * temp1 * rteosq * _con41 + (sgp4_real)0.0625 * temp2 * rteosq * (13 - 78 * cosio2 + 137 * cosio4);
+        _argpdot = (sgp4_real)-0.5 * temp1 * con42 + (sgp4_real)0.0625 * temp2 * (7 - 114 * cosio2 + 395 * cosio4)
+                 + temp3 * (3 - 36 * cosio2 + 49 * cosio4);
+        sgp4_real xhdot1 = -temp1 * cosio;
+        _nodedot = xhdot1 + ((sgp4_real)0.5 * temp2 * (4 - 19 * cosio2) + 2 * temp3 * (3 - 7 * cosio2)) * cosio;
+
+        _omgcof = _bstar * cc3 * std::cos(_argpo);
+        _xmcof  = 0;
+        if(_ecco > (sgp4_real)1e-4){
+            _xmcof = -(sgp4_real)2 / 3 * coef * _bstar / eeta;
+        }
+        _nodecf = (sgp4_real)3.5 * omeosq * xhdot1 * _cc1;
+        _t2cof  = (sgp4_real)1.5 * _cc1;
+        if(std::fabs(cosio + 1) > (sgp4_real)1.5e-12){
+            _xlcof = (sgp4_real)-0.25 * (SGP4_J3 / SGP4_J2) * sinio * (3 + 5 * cosio) / (1 + cosio);
+        }
+        else{
+            _xlcof = (sgp4_real)-0.25 * (SGP4_J3 / SGP4_J2) * sinio * (3 + 5 * cosio) / (sgp4_real)1.5e-12;
+        }
+        _aycof  = (sgp4_real)-0.5 * (SGP4_J3 / SGP4_J2) * sinio;
+        _delmo  = std::pow(1 + _eta * std::cos(_mo), (sgp4_real)3);
+        _sinmao = std::sin(_mo);
+        _x7thm1 = 7 * cosio2 - 1;
+
+        // Higher order drag terms, not used for low perigees
+        _d2 = _d3 = _d4 = _t3cof = _t4cof = _t5cof = 0;
+        if(_isimp != 1){
+            sgp4_real cc1sq = _cc1 * _cc1;
+            _d2 = 4 * _ao * tsi * cc1sq;
+            sgp4_real temp = _d2 * tsi * _cc1 / 3;
+            _d3 = (17 * _ao + sfour) * temp;
+            _d4 = (sgp4_real)0.5 * temp * _ao * tsi * (221 * _ao + 31 * sfour) * _cc1;
+            _t3cof = _d2 + 2 * cc1sq;
+            _t4cof = (sgp4_real)0.25 * (3 * _d3 + _cc1 * (12 * _d2 + 10 * cc1sq));
+            _t5cof = (sgp4_real)0.2 * (3 * _d4 + 12 * _cc1 * _d3 + 6 * _d2 * _d2 + 15 * cc1sq * (2 * _d2 + cc1sq));
+        }
+
+        _date = _epoch;
+        _tsince = 0;
+        _tsince_err = 0;
+        _error = SGP4_OK;
+        #ifdef ORBIT_USE_IGRF
+        _igrf.setJulianDate(_epoch);
+        #endif
+        return propagate(0);
+    }
+
+    JulianDate SGP4::getEpoch(){
+        return _epoch;
+    }
+
+    int SGP4::propagate(sgp4_real t){
+        if(_error == SGP4_TLE_ERROR || _error == SGP4_DEEP_SPACE){
+            return _error;
+        }
+
+        // Secular effects of the gravity and the drag
+        sgp4_real xmdf   = _mo + _mdot * t;
+        sgp4_real argpdf = _argpo + _argpdot * t;
+        sgp4_real nodedf = _nodeo + _nodedot * t;
+        sgp4_real argpm  = argpdf;
+        sgp4_real mm     = xmdf;
+        sgp4_real t2     = t * t;
+        sgp4_real nodem  = nodedf + _nodecf * t2;
+        sgp4_real tempa  = 1 - _cc1 * t;
+        sgp4_real tempe  = _bstar * _cc4 * t;
+        sgp4_real templ  = _t2cof * t2;
+
+        if(_isimp != 1){
+            sgp4_real delomg = _omgcof * t;
+            sgp4_real delmtemp = 1 + _eta * std::cos(xmdf);
+            sgp4_real delm = _xmcof * (delmtemp * delmtemp * delmtemp - _delmo);
+            sgp4_real temp = delomg + delm;
+            mm = xmdf + temp;
+            argpm = argpdf - temp;
+            sgp4_real t3 = t2 * t;
+            sgp4_real t4 = t3 * t;
+            tempa = tempa - _d2 * t2 - _d3 * t3 - _d4 * t4;
+            tempe = tempe + _bstar * _cc5 * (std::sin(mm) - _sinmao);
+            templ = templ + _t3cof * t3 + t4 * (_t4cof + t * _t5cof);
+        }
+
+        sgp4_real am = std::pow(SGP4_XKE / _no, (sgp4_real)2 / 3) * tempa * tempa;
+        sgp4_real nm = SGP4_XKE / std::pow(am, (sgp4_real)1.5);
+        sgp4_real em = _ecco - tempe;
+        if(em >= 1 || em < (sgp4_real)-0.001){
+            _error = SGP4_ECCENTRICITY;
+            return _error;
+        }
+        if(em < (sgp4_real)1e-6){
+            em = (sgp4_real)1e-6;
+        }
+        mm = mm + _no * templ;
+        sgp4_real xlm = mm + argpm + nodem;
+        nodem = std::fmod(nodem, SGP4_TWOPI);
+        argpm = std::fmod(argpm, SGP4_TWOPI);
+        xlm   = std::fmod(xlm, SGP4_TWOPI);
+        mm    = std::fmod(xlm - argpm - nodem, SGP4_TWOPI);
+
+        sgp4_real sinim = std::sin(_inclo);
+        sgp4_real cosim = std::cos(_inclo);
+
+        // Long period periodics
+        sgp4_real axnl = em * std::cos(argpm);
+        sgp4_real temp = 1 / (am * (1 - em * em));
+        sgp4_real aynl = em * std::sin(argpm) + temp * _aycof;
+        sgp4_real xl   = mm + argpm + nodem + temp * _xlcof * axnl;
+
+        // Kepler's equation
+        sgp4_real u = std::fmod(xl - nodem, SGP4_TWOPI);
+        sgp4_real eo1 = u;
+        sgp4_real tem5 = 9999.9;
+        sgp4_real sineo1 = 0, coseo1 = 1;
+        for(int ktr = 1; std::fabs(tem5) >= ((sizeof(sgp4_real) == sizeof(float)) ? (sgp4_real)1e-6 : (sgp4_real)1e-12) && ktr <= 10; ktr++){
+            sineo1 = std::sin(eo1);
+            coseo1 = std::cos(eo1);
+            tem5 = 1 - coseo1 * axnl - sineo1 * aynl;
+            tem5 = (u - aynl * coseo1 + axnl * sineo1 - eo1) / tem5;
+            if(std::fabs(tem5) >= (sgp4_real)0.95){
+                tem5 = (tem5 > 0) ? (sgp4_real)0.95 : (sgp4_real)-0.95;
+            }
+            eo1 = eo1 + tem5;
+        }
+
+        // Short period preliminary quantities
+        sgp4_real ecose = axnl * coseo1 + aynl * sineo1;
+        sgp4_real esine = axnl * sineo1 - aynl * coseo1;
+        sgp4_real el2   = axnl * axnl + aynl * aynl;
+        sgp4_real pl    = am * (1 - el2);
+        if(pl < 0){
+            _error = SGP4_SEMILATUS;
+            return _error;
+        }
+        sgp4_real rl     = am * (1 - ecose);
+        sgp4_real rdotl  = std::sqrt(am) * esine / rl;
+        sgp4_real rvdotl = std::sqrt(pl) / rl;
+        sgp4_real betal  = std::sqrt(1 - el2);
+        temp = esine / (1 + betal);
+        sgp4_real sinu = am / rl * (sineo1 - aynl - axnl * temp);
+        sgp4_real cosu = am / rl * (coseo1 - axnl + aynl * temp);
+        sgp4_real su   = std::atan2(sinu, cosu);
+        sgp4_real sin2u = (cosu + cosu) * sinu;
+        sgp4_real cos2u = 1 - 2 * sinu * sinu;
+        temp = 1 / pl;
+        sgp4_real temp1 = (sgp4_real)0.5 * SGP4_J2 * temp;
+        sgp4_real temp2 = temp1 * temp;
+
+        // Short periodics
+        sgp4_real mrt   = rl * (1 - (sgp4_real)1.5 * temp2 * betal * _con41) + (sgp4_real)0.5 * temp1 * _x1mth2 * cos2u;
+        su = su - (sgp4_real)0.25 * temp2 * _x7thm1 * sin2u;
+        sgp4_real xnode = nodem + (sgp4_real)1.5 * temp2 * cosim * sin2u;
+        sgp4_real xinc  = _inclo + (sgp4_real)1.5 * temp2 * cosim * sinim * cos2u;
+        sgp4_real mvt   = rdotl - nm * temp1 * _x1mth2 * sin2u / SGP4_XKE;
+        sgp4_real rvdot = rvdotl + nm * temp1 * (_x1mth2 * cos2u + (sgp4_real)1.5 * _con41) / SGP4_XKE;
+
+        // Orientation vectors
+        sgp4_real sinsu = std::sin(su);
+        sgp4_real cossu = std::cos(su);
+        sgp4_real snod  = std::sin(xnode);
+        sgp4_real cnod  = std::cos(xnode);
+        sgp4_real sini  = std::sin(xinc);
+        sgp4_real cosi  = std::cos(xinc);
+        sgp4_real xmx = -snod * cosi;
+        sgp4_real xmy =  cnod * cosi;
+        sgp4_real ux  = xmx * sinsu + cnod * cossu;
+        sgp4_real uy  = xmy * sinsu + snod * cossu;
+        sgp4_real uz  = sini * sinsu;
+        sgp4_real vx  = xmx * cossu - cnod * sinsu;
+        sgp4_real vy  = xmy * cossu - snod * sinsu;
+        sgp4_real vz  = sini * cossu;
+
+        // Position (m) and velocity (m/s)
+        sgp4_real rscale = mrt * SGP4_RE * 1000;
+        sgp4_real vscale = SGP4_RE * SGP4_XKE / 60 * 1000;
+        _r[0] = rscale * ux;
+        _r[1] = rscale * uy;
+        _r[2] = rscale * uz;
+        _v[0] = vscale * (mvt * ux + rvdot * vx);
+        _v[1] = vscale * (mvt * uy + rvdot * vy);
+        _v[2] = vscale * (mvt * uz + rvdot * vz);
+
+        _error = (mrt < 1) ? SGP4_DECAYED : SGP4_OK;
+        return _error;
+    }
+
+    void SGP4::getPositionVector(float r_sat[3]){
+        r_sat[0] = _r[0];
+        r_sat[1] = _r[1];
+        r_sat[2] = _r[2];
+    }
+
+    void SGP4::getVelocityVector(float v_sat[3]){
+        v_sat[0] = _v[0];
+        v_sat[1] = _v[1];
+        v_sat[2] = _v[2];
+    }
+
+    int SGP4::getError(){
+        return _error;
+    }
+
+// Earth magnetic field
+    void SGP4::getMagVector(float rmag[3]){
+        if(_grid){
+            Orbit::mag_vector(rmag, _r, getFrames(), *_grid);
+            return;
+        }
+        #ifdef ORBIT_USE_IGRF
+        Orbit::mag_vector(rmag, _r, getFrames(), _igrf);
+        #else
+        Orbit::mag_vector(rmag, _r, _date.getDay(), _date.getFrac());
+        #endif
+    }
+
+    #ifdef ORBIT_USE_IGRF
+    int SGP4::setMagDegree(int degree){
+        return _igrf.setDegree(degree);
+    }
+    #endif
+
+    void SGP4::setMagGrid(MagGrid *grid){
+        _grid = grid;
+    }
+
+    Frames& SGP4::getFrames(){
+        _frames.setJulianDate(_date);
+        return _frames;
+    }
+
+// ------------------- Ephemeris -------------------//
+// Constructors
+    Ephemeris::Ephemeris():_table(0),_ncoef(0),_segments(0),_span(1),_epoch(JulianDate()),_date(JulianDate()),_t(0),_t_err(0){}
+
+    int Ephemeris::load(const float *table, int size){
+        _table = 0;
+        if(size < EPHEMERIS_HEADER_SIZE || table[0] != EPHEMERIS_VERSION || table[6] != EPHEMERIS_CHANNELS
+           || table[1] < 1 || table[2] < 1 || !(table[3] > 0)){
+            return 0;
+        }
+        _ncoef = (int)table[1];
+        _segments = (int)table[2];
+        if(size < tableSize(_segments, _ncoef - 1)){
+            return 0;
+        }
+        _span = table[3];
+        _epoch = JulianDate((long)table[4], table[5]);
+        _table = table;
+        setJulianDate(_epoch);
+        return 1;
+    }
+
+    int Ephemeris::tableSize(int segments, int order){
+        return EPHEMERIS_HEADER_SIZE + segments * EPHEMERIS_CHANNELS * (order + 1);
+    }
+
+// Date management
+    JulianDate Ephemeris::getJulianDate(){
+        return _date;
+    }
+
+    void Ephemeris::setJulianDate(JulianDate date){
+        _date = date;
+        _t = _date.secondsSince(_epoch);
+        _t_err = 0;
+    }
+
+    int Ephemeris::update(float seconds){
+        _date.update(seconds);
+        // Compensated summation of the time since the start of the table
+        float y = seconds - _t_err;
+        float t = _t + y;
+        _t_err = (t - _t) - y;
+        _t = t;
+        return (_t >= 0 && _t <= _segments * _span) ? 1 : 0;
+    }
+
+// Vectors
+    void Ephemeris::getSunVector(float rsun[3]){
+        evaluate(rsun, 0);
+    }
+
+    void Ephemeris::getPositionVector(float r_sat[3]){
+        evaluate(r_sat, 3);
+    }
+
+    void Ephemeris::getMagVector(float rmag[3]){
+        evaluate(rmag, 6);
+    }
+
+    void Ephemeris::evaluate(float vec[3], int channel){
+        if(!_table){
+            vec[0] = vec[1] = vec[2] = 0;
+            return;
+        }
+        // Segment covering the current date, the first or last one is extrapolated outside the table
+        int i = (int)floor(_t / _span);
+        i = (i < 0) ? 0 : ((i >= _segments) ? _segments - 1 : i);
+        float x = 2 * (_t - i * _span) / _span - 1;
+        const float *coef = _table + EPHEMERIS_HEADER_SIZE + (i * EPHEMERIS_CHANNELS + channel) * _ncoef;
+
+        // Clenshaw recurrence
+        for(int c = 0; c < 3; c++){
+            float b1 = 0, b2 = 0, b0;
+            for(int j = _ncoef - 1; j >= 1; j--){
+                b0 = 2 * x * b1 - b2 + coef[j];
+                b2 = b1;
+                b1 = b0;
+            }
+            vec[c] = x * b1 - b2 + coef[0];
+            coef += _ncoef;
+        }
+    }
@@ -25,10 +25,14 @@
  * - Julian date time format and conversion from common calendar,
  * - Orbit model based on perifocal parameters,
  * - Spacecraft position vector in the ECI (Earth Centered Inertial) frame,
+ * - Sidereal time and ECI, ECEF (Earth Centered Earth Fixed) and NED (North East Down) conversions,
  * - Sun vector in the ECI frame,
- * - Earth Magnetic Field vector in the ECI frame.
+ * - Earth Magnetic Field vector in the ECI frame (IGRF-13 up to degree 13, or tilted dipole).
  * 
  * @see AstroLib::JulianDate
+ * @see AstroLib::Frames
+ * @see AstroLib::IGRF
+ * @see AstroLib::MagGrid
  * @see AstroLib::Orbit
  * @see AstroLib::Ground
  * 
@@ -88,6 +92,14 @@
  *       @f$ R_{\oplus} = 6378 km @f$,
  *       @f$ H_0 = 30.115 \mu T @f$
  * 
+ * The Ephemeris class evaluates Chebyshev polynomials fitted on the ground to any of
+ * the models over a time window, trading a few kilobytes of flash for the CPU time of
+ * the models.
+ * 
+ * The SGP4 class is another drop-in replacement for the Orbit class, that propagates
+ * the NORAD Two-Line Elements with the SGP4 model (zonal harmonics and drag) for
+ * missions that can only uplink new elements every few days.
+ * 
  * The ground version is a drop-in replacement for the Orbit class that facilitates
  * ground testing in a lab.
  * 
@@ -112,6 +124,7 @@
  * - "Spacecraft Dynamic and Control: An introduction",
  * by A. de Ruiter, C. Damaren and J Forbes
  * - "Fundamentals of Astrodynamics and Applications", by D. Vallado
+ * - "Revisiting Spacetrack Report #3", by D. Vallado, P. Crawford, R. Hujsak and T. Kelso
  * - http://www.instesre.org/ArduinoUnoSolarCalculations.pdf by David Brooks
  * - https://www.ngdc.noaa.gov/geomag/WMM/image.shtml
  * - https://www.esrl.noaa.gov/gmd/grad/solcalc/
@@ -132,15 +145,49 @@
 #ifndef ASTROLIB_H
 #define ASTROLIB_H
 #include <cmath>                     ///< <std::math> for square root and trigonometric functions
+#include <cfloat>                    ///< <std::cfloat> for the float resolution in the error bounds
+#include <cstdlib>                   ///< <std::cstdlib> for the parsing of the Two-Line Elements
+#include <cstring>                   ///< <std::cstring> for the parsing of the Two-Line Elements
+#include <stdint.h>                  ///< <stdint.h> for the 64-bits nanoseconds of the Julian dates
 
 #define PI 3.1415926535f             ///< The number PI
 #define TWOPI 6.283185307f           ///< The number 2*PI
 #define DEG2RAD 3.1415926535f/180.0f ///< Conversion from degrees to radians
 #define RAD2DEG 180.0f/3.1415926535f ///< Conversion from radians to degrees
-#define SEC2JFRAC 1 / (60*60*24)     ///< Conversion from seconds to julian fraction
+#define SEC2JFRAC (1.0f/86400.0f)    ///< Conversion from seconds to julian fraction
+#define JULIAN_NS_PER_DAY 86400000000000LL ///< Number of nanoseconds in a Julian day
 #define MU 398600441800000.0f        ///< Gravitational constant of the Earth
 #define OMEGA_EARTH 0.000072921158f  ///< Rotation speed of the Earth
 #define R_EARTH 6378000.0f           ///< Radius of the Earth
+#define J2_EARTH 0.00108262668f      ///< Second zonal harmonic of the Earth gravity field
+#define KEPLER_TOLERANCE 1e-6f       ///< Tolerance (rad) on the eccentric anomaly of the Kepler solver
+#define KEPLER_MAX_ITERATIONS 4      ///< Hard cap on the Newton iterations of the Kepler solver
+#define KEPLER_WARM_START_LIMIT 0.5f ///< Mean anomaly step (rad) above which the Kepler solver uses the Markley starter
+#define ORBIT_USE_J2                 ///< Apply the secular J2 drift of the node, perigee and mean anomaly in Orbit
+#define ORBIT_J2_THRESHOLD 1e-4f     ///< Drift of the node or perigee (rad) above which the perifocal to ECI rotation is recomputed
+#define ORBIT_SUN_REFRESH 0.0f       ///< Default period (s) of the full computation of the sun vector in Orbit (0 for every call)
+#define ORBIT_SUN_ACCELERATION 4.3e-14f ///< Upper bound of the second derivative of the sun vector (AU/s^2)
+#define ORBIT_SUN_ROUNDOFF 3.0f      ///< Round-off of the full sun vector computation, in float resolutions of the mean longitude
+#define ORBIT_USE_CONICAL_SHADOW     ///< Use the conical (umbra and penumbra) Earth shadow in Orbit, cylindrical otherwise
+#define ORBIT_ECLIPSE_STEP 30.0f     ///< Default time step (s) of the search of the eclipses (shorter eclipses can be missed)
+#define ORBIT_ECLIPSE_TOLERANCE 0.1f ///< Tolerance (s) on the predicted eclipse entry and exit times
+#define ORBIT_ECLIPSE_BISECTIONS 24  ///< Maximum number of halvings of the eclipse bisection (float spacing bound far from the date)
+#define AU_METERS 149597870700.0f    ///< Astronomical unit (m)
+#define R_SUN 695700000.0f           ///< Radius of the Sun (m)
+#define IGRF_MAX_DEGREE 13           ///< Maximum degree and order of the IGRF model (IGRF-13)
+#define IGRF_SIZE ((IGRF_MAX_DEGREE+1)*(IGRF_MAX_DEGREE+2)/2) ///< Number of (n, m) pairs of the IGRF model
+#define IGRF_RADIUS 6371200.0f       ///< Reference radius of the IGRF model (m)
+#define IGRF_DEFAULT_DEGREE 6        ///< Default degree of the IGRF model
+#define IGRF_LEGENDRE_TOLERANCE 1e-6f ///< Change of colatitude (rad) below which the IGRF Legendre functions are reused
+#define MAG_GRID_VERSION 1           ///< Version of the layout of the magnetic field grids
+#define MAG_GRID_HEADER_SIZE 8       ///< Number of words of the header of the magnetic field grids
+//#define ASTROLIB_USE_MMAP          ///< Uncomment on a POSIX host to memory-map the grid files (MagGrid::mapFile)
+#define ORBIT_USE_IGRF               ///< Use the IGRF model for the magnetic field in Orbit and SGP4, tilted dipole otherwise
+#define EPHEMERIS_VERSION 1          ///< Version of the layout of the ephemeris tables
+#define EPHEMERIS_HEADER_SIZE 8      ///< Number of words of the header of the ephemeris tables
+#define EPHEMERIS_CHANNELS 9         ///< Number of channels of the ephemeris tables (sun, position, magnetic field)
+#define EPHEMERIS_MAX_ORDER 16       ///< Maximum order of the Chebyshev polynomials of the ephemeris tables
+//#define ASTROLIB_SGP4_USE_DOUBLE   ///< Uncomment to run SGP4 in double precision (ground segment), float otherwise
 
 /**
  * @{
@@ -174,8 +221,12 @@ namespace AstroLib{
  * and which preceded any dates in recorded history.
  * 
  * The julian day is split in an integer part (stored as a 32-bits 'long' type)
- * and a decimal part (stored as a 32-bits 'float' type) to allow more significant
- * figures (precision of 9ms)
+ * and the time elapsed in the day (stored as 64-bits integer nanoseconds). The updates
+ * are rounded to the nanosecond and accumulated exactly, so that a control loop
+ * adding 10 ms steps for months keeps the correct time without any resync (a float
+ * fraction of day has a resolution of about 5 ms, larger than a 10 ms step can
+ * accumulate without drifting). The decimal part is still provided as a float for
+ * the models (JulianDate::getFrac).
  *
  * This class supports addition and substraction of JulianDates with themselves, float, int and long,
  * as well as comparison between JulianDates themselves and between JulianDates and float. Finally this class
@@ -487,6 +538,21 @@ public:
      */
     void setFrac(float frac);
 
+    /**
+     * @brief
+     * Gets the time elapsed in the julian day
+     * @return The time elapsed since the start of the julian day (ns, in [0, JULIAN_NS_PER_DAY[)
+     */
+    int64_t getNanoseconds() const;
+
+    /**
+     * @brief
+     * Computes the exact time between two dates, rounded to a float at the end
+     * @param ref The reference date
+     * @return The time elapsed from the reference date to this date (s)
+     */
+    float secondsSince(const JulianDate& ref) const;
+
 
 ///@name Specific methods
     /** 
@@ -495,14 +561,440 @@ public:
      * @param seconds The amount of seconds to add
      */
     void update(float seconds);
+
+    /** 
+     * @brief
+     * Update the Julian Date by adding an exact amount of time
+     * @param nanoseconds The amount of nanoseconds to add (e.g. from a hardware timer)
+     */
+    void updateNanoseconds(int64_t nanoseconds);
 ///@}
 private:
+    /**
+     * @brief
+     * Converts a float amount of seconds to nanoseconds, the integer part of the seconds is exact
+     * @param seconds The amount of seconds
+     * @return The amount of nanoseconds
+     */
+    static int64_t toNanoseconds(float seconds);
+
+    /**
+     * @brief
+     * Converts a fraction of julian day to nanoseconds
+     * @param frac The fraction of day
+     * @return The amount of nanoseconds
+     */
+    static int64_t fracToNanoseconds(float frac);
+
+    /**
+     * @brief
+     * Brings the nanoseconds back in [0, JULIAN_NS_PER_DAY[ by carrying over to the day
+     */
+    void normalize();
+
     /** @brief The integer part of the Julian day */
     long _day;
-     /** @brief The decimal part of the Julian day */
-    float _frac;
+    /** @brief The time elapsed in the Julian day (ns) */
+    int64_t _ns;
 };
 
+/**
+ * @ingroup AstroLibGr 
+ * @brief
+ * Greenwich sidereal time and conversions between the ECI, ECEF and NED frames
+ * 
+ * @class AstroLib::Frames
+ * 
+ * @details
+ * The sidereal time and the rotation between the Earth Centered Inertial and the Earth
+ * Centered Earth Fixed frames are computed once per date (JulianDate::setJulianDate
+ * does nothing if the date did not change), then any number of vectors can be converted
+ * in a batch. The rotation to the local North East Down frame of a location is cached
+ * the same way (Frames::setLocation).
+ * 
+ * The Greenwich mean sidereal time uses the IAU 1982 rate. The whole days and the time
+ * of the day are reduced separately so that the float keeps a precision of about 1e-5 rad:
+ * 
+ * @f{equation}{
+ *     \theta_g = 4.894961212 + 0.0172027918 D + 6.300388099 f \pmod{2\pi}
+ * @f}
+ * 
+ * with D the whole days and f the fraction of day since J2000.
+ * 
+ * # Example code
+ * @code
+ * AstroLib::Frames frames;
+ * float vec[2][3];                 // Position and magnetic field in the ECI frame
+ * frames.setJulianDate(orbit.getJulianDate());
+ * frames.eciToEcef(vec[0], vec[0], 2);
+ * @endcode
+ * 
+ * @see AstroLib
+ */
+class Frames {
+public:
+///@name Constructors
+    /**
+     * @brief Frames constructor
+     */
+    Frames();
+
+///@name Date and location
+    /**
+     * @brief
+     * Sets the date of the conversions, the rotation is only recomputed if the date changed
+     * @param date The date
+     */
+    void setJulianDate(JulianDate date);
+
+    /**
+     * @brief
+     * Gets the date of the conversions
+     * @return The date
+     */
+    JulianDate getJulianDate();
+
+    /**
+     * @brief
+     * Gets the Greenwich mean sidereal time at the date of the conversions
+     * @return The sidereal time (rad, in [0, 2pi[)
+     */
+    float getSiderealTime();
+
+    /**
+     * @brief
+     * Sets the location of the North East Down frame
+     * @param lat The geodetic latitude (rad)
+     * @param lon The longitude (rad)
+     */
+    void setLocation(float lat, float lon);
+
+///@name Batched conversions
+    /**
+     * @brief
+     * Converts vectors from the ECI to the ECEF frame (the input and output can be the same array)
+     * @param out The converted vectors (3 x n floats)
+     * @param in The vectors to convert (3 x n floats)
+     * @param n The number of vectors
+     */
+    void eciToEcef(float *out, const float *in, int n = 1);
+
+    /**
+     * @brief
+     * Converts vectors from the ECEF to the ECI frame (the input and output can be the same array)
+     * @param out The converted vectors (3 x n floats)
+     * @param in The vectors to convert (3 x n floats)
+     * @param n The number of vectors
+     */
+    void ecefToEci(float *out, const float *in, int n = 1);
+
+    /**
+     * @brief
+     * Converts vectors from the ECEF to the NED frame of the location (the input and output can be the same array)
+     * @param out The converted vectors (3 x n floats)
+     * @param in The vectors to convert (3 x n floats)
+     * @param n The number of vectors
+     */
+    void ecefToNed(float *out, const float *in, int n = 1);
+
+    /**
+     * @brief
+     * Converts vectors from the NED frame of the location to the ECEF frame (the input and output can be the same array)
+     * @param out The converted vectors (3 x n floats)
+     * @param in The vectors to convert (3 x n floats)
+     * @param n The number of vectors
+     */
+    void nedToEcef(float *out, const float *in, int n = 1);
+
+    /**
+     * @brief
+     * Converts vectors from the ECI frame to the NED frame of the location (the input and output can be the same array)
+     * @param out The converted vectors (3 x n floats)
+     * @param in The vectors to convert (3 x n floats)
+     * @param n The number of vectors
+     */
+    void eciToNed(float *out, const float *in, int n = 1);
+
+    /**
+     * @brief
+     * Converts vectors from the NED frame of the location to the ECI frame (the input and output can be the same array)
+     * @param out The converted vectors (3 x n floats)
+     * @param in The vectors to convert (3 x n floats)
+     * @param n The number of vectors
+     */
+    void nedToEci(float *out, const float *in, int n = 1);
+
+///@name Static tools
+    /**
+     * @brief
+     * Computes the Greenwich mean sidereal time
+     * @param date The date
+     * @return The sidereal time (rad, in [0, 2pi[)
+     */
+    static float siderealTime(JulianDate date);
+
+    /**
+     * @brief
+     * Computes the ECEF position of a geodetic location (WGS-84)
+     * @param r The position in the ECEF frame (m)
+     * @param lat The geodetic latitude (rad)
+     * @param lon The longitude (rad)
+     * @param alt The altitude above the ellipsoid (m)
+     */
+    static void geodeticToEcef(float r[3], float lat, float lon, float alt);
+
+private:
+    JulianDate _date;   ///< The date of the rotation
+    int _valid;         ///< Whether the rotation matches the date
+    float _theta;       ///< The Greenwich mean sidereal time (rad)
+    float _c;           ///< Cosine of the sidereal time
+    float _s;           ///< Sine of the sidereal time
+    float _ned[9];      ///< Rotation from the ECEF to the NED frame (row major)
+}; // class Frames
+
+/**
+ * @ingroup AstroLibGr 
+ * @brief
+ * International Geomagnetic Reference Field (IGRF-13) with configurable degree
+ * 
+ * @class AstroLib::IGRF
+ * 
+ * @details
+ * Spherical harmonic model of the Earth magnetic field, with the IGRF-13 coefficients of
+ * the 2020 epoch and their secular variation (valid from 2020 to 2025):
+ * 
+ * @f{equation}{
+ *     V = a \sum_{n=1}^{N} \left(\frac{a}{r}\right)^{n+1} \sum_{m=0}^{n}
+ *         \left(g_n^m \cos m\lambda + h_n^m \sin m\lambda\right) P_n^m(\cos\theta)
+ * @f}
+ * 
+ * The degree N can be lowered from 13 to trade accuracy for CPU time: the cost grows
+ * with N^2. At 500 km, the worst error against the full model is about 1700 nT for a
+ * degree of 4, 500 nT for 6 and 120 nT for 8, against 16000 nT for the dipole (N = 1).
+ * 
+ * The Schmidt semi-normalised Legendre functions are computed with the recursions
+ * below, whose coefficients are precomputed at construction:
+ * 
+ * @f{eqnarray*}{
+ *     P_n^n &=& \sqrt{\frac{2n-1}{2n}} \sin\theta P_{n-1}^{n-1} \\
+ *     P_n^m &=& \frac{(2n-1)\cos\theta P_{n-1}^m - \sqrt{(n-1)^2-m^2} P_{n-2}^m}{\sqrt{n^2-m^2}}
+ * @f}
+ * 
+ * The longitude terms use the multiple angle recursion. The Legendre functions are
+ * kept between calls and only recomputed when the colatitude moves by more than
+ * IGRF_LEGENDRE_TOLERANCE (a few meters, which only absorbs the rounding of the
+ * position). This only helps the evaluations at a fixed latitude: a ground station,
+ * or the longitudes of a row of MagGrid::sample. Along an orbit, the colatitude moves
+ * by about 1e-4 rad per step at 10 Hz, so the functions are recomputed at every call.
+ * 
+ * # Example code
+ * @code
+ * AstroLib::IGRF igrf(6);
+ * igrf.setJulianDate(AstroLib::JulianDate(2021, 3, 1, 12, 0, 0));
+ * float r_ecef[3] = {6778000.0f, 0.0f, 0.0f};
+ * float b_ecef[3];
+ * igrf.getField(b_ecef, r_ecef);   // uT
+ * @endcode
+ * 
+ * @see AstroLib
+ */
+class IGRF {
+public:
+///@name Constructors
+    /**
+     * @brief IGRF constructor
+     * @param degree The degree and order of the model (from 1 to IGRF_MAX_DEGREE)
+     */
+    IGRF(int degree = IGRF_DEFAULT_DEGREE);
+
+///@name Settings
+    /**
+     * @brief
+     * Sets the degree and order of the model
+     * @param degree The degree (from 1 to IGRF_MAX_DEGREE)
+     * @return 1 if the degree is valid, 0 otherwise (the degree is then unchanged)
+     */
+    int setDegree(int degree);
+
+    /**
+     * @brief
+     * Gets the degree and order of the model
+     * @return The degree
+     */
+    int getDegree();
+
+    /**
+     * @brief
+     * Applies the secular variation of the coefficients for a given date
+     * @details
+     * The secular variation is linear, so the model is usually only updated once per
+     * day or per pass
+     * @param date The date
+     */
+    void setJulianDate(JulianDate date);
+
+///@name Magnetic field
+    /**
+     * @brief
+     * Computes the magnetic field in the Earth Centered Earth Fixed frame
+     * @param b The array where to store the magnetic field (uT)
+     * @param r The position in the Earth Centered Earth Fixed frame (m)
+     */
+    void getField(float b[3], const float r[3]);
+
+private:
+    /**
+     * @brief
+     * Computes the Legendre functions and their derivatives for a colatitude
+     * @param ct The cosine of the colatitude
+     * @param st The sine of the colatitude
+     */
+    void updateLegendre(float ct, float st);
+
+    int _degree;            ///< Degree and order of the model
+    float _g[IGRF_SIZE];    ///< Coefficients g at the current date (nT)
+    float _h[IGRF_SIZE];    ///< Coefficients h at the current date (nT)
+    float _a[IGRF_SIZE];    ///< First recursion coefficient of the Legendre functions
+    float _b[IGRF_SIZE];    ///< Second recursion coefficient of the Legendre functions
+    float _P[IGRF_SIZE];    ///< Legendre functions at the last colatitude
+    float _dP[IGRF_SIZE];   ///< Derivatives of the Legendre functions at the last colatitude
+    float _ct;              ///< Cosine of the last colatitude (2 when not computed yet)
+    float _st;              ///< Sine of the last colatitude
+}; // class IGRF
+
+/**
+ * @ingroup AstroLibGr 
+ * @brief
+ * Magnetic field interpolated in a latitude, longitude and altitude grid
+ * 
+ * @class AstroLib::MagGrid
+ * 
+ * @details
+ * Alternative to the IGRF class for the flight: the grid is sampled on the ground from
+ * a high degree model (MagGrid::sample), stored in flash as a plain array of floats
+ * (or memory-mapped from a file on a host, see MagGrid::mapFile), and trilinearly
+ * interpolated at run time. An evaluation costs three trigonometric calls and 8 x 3
+ * multiply-adds, whatever the degree of the sampled model.
+ * 
+ * The grid points cover the latitudes from -90 to 90 deg (poles included), the
+ * longitudes from -180 deg with a wrap around, and the altitudes above the
+ * IGRF_RADIUS sphere from alt_min to alt_max. Each point holds the field in the Earth
+ * fixed frame multiplied by (r/a)^3: the dipole decay is removed before the
+ * interpolation, so that a few altitude levels are enough.
+ * 
+ * # Table layout
+ * All words are floats (the integers are exactly representable):
+ * - Header: [version, number of latitudes, number of longitudes, number of altitudes,
+ *   minimum altitude (m), maximum altitude (m), 0, 0]
+ * - For each altitude, latitude and longitude, the scaled field x, y, z (uT)
+ * 
+ * Thanks to the scaling, two altitude levels are enough over the usual range of a low
+ * orbit. Between 400 and 600 km, against a degree 13 IGRF, a 10 deg grid (19 x 36 x 2
+ * x 3 floats = 16 KB) stays within 1200 nT, and a 5 deg grid (37 x 72 x 2 x 3 floats =
+ * 62 KB) within 300 nT, which is better than a degree 6 model.
+ * 
+ * # Example code
+ * @code
+ * // Ground
+ * static float table[MAG_GRID_HEADER_SIZE + 19*36*2*3];
+ * AstroLib::IGRF igrf(13);
+ * igrf.setJulianDate(launch);
+ * int size = AstroLib::MagGrid::sample(table, sizeof(table)/sizeof(float), igrf, 19, 36, 2, 400000.0f, 600000.0f);
+ * fwrite(table, sizeof(float), size, file);
+ * 
+ * // Flight
+ * AstroLib::MagGrid grid;
+ * grid.load(table, sizeof(table)/sizeof(float));
+ * orbit.setMagGrid(&grid);
+ * orbit.getMagVector(mag);
+ * @endcode
+ * 
+ * @see AstroLib
+ */
+class MagGrid {
+public:
+///@name Constructors
+    /**
+     * @brief MagGrid constructor, the table has to be loaded before use
+     */
+    MagGrid();
+
+    /**
+     * @brief
+     * Loads a table (the table is not copied and must outlive the object)
+     * @param table The grid with its header
+     * @param size The number of words in the table
+     * @return 1 if the table is valid, 0 otherwise
+     */
+    int load(const float *table, int size);
+
+    /**
+     * @brief
+     * Computes the number of words of a table
+     * @param nlat The number of latitudes
+     * @param nlon The number of longitudes
+     * @param nalt The number of altitudes
+     * @return The number of words
+     */
+    static int tableSize(int nlat, int nlon, int nalt);
+
+    #ifdef ASTROLIB_USE_MMAP
+    /**
+     * @brief
+     * Memory-maps a table file on a POSIX host (read only)
+     * @param path The path of the file
+     * @param size The number of words of the table
+     * @return The table, 0 on failure
+     */
+    static const float* mapFile(const char *path, int *size);
+
+    /**
+     * @brief
+     * Unmaps a table mapped with MagGrid::mapFile
+     * @param table The table
+     * @param size The number of words of the table
+     */
+    static void unmapFile(const float *table, int size);
+    #endif
+
+///@name Magnetic field
+    /**
+     * @brief
+     * Interpolates the magnetic field in the Earth Centered Earth Fixed frame
+     * @details
+     * Outside of the altitude range, the closest level is used with the dipole decay
+     * @param b The array where to store the magnetic field (uT, zero if no table is loaded)
+     * @param r The position in the Earth Centered Earth Fixed frame (m)
+     */
+    void getField(float b[3], const float r[3]);
+
+///@name Ground tool
+    /**
+     * @brief
+     * Samples a field model on a grid
+     * @param table The table to fill
+     * @param capacity The number of words available in the table
+     * @param model The model to sample (usually a high degree IGRF at the mission date)
+     * @param nlat The number of latitudes (at least 2)
+     * @param nlon The number of longitudes (at least 2)
+     * @param nalt The number of altitudes (at least 1)
+     * @param alt_min The minimum altitude above IGRF_RADIUS (m)
+     * @param alt_max The maximum altitude above IGRF_RADIUS (m)
+     * @return The number of words written, 0 if the table is too small or the grid is invalid
+     */
+    static int sample(float *table, int capacity, IGRF& model, int nlat, int nlon, int nalt, float alt_min, float alt_max);
+
+private:
+    const float *_table;    ///< The grid (header included)
+    int _nlat;              ///< The number of latitudes
+    int _nlon;              ///< The number of longitudes
+    int _nalt;              ///< The number of altitudes
+    float _alt_min;         ///< The minimum altitude (m)
+    float _dlat;            ///< The latitude step (rad)
+    float _dlon;            ///< The longitude step (rad)
+    float _dalt;            ///< The altitude step (m)
+}; // class MagGrid
+
 /**
  * @ingroup AstroLibGr 
  * @brief
@@ -517,6 +1009,19 @@ private:
  * of the orbit. It can return the Sun vector and the Earth magnetic field
  * vector in the ECI frame.
  * 
+ * If ORBIT_USE_J2 is defined, the secular drift due to the oblateness of the Earth
+ * is added to the two-body model:
+ * 
+ * @f{align}{
+ *   \dot{\Omega} & = -\frac{3}{2} n J_2 \left(\frac{R_{\oplus}}{p}\right)^2 \cos i \nonumber \\
+ *   \dot{\omega} & = \frac{3}{4} n J_2 \left(\frac{R_{\oplus}}{p}\right)^2 \left(5 \cos^2 i - 1\right) \nonumber \\
+ *   \dot{M} & = n \left[1 + \frac{3}{4} J_2 \left(\frac{R_{\oplus}}{p}\right)^2 \sqrt{1-e^2} \left(3 \cos^2 i - 1\right)\right] \nonumber
+ * @f}
+ * 
+ * The node and perigee drift are accumulated and the rotation to the ECI frame is only
+ * recomputed when one of them exceeds ORBIT_J2_THRESHOLD, the mean anomaly rate is
+ * applied at every step at no extra cost.
+ * 
  * @see AstroLib
  */
 class Orbit {
@@ -553,6 +1058,11 @@ public:
     /**
      * @brief
      * Provides the Sun-vector in the ECI frame for the currently stored Julian date
+     * @details
+     * By default (ORBIT_SUN_REFRESH of 0), the full computation runs at every call. With
+     * a refresh period (see Orbit::setSunRefresh), it only runs once per period and the
+     * cached vector is extrapolated with its time derivative in between, which costs
+     * three multiply-adds (see Orbit::getSunErrorBound for the error).
      * @param rsun The array where to store the sun vector
      */
     void getSunVector(float rsun[3]);
@@ -563,12 +1073,110 @@ public:
      * @param rsun The array where to store the sun vector
      * @param date A JulianDate object representing the desired time
      */
-    void getSunVector(float rsun[3], JulianDate date);
+    static void getSunVector(float rsun[3], JulianDate date);
+
+    /**
+     * @brief
+     * Provides the Sun-vector in the ECI frame and its time derivative for a given Julian Date
+     * @param rsun The array where to store the sun vector (AU)
+     * @param drsun The array where to store the time derivative of the sun vector (AU/s)
+     * @param date A JulianDate object representing the desired time
+     */
+    static void getSunVector(float rsun[3], float drsun[3], JulianDate date);
+
+    /**
+     * @brief
+     * Sets the period of the full computation of the sun vector
+     * @param period The period (s), 0 to run the full computation at every call
+     */
+    void setSunRefresh(float period);
+
+    /**
+     * @brief
+     * Gets the period of the full computation of the sun vector
+     * @return The period (s)
+     */
+    float getSunRefresh();
+
+    /**
+     * @brief
+     * Bound of the difference between the sun vector and the full computation at the
+     * current date
+     * @details
+     * The truncation of the first order extrapolation is bounded by
+     * ORBIT_SUN_ACCELERATION * dt^2 / 2, with dt the time since the last full
+     * computation: about 1e-10 AU after a minute and 3e-7 AU after an hour. It is
+     * dominated by the float round-off of the two full computations (the cached one
+     * and the reference), which grows with the time since J2000 through the mean
+     * longitude: about 1e-4 AU in 2020, counted even without extrapolation.
+     * @return The error bound (AU, or rad on the direction)
+     */
+    float getSunErrorBound();
+
+///@name Earth shadow
+    /**
+     * @brief
+     * Illumination of a satellite in the cylindrical Earth shadow
+     * @details
+     * The shadow is a cylinder of radius R_EARTH behind the Earth: there is no penumbra,
+     * and the satellite is either lit or in eclipse.
+     * @param r_sat The position vector of the satellite in the ECI frame (m)
+     * @param rsun The sun vector in the ECI frame (any unit)
+     * @return 1 if the satellite is lit, 0 in eclipse
+     */
+    static float cylindricalShadow(float r_sat[3], float rsun[3]);
+
+    /**
+     * @brief
+     * Illumination of a satellite in the conical Earth shadow (umbra and penumbra)
+     * @details
+     * From the apparent radii of the Sun and the Earth seen from the satellite and the
+     * angle between their centers, the illumination is the visible fraction of the solar
+     * disk ("Satellite Orbits" by Montenbruck and Gill, section 3.4.2).
+     * @param r_sat The position vector of the satellite in the ECI frame (m)
+     * @param rsun The sun vector in the ECI frame (AU)
+     * @return The illumination, from 0 in the umbra to 1 in full sunlight
+     */
+    static float conicalShadow(float r_sat[3], float rsun[3]);
+
+    /**
+     * @brief
+     * Illumination of the satellite at the current Julian date
+     * @details
+     * The conical model is used with ORBIT_USE_CONICAL_SHADOW, the cylindrical one otherwise.
+     * @return The illumination, from 0 in eclipse to 1 in full sunlight
+     */
+    float getIllumination();
+
+    /**
+     * @brief
+     * Predicts the next eclipse of the satellite
+     * @details
+     * The orbit is propagated from the current state without changing it, with the sun
+     * vector extrapolated from the current date. The shadow boundary (the penumbra with
+     * ORBIT_USE_CONICAL_SHADOW) is searched with a fixed time step, then each crossing is
+     * refined by bisection down to ORBIT_ECLIPSE_TOLERANCE, or ORBIT_ECLIPSE_BISECTIONS
+     * halvings when the float spacing of the time is coarser (past about 2^20 s). An
+     * eclipse shorter than the step can be missed. If the satellite is already in eclipse, the entry time is 0.
+     * Both times are always written, -1 meaning not found within the window (an entry
+     * can be found without its exit).
+     * @param entry Where to store the time of the eclipse entry (s from the current date, -1 if not found)
+     * @param exit Where to store the time of the eclipse exit (s from the current date, -1 if not found)
+     * @param horizon The search window (s), two orbit periods if 0
+     * @param step The time step of the search (s), 0 is returned if it is not positive
+     * @return 1 if the entry and the exit were found within the window, 0 otherwise
+     * (also when the step is not positive or the orbit is not set)
+     */
+    int predictEclipse(float *entry, float *exit, float horizon = 0, float step = ORBIT_ECLIPSE_STEP);
 
 ///@name Spacecraft position management
     /**
      * @brief
      * Set the orbit parameters
+     * @details
+     * With ORBIT_USE_J2, the parameters are mean elements: the mean motion is corrected
+     * for J2, so the semi major axis must not be derived from an observed orbit period
+     * that already includes the J2 effect.
      * @param axis The semi major axis of the orbit (m)
      * @param ecc The eccentricity of the orbit
      * @param inc The orbit plane inclination (rad)
@@ -588,11 +1196,18 @@ public:
 
     /**
      * @brief
-     * Update the mean anomaly at the current Julian date
+     * Update the mean, eccentric and true anomalies at the current Julian date
+     * @details
+     * For the small steps of the control loop, the Kepler equation is warm-started from the
+     * previous eccentric anomaly with a first order prediction, and a single Newton iteration
+     * is usually enough. Larger steps start from the Markley starter (Orbit::keplerStarter).
+     * The number of Newton iterations is bounded by KEPLER_MAX_ITERATIONS so that the cost
+     * of an update is predictable.
      * @param seconds The time since last update
-     * @param tolerance The tolerance for the Newton optimization method
+     * @param tolerance The tolerance for the Newton optimization method (rad)
+     * @return The number of Newton iterations
      */
-    void updateTrueAnomaly(float seconds, float tolerance);
+    int updateTrueAnomaly(float seconds, float tolerance = KEPLER_TOLERANCE);
 
     /**
      * @brief
@@ -610,7 +1225,23 @@ public:
      * @param jday The Julian day (The object julian day if default or 0)
      * @param jfrac The Julian day fraction (The object julian day fraction if default or 0)
      */
-    void mag_vector(float mag[3], float r_sat[3], long jday, float jfrac);
+    static void mag_vector(float mag[3], float r_sat[3], long jday, float jfrac);
+
+    /**
+     * @brief
+     * Computes the Earth magnetic field vector from a model of the Earth fixed frame for a given orbit position in the ECI frame
+     * @param mag The magnetic vector of the Earth magnetic field (uT)
+     * @param r_sat The position vector of the satellite (m)
+     * @param frames The frames, at the date of the position
+     * @param model The field model, with a getField(b, r) method in the Earth fixed frame (IGRF or MagGrid)
+     */
+    template <class Field>
+    static void mag_vector(float mag[3], float r_sat[3], Frames& frames, Field& model){
+        float r_ecef[3];
+        frames.eciToEcef(r_ecef, r_sat);
+        model.getField(mag, r_ecef);
+        frames.ecefToEci(mag, mag);
+    }
 
     /**
      * @brief
@@ -619,6 +1250,30 @@ public:
      */
     void getMagVector(float rmag[3]);
 
+    #ifdef ORBIT_USE_IGRF
+    /**
+     * @brief
+     * Sets the degree and order of the IGRF model of the magnetic field
+     * @param degree The degree (from 1 to IGRF_MAX_DEGREE)
+     * @return 1 if the degree is valid, 0 otherwise
+     */
+    int setMagDegree(int degree);
+    #endif
+
+    /**
+     * @brief
+     * Uses a grid for the magnetic field instead of the model
+     * @param grid The loaded grid, 0 to go back to the model
+     */
+    void setMagGrid(MagGrid *grid);
+
+    /**
+     * @brief
+     * Provides the frame conversions at the current date
+     * @return The frames, with the rotation of the Earth at the current date
+     */
+    Frames& getFrames();
+
 ///@name Static methods
     /**
      * @brief
@@ -629,6 +1284,34 @@ public:
      * @param vec The array where to store the position vector
      */
     static void AzEl2NED(float azimuth, float elevation, float vec[3]);
+
+    /**
+     * @brief
+     * Solves the Kepler equation E - e sin(E) = M for the eccentric anomaly
+     * with Newton iterations
+     * @param M The mean anomaly (rad)
+     * @param ecc The eccentricity (0 <= ecc < 1)
+     * @param E0 The initial guess of the eccentric anomaly (rad)
+     * @param tolerance The tolerance on the eccentric anomaly (rad)
+     * @param max_iter The maximum number of Newton iterations
+     * @param iterations Where to store the number of iterations (optional)
+     * @return The eccentric anomaly (rad)
+     */
+    static float solveKepler(float M, float ecc, float E0, float tolerance = KEPLER_TOLERANCE,
+                             int max_iter = KEPLER_MAX_ITERATIONS, int *iterations = 0);
+
+    /**
+     * @brief
+     * Initial guess of the eccentric anomaly for any eccentricity
+     * @details
+     * Cubic starter from "Kepler Equation Solver" by Markley (1995). It is accurate to about
+     * 1e-3 rad even at high eccentricity, so a couple of Newton iterations reach the float
+     * precision.
+     * @param M The mean anomaly (rad, in [-pi, pi])
+     * @param ecc The eccentricity (0 <= ecc < 1)
+     * @return The initial guess of the eccentric anomaly (rad)
+     */
+    static float keplerStarter(float M, float ecc);
        
 private:
     /**
@@ -637,7 +1320,7 @@ private:
      * @param vec The vector from which to calculate the norm
      * @return The norm of the vector
      */
-    float norm(float vec[3]);
+    static float norm(float vec[3]);
     
     /**
      * @brief
@@ -647,7 +1330,62 @@ private:
      * @param b Second vector
      * @return The result of transpose(a)*b
      */
-    float scalar(float *a, float *b);
+    static float scalar(float *a, float *b);
+
+    /**
+     * @brief
+     * Computes the rotation from the perifocal to the ECI frame (scaled by the
+     * semi-latus rectum) from the current orbit angles
+     */
+    void updateRotECI();
+
+    /**
+     * @brief
+     * Computes the rotation from the perifocal to the ECI frame (scaled by the
+     * semi-latus rectum) for given orbit angles
+     * @param rot The 9-element array where to store the rotation (the third column is skipped)
+     * @param Omega The right ascension node (rad)
+     * @param omega The argument of perigee (rad)
+     */
+    void rotationECI(float rot[9], float Omega, float omega);
+
+    /**
+     * @brief
+     * Computes the position of the satellite at a given time from the current state,
+     * without changing it (used by the eclipse prediction)
+     * @param r_sat The array where to store the position vector (m)
+     * @param seconds The time from the current date (s)
+     */
+    void positionAt(float r_sat[3], float seconds);
+
+    /**
+     * @brief
+     * Signed distance to the Earth shadow, continuous along the orbit (used by the
+     * eclipse prediction)
+     * @param r_sat The position vector of the satellite in the ECI frame (m)
+     * @param rsun The sun vector in the ECI frame (AU)
+     * @return Positive when lit, negative in the shadow (rad for the conical model, m for the cylindrical one)
+     */
+    static float shadowFunction(float r_sat[3], float rsun[3]);
+
+    /**
+     * @brief
+     * Signed distance to the Earth shadow at a given time from the current state (used
+     * by the eclipse prediction)
+     * @param seconds The time from the current date (s)
+     * @param sun The sun vector at the current date (AU)
+     * @param dsun The time derivative of the sun vector (AU/s)
+     * @return Positive when lit, negative in the shadow (see Orbit::shadowFunction)
+     */
+    float shadowAt(float seconds, float sun[3], float dsun[3]);
+
+    /**
+     * @brief
+     * Accumulates the secular J2 drift of the node and perigee, and updates the
+     * rotation to the ECI frame when the drift exceeds ORBIT_J2_THRESHOLD
+     * @param seconds The time since last update
+     */
+    void updateJ2(float seconds);
     
     /* Private variables */
 
@@ -658,14 +1396,34 @@ private:
     float inc_;         ///< Orbital plane inclination (rad)
     float Omega_;       ///< Right ascension node longitude (rad)
     float omega_;       ///< Argument perigee (rad)
-    float M_;           ///< Mean anomaly
+    float M_;           ///< Mean anomaly (rad, in [-pi, pi])
     float E_;           ///< Eccentric anomaly (rad)
     float theta_;       ///< True anomaly (rad)
+    float M_err_;       ///< Rounding error of the mean anomaly carried over to the next update
 
     // orbit computed-once variables 
     float rate;         ///< Mean angular rate (rad/s)
     float eccRatio;     ///< = sqrt((1+ecc)/(1-ecc))
     float rotECI[9];    ///< Rotation from perifocal to ECI frame
+
+    // J2 secular drift
+    float Omega_dot;    ///< Secular rate of the right ascension node (rad/s)
+    float omega_dot;    ///< Secular rate of the argument of perigee (rad/s)
+    float dOmega_;      ///< Drift of the right ascension node not yet applied to rotECI (rad)
+    float domega_;      ///< Drift of the argument of perigee not yet applied to rotECI (rad)
+
+    #ifdef ORBIT_USE_IGRF
+    IGRF igrf_;         ///< Model of the Earth magnetic field
+    #endif
+    MagGrid *grid_;     ///< Grid of the Earth magnetic field (0 to use the model)
+    Frames frames_;     ///< Conversions between the ECI and ECEF frames at the current date
+
+    // Sun vector cache
+    float sun_[3];      ///< Sun vector at the last full computation (AU)
+    float dsun_[3];     ///< Time derivative of the sun vector at the last full computation (AU/s)
+    float sun_dt_;      ///< Time since the last full computation (s)
+    float sun_period_;  ///< Period of the full computation (s)
+    int sun_valid_;     ///< Whether the cache matches the current date
 }; // class Orbit
 
 /**
@@ -780,6 +1538,422 @@ private:
     float _rmag[3];         ///< The magnetic field at the location (in uT)
 }; // class Ground
 
+#ifdef ASTROLIB_SGP4_USE_DOUBLE
+typedef double sgp4_real;   ///< Floating point type of the SGP4 propagator
+#else
+typedef float sgp4_real;    ///< Floating point type of the SGP4 propagator
+#endif
+
+/**
+ * @ingroup AstroLibGr
+ * @brief
+ * Error codes of the SGP4 propagator
+ */
+enum SGP4Error{
+    SGP4_OK = 0,            ///< No error
+    SGP4_TLE_ERROR,         ///< The TLE lines could not be parsed
+    SGP4_DEEP_SPACE,        ///< Orbit period above 225 min, the deep space model (SDP4) is not implemented
+    SGP4_ECCENTRICITY,      ///< The mean eccentricity went out of [0, 1)
+    SGP4_SEMILATUS,         ///< The semi-latus rectum became negative
+    SGP4_DECAYED            ///< The satellite is below the surface of the Earth
+};
+
+/**
+ * @ingroup AstroLibGr 
+ * @brief
+ * Provide an SGP4 orbit propagator initialized from a Two-Line Element set
+ * 
+ * @class AstroLib::SGP4
+ * 
+ * @details
+ * Drop-in replacement for the Orbit class that propagates the NORAD Two-Line Elements
+ * with the SGP4 model, as described in "Revisiting Spacetrack Report #3" by Vallado,
+ * Crawford, Hujsak and Kelso (near Earth model only, WGS-72 constants). Unlike the
+ * two-body model of the Orbit class, it accounts for the J2, J3 and J4 zonal harmonics
+ * and the atmospheric drag, so that the position stays within a few kilometres for days
+ * instead of drifting quickly away from the elements uplinked from the ground.
+ * 
+ * The position and velocity are given in the True Equator Mean Equinox (TEME) frame,
+ * used as the ECI frame by the rest of the library.
+ * 
+ * The computation uses the sgp4_real type: float on the microcontroller, or double on the
+ * ground if ASTROLIB_SGP4_USE_DOUBLE is defined. In float, the position stays within
+ * about a hundred meters of the double precision computation after three days.
+ * 
+ * # Example code
+ * @code
+ * AstroLib::SGP4 orbit;
+ * orbit.setTLE("1 88888U          80275.98708465  .00073094  13844-3  66816-4 0     8",
+ *              "2 88888  72.8435 115.9689 0086731  52.6988 110.5714 16.05824518  1058");
+ * orbit.setJulianDate(orbit.getEpoch());
+ * while(1){
+ *     orbit.update(dt);
+ *     orbit.getPositionVector(r_sat);
+ *     orbit.getMagVector(mag);
+ * }
+ * @endcode
+ * 
+ * @see AstroLib
+ */
+class SGP4 {
+public:
+///@name Constructors
+    /**
+     * @brief SGP4 constructor
+     */
+    SGP4();
+
+///@name Date management
+    /**
+     * @brief
+     * Gets the Julian Date member of the orbit
+     * @return The Julian Date
+     */
+    JulianDate getJulianDate();
+
+    /**
+     * @brief
+     * Sets the Julian Date member of the orbit and propagates the orbit to this date
+     * @param date The new date
+     */
+    void setJulianDate(JulianDate date);
+
+    /**
+     * @brief
+     * Update the orbit to match the number of seconds ellapsed
+     * @param seconds The number of seconds ellapsed since last update
+     */
+    void update(float seconds);
+
+///@name Sun position
+    /**
+     * @brief
+     * Provides the Sun-vector in the ECI frame for the currently stored Julian date
+     * @param rsun The array where to store the sun vector
+     */
+    void getSunVector(float rsun[3]);
+
+///@name Spacecraft position management
+    /**
+     * @brief
+     * Sets the orbit from a Two-Line Element set
+     * @details
+     * The lines are parsed by column as specified by NORAD, the checksums are not verified.
+     * @param line1 The first line of the TLE (at least 63 characters)
+     * @param line2 The second line of the TLE (at least 63 characters)
+     * @return SGP4_OK if successful, an AstroLib::SGP4Error otherwise
+     */
+    int setTLE(const char *line1, const char *line2);
+
+    /**
+     * @brief
+     * Gets the epoch of the Two-Line Elements
+     * @return The Julian date of the epoch
+     */
+    JulianDate getEpoch();
+
+    /**
+     * @brief
+     * Propagates the orbit to a given time since the epoch of the elements
+     * @param tsince The time since the epoch (min)
+     * @return SGP4_OK if successful, an AstroLib::SGP4Error otherwise
+     */
+    int propagate(sgp4_real tsince);
+
+    /**
+     * @brief
+     * Provide the current position vector
+     * @param r_sat The position vector of the satellite (m)
+     */
+    void getPositionVector(float r_sat[3]);
+
+    /**
+     * @brief
+     * Provide the current velocity vector
+     * @param v_sat The velocity vector of the satellite (m/s)
+     */
+    void getVelocityVector(float v_sat[3]);
+
+    /**
+     * @brief
+     * Gets the error of the last propagation
+     * @return SGP4_OK if successful, an AstroLib::SGP4Error otherwise
+     */
+    int getError();
+
+///@name Earth magnetic field
+    /**
+     * @brief
+     * Provides the Earth magnetic field vector according to the model
+     * @param rmag The array where to store the magnetic field
+     */
+    void getMagVector(float rmag[3]);
+
+    #ifdef ORBIT_USE_IGRF
+    /**
+     * @brief
+     * Sets the degree and order of the IGRF model of the magnetic field
+     * @param degree The degree (from 1 to IGRF_MAX_DEGREE)
+     * @return 1 if the degree is valid, 0 otherwise
+     */
+    int setMagDegree(int degree);
+    #endif
+
+    /**
+     * @brief
+     * Uses a grid for the magnetic field instead of the model
+     * @param grid The loaded grid, 0 to go back to the model
+     */
+    void setMagGrid(MagGrid *grid);
+
+    /**
+     * @brief
+     * Provides the frame conversions at the current date
+     * @return The frames, with the rotation of the Earth at the current date
+     */
+    Frames& getFrames();
+
+private:
+    JulianDate _date;       ///< The current Julian Date on the orbit
+    JulianDate _epoch;      ///< The epoch of the elements
+    sgp4_real _tsince;      ///< The time since the epoch (min)
+    sgp4_real _tsince_err;  ///< Rounding error of the time since the epoch carried over to the next update
+    int _error;             ///< The error of the last propagation (AstroLib::SGP4Error)
+
+    // Mean elements at epoch
+    sgp4_real _bstar;       ///< Drag term (1/earth radii)
+    sgp4_real _inclo;       ///< Inclination (rad)
+    sgp4_real _nodeo;       ///< Right ascension of the ascending node (rad)
+    sgp4_real _ecco;        ///< Eccentricity
+    sgp4_real _argpo;       ///< Argument of perigee (rad)
+    sgp4_real _mo;          ///< Mean anomaly (rad)
+    sgp4_real _no;          ///< Un-Kozai mean motion (rad/min)
+
+    // Computed-once coefficients
+    int _isimp;             ///< Simplified drag model for perigees below 220 km
+    sgp4_real _ao, _eta, _sinmao, _delmo;
+    sgp4_real _cc1, _cc4, _cc5, _d2, _d3, _d4;
+    sgp4_real _t2cof, _t3cof, _t4cof, _t5cof;
+    sgp4_real _mdot, _argpdot, _nodedot, _nodecf;
+    sgp4_real _omgcof, _xmcof, _xlcof, _aycof;
+    sgp4_real _con41, _x1mth2, _x7thm1;
+
+    // Propagated state
+    float _r[3];            ///< Position in the TEME frame (m)
+    float _v[3];            ///< Velocity in the TEME frame (m/s)
+
+    #ifdef ORBIT_USE_IGRF
+    IGRF _igrf;             ///< Model of the Earth magnetic field
+    #endif
+    MagGrid *_grid;         ///< Grid of the Earth magnetic field (0 to use the model)
+    Frames _frames;         ///< Conversions between the ECI and ECEF frames at the current date
+}; // class SGP4
+
+/**
+ * @ingroup AstroLibGr 
+ * @brief
+ * Provide the sun vector, position and magnetic field from a precomputed table
+ * of Chebyshev polynomials
+ * 
+ * @class AstroLib::Ephemeris
+ * 
+ * @details
+ * Drop-in replacement for the Orbit class for a known time window (e.g. a pass). On the
+ * ground, Ephemeris::fit samples any of the models (Orbit, SGP4 or Ground) and fits
+ * Chebyshev polynomials of a given order over consecutive segments of the window. The
+ * table is a plain array of floats that can be written to a binary file and stored in the
+ * flash of the microcontroller.
+ * 
+ * In flight, each vector is evaluated with the Clenshaw recurrence, in a few
+ * multiply-adds per component instead of the trigonometry of the models:
+ * 
+ * @f{equation}{
+ *     f(t) \approx \sum_{j=0}^{n} c_j T_j(x), \quad x = 2 \frac{t - t_i}{\Delta t} - 1
+ * @f}
+ * 
+ * # Table layout
+ * All words are floats (the integers are exactly representable):
+ * - Header: [version, number of coefficients (order + 1), number of segments,
+ *   segment duration (s), epoch Julian day, epoch day fraction, channels, 0]
+ * - For each segment and each channel (sun x, y, z in AU, position x, y, z in m,
+ *   magnetic field x, y, z), the coefficients c_0 to c_n
+ * 
+ * A 3 hours window with 10 minutes segments of order 9 takes 18 x 9 x 10 floats = 6.5 KB.
+ * 
+ * # Example code
+ * @code
+ * // Ground
+ * static float table[EPHEMERIS_HEADER_SIZE + 18*EPHEMERIS_CHANNELS*10];
+ * orbit.setJulianDate(start);
+ * int size = AstroLib::Ephemeris::fit(table, sizeof(table)/sizeof(float), orbit, 18, 600.0f, 9);
+ * fwrite(table, sizeof(float), size, file);
+ * 
+ * // Flight
+ * AstroLib::Ephemeris ephemeris;
+ * ephemeris.load(table, sizeof(table)/sizeof(float));
+ * ephemeris.setJulianDate(now);
+ * ephemeris.update(dt);
+ * ephemeris.getSunVector(sun);
+ * @endcode
+ * 
+ * @see AstroLib
+ */
+class Ephemeris {
+public:
+///@name Constructors
+    /**
+     * @brief Ephemeris constructor, the table has to be loaded before use
+     */
+    Ephemeris();
+
+    /**
+     * @brief
+     * Loads a table (the table is not copied and must outlive the object)
+     * @param table The table of coefficients with its header
+     * @param size The number of words in the table
+     * @return 1 if the table is valid, 0 otherwise
+     */
+    int load(const float *table, int size);
+
+    /**
+     * @brief
+     * Computes the number of words of a table
+     * @param segments The number of segments
+     * @param order The order of the Chebyshev polynomials
+     * @return The number of words
+     */
+    static int tableSize(int segments, int order);
+
+///@name Date management
+    /**
+     * @brief
+     * Gets the Julian Date member of the ephemeris
+     * @return The Julian Date
+     */
+    JulianDate getJulianDate();
+
+    /**
+     * @brief
+     * Sets the Julian Date member of the ephemeris
+     * @param date The new date
+     */
+    void setJulianDate(JulianDate date);
+
+    /**
+     * @brief
+     * Update the ephemeris to match the number of seconds ellapsed
+     * @param seconds The number of seconds ellapsed since last update
+     * @return 1 if the date is covered by the table, 0 otherwise (the closest segment is extrapolated)
+     */
+    int update(float seconds);
+
+///@name Vectors
+    /**
+     * @brief
+     * Provides the Sun-vector in the ECI frame (in AU)
+     * @param rsun The array where to store the sun vector
+     */
+    void getSunVector(float rsun[3]);
+
+    /**
+     * @brief
+     * Provide the current position vector
+     * @param r_sat The position vector of the satellite (m)
+     */
+    void getPositionVector(float r_sat[3]);
+
+    /**
+     * @brief
+     * Provides the Earth magnetic field vector according to the model used for the fit
+     * @param rmag The array where to store the magnetic field
+     */
+    void getMagVector(float rmag[3]);
+
+///@name Ground tool
+    /**
+     * @brief
+     * Fits the Chebyshev polynomials to a model over consecutive segments
+     * @details
+     * The polynomials interpolate the model at the Chebyshev nodes of each segment, which
+     * is close to the best uniform approximation. The model must be set at the start date
+     * beforehand, it is then only advanced with its update method.
+     * @param table The table to fill
+     * @param capacity The number of words available in the table
+     * @param model The model to sample (Orbit, SGP4 or Ground), at the start date
+     * @param segments The number of segments
+     * @param span The duration of each segment (s)
+     * @param order The order of the polynomials (at most EPHEMERIS_MAX_ORDER)
+     * @return The number of words written, 0 if the table is too small
+     */
+    template <class Model>
+    static int fit(float *table, int capacity, Model& model, int segments, float span, int order){
+        int ncoef = order + 1;
+        int size = tableSize(segments, order);
+        float samples[EPHEMERIS_MAX_ORDER + 1][EPHEMERIS_CHANNELS];
+        float t_model = 0;  // Time of the model in the segment (s)
+        float t_node;
+        float *coef;
+        JulianDate epoch = model.getJulianDate();
+
+        if(order < 0 || order > EPHEMERIS_MAX_ORDER || size > capacity){
+            return 0;
+        }
+        table[0] = EPHEMERIS_VERSION;
+        table[1] = ncoef;
+        table[2] = segments;
+        table[3] = span;
+        table[4] = epoch.getDay();
+        table[5] = epoch.getFrac();
+        table[6] = EPHEMERIS_CHANNELS;
+        table[7] = 0;
+
+        for(int i = 0; i < segments; i++){
+            // Sampling at the Chebyshev nodes, in chronological order
+            for(int k = ncoef - 1; k >= 0; k--){
+                t_node = 0.5f * span * (1 + cos(PI * (k + 0.5f) / ncoef));
+                model.update(t_node - t_model);
+                t_model = t_node;
+                model.getSunVector(samples[k]);
+                model.getPositionVector(samples[k] + 3);
+                model.getMagVector(samples[k] + 6);
+            }
+            model.update(span - t_model);
+            t_model = 0;
+
+            // Discrete Chebyshev transform
+            coef = table + EPHEMERIS_HEADER_SIZE + i * EPHEMERIS_CHANNELS * ncoef;
+            for(int c = 0; c < EPHEMERIS_CHANNELS; c++){
+                for(int j = 0; j < ncoef; j++){
+                    float sum = 0;
+                    for(int k = 0; k < ncoef; k++){
+                        sum += samples[k][c] * cos(PI * j * (k + 0.5f) / ncoef);
+                    }
+                    coef[c * ncoef + j] = ((j == 0) ? 1.0f : 2.0f) * sum / ncoef;
+                }
+            }
+        }
+        return size;
+    }
+
+private:
+    /**
+     * @brief
+     * Evaluates three consecutive channels at the current date
+     * @param vec The array where to store the vector
+     * @param channel The first channel
+     */
+    void evaluate(float vec[3], int channel);
+
+    const float *_table;    ///< The table of coefficients (header included)
+    int _ncoef;             ///< The number of coefficients of each polynomial (order + 1)
+    int _segments;          ///< The number of segments
+    float _span;            ///< The duration of each segment (s)
+    JulianDate _epoch;      ///< The start date of the table
+    JulianDate _date;       ///< The current date
+    float _t;               ///< The time since the start of the table (s)
+    float _t_err;           ///< Rounding error of the time carried over to the next update
+}; // class Ephemeris
+
 } // namespace AstroLib
 
 #endif // ASTROLIB_H
\ No newline at end of file
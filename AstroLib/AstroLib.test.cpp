@@ -60,6 +60,402 @@ int AstroLibTest(){
     printf("Objects created");
     #endif
 
+    /************* JULIAN DATE ************/
+    // An hour of 10 ms updates against the exact date, with the drift of a float
+    // fraction of day for comparison, then the carry of the substractions
+    JulianDate jd_start(year,month,day,hours,minutes,seconds);
+    JulianDate jd_loop = jd_start;
+    float jd_float_frac = jd_start.getFrac();
+    for(int k = 0; k < 360000; k++){
+        jd_loop.update(0.01f);
+        jd_float_frac += 0.01f / 86400.0f;
+    }
+    JulianDate jd_diff = JulianDate(year,month,day,hours+1,minutes,seconds) - JulianDate(0, 0.75f);
+    #ifdef MBED_H
+    printf("Julian date | 1 h of 10 ms steps | exact %d | error %f s (float fraction %f s) | substraction %ld and %f\n\r",
+            jd_loop == JulianDate(year,month,day,hours+1,minutes,seconds), jd_loop.secondsSince(jd_start) - 3600.0f,
+            (jd_float_frac - jd_start.getFrac()) * 86400.0f - 3600.0f, jd_diff.getDay(), jd_diff.getFrac());
+    #endif
+
+    /*************** FRAMES ***************/
+    // Sidereal time of Vallado's example 3-5 (1992-08-20 12:14 UT1, 152.578787886 deg),
+    // round trip through the ECI, ECEF and NED frames, and cost of a batch of 3 vectors
+    // against a sidereal time per vector
+    #define FRAMES_RUNS 1000
+    Frames frames;
+    float frames_vec[3][3] = {{6878000.0f, 0.0f, 0.0f}, {0.0f, 20.0f, -30.0f}, {-0.4f, -0.9f, 0.2f}};
+    float frames_out[3][3];
+    float frames_err = 0;
+    int batch_time = 0, single_time = 0;
+    frames.setJulianDate(JulianDate(1992,8,20,12,14,0));
+    float gmst = frames.getSiderealTime() * RAD2DEG;
+    frames.setLocation(55.86515f*DEG2RAD, -4.25763f*DEG2RAD);
+    frames.eciToNed(frames_out[0], frames_vec[0], 3);
+    frames.nedToEci(frames_out[0], frames_out[0], 3);
+    for(int i = 0; i < 3; i++){
+        for(int k = 0; k < 3; k++){
+            float frames_e = fabs(frames_out[i][k] - frames_vec[i][k]) / sqrt(frames_vec[i][0]*frames_vec[i][0] + frames_vec[i][1]*frames_vec[i][1] + frames_vec[i][2]*frames_vec[i][2]);
+            frames_err = (frames_e > frames_err) ? frames_e : frames_err;
+        }
+    }
+    JulianDate frames_date(year,month,day,hours,minutes,seconds);
+    for(int run = 0; run < FRAMES_RUNS; run++){
+        frames_date.update(0.1f);
+        #ifdef MBED_H
+        time = t.read_us();
+        #endif
+        frames.setJulianDate(frames_date);
+        frames.eciToEcef(frames_out[0], frames_vec[0], 3);
+        #ifdef MBED_H
+        batch_time += t.read_us() - time;
+        time = t.read_us();
+        #endif
+        for(int i = 0; i < 3; i++){
+            float theta_g = Frames::siderealTime(frames_date);
+            frames_out[i][0] =   cos(theta_g) * frames_vec[i][0] + sin(theta_g) * frames_vec[i][1];
+            frames_out[i][1] = - sin(theta_g) * frames_vec[i][0] + cos(theta_g) * frames_vec[i][1];
+            frames_out[i][2] =   frames_vec[i][2];
+        }
+        #ifdef MBED_H
+        single_time += t.read_us() - time;
+        #endif
+    }
+    #ifdef MBED_H
+    printf("Frames | GMST %11.6f deg (error %e deg) | round trip error %e | batch of 3 %7.3f us | per vector %7.3f us\n\r",
+            gmst, gmst - 152.578787886f, frames_err, (float)batch_time/FRAMES_RUNS, (float)single_time/FRAMES_RUNS);
+    #endif
+
+    /************ KEPLER SOLVER ***********/
+    // Cost of an orbit update at 10 Hz (warm start) and worst residual of the
+    // Kepler equation from the Markley starter (cold start) for several eccentricities
+    #define KEPLER_RUNS 1000
+    float ecc_bench[4] = {0.001f, 0.1f, 0.5f, 0.9f};
+    Orbit kepler_orbit;
+    int kepler_iter;
+    int kepler_max_iter;
+    float mean_anomaly, ecc_anomaly, residual, residual_max;
+    for(int i = 0; i < 4; i++){
+        kepler_orbit.setOrbit(6878000.0f, ecc_bench[i], 51.6f*DEG2RAD, 0.0f, 0.0f, 0.0f);
+        kepler_max_iter = 0;
+        #ifdef MBED_H
+        time = t.read_us();
+        #endif
+        for(int run = 0; run < KEPLER_RUNS; run++){
+            kepler_iter = kepler_orbit.updateTrueAnomaly(0.1f);
+            kepler_max_iter = (kepler_iter > kepler_max_iter) ? kepler_iter : kepler_max_iter;
+        }
+        #ifdef MBED_H
+        time = t.read_us() - time;
+        #endif
+
+        residual_max = 0;
+        for(int k = -100; k <= 100; k++){
+            mean_anomaly = PI * k / 100.0f;
+            ecc_anomaly = Orbit::solveKepler(mean_anomaly, ecc_bench[i], Orbit::keplerStarter(mean_anomaly, ecc_bench[i]), KEPLER_TOLERANCE, KEPLER_MAX_ITERATIONS, &kepler_iter);
+            residual = fabs(ecc_anomaly - ecc_bench[i] * sin(ecc_anomaly) - mean_anomaly);
+            residual_max = (residual > residual_max) ? residual : residual_max;
+            kepler_max_iter = (kepler_iter > kepler_max_iter) ? kepler_iter : kepler_max_iter;
+        }
+
+        #ifdef MBED_H
+        printf("Kepler | e = %5.3f | %7.3f us per update | max %d iterations | max residual %e rad\n\r",
+                ecc_bench[i], (float)time/KEPLER_RUNS, kepler_max_iter, residual_max);
+        #endif
+    }
+
+    /************* SUN VECTOR *************/
+    // Cost of the sun vector at 10 Hz over an hour for several refresh periods of the
+    // full computation, and worst difference to the full computation against the bound
+    #define SUN_STEPS 36000
+    float sun_refresh[3] = {0.0f, 60.0f, 3600.0f};
+    Orbit sun_orbit;
+    float sun_ref[3];
+    float sun_diff, sun_diff_max, sun_bound_max;
+    int sun_time;
+    for(int i = 0; i < 3; i++){
+        sun_orbit.setJulianDate(JulianDate(year,month,day,hours,minutes,seconds));
+        sun_orbit.setSunRefresh(sun_refresh[i]);
+        sun_diff_max = 0;
+        sun_bound_max = 0;
+        sun_time = 0;
+        for(int k = 0; k < SUN_STEPS; k++){
+            sun_orbit.update(0.1f);
+            #ifdef MBED_H
+            time = t.read_us();
+            #endif
+            sun_orbit.getSunVector(sun_eci);
+            #ifdef MBED_H
+            sun_time += t.read_us() - time;
+            #endif
+            Orbit::getSunVector(sun_ref, sun_orbit.getJulianDate());
+            sun_diff = sqrt((sun_eci[0]-sun_ref[0])*(sun_eci[0]-sun_ref[0]) + (sun_eci[1]-sun_ref[1])*(sun_eci[1]-sun_ref[1])
+                          + (sun_eci[2]-sun_ref[2])*(sun_eci[2]-sun_ref[2]));
+            sun_diff_max = (sun_diff > sun_diff_max) ? sun_diff : sun_diff_max;
+            sun_bound_max = (sun_orbit.getSunErrorBound() > sun_bound_max) ? sun_orbit.getSunErrorBound() : sun_bound_max;
+        }
+        #ifdef MBED_H
+        printf("Sun vector | refresh %6.0f s | %7.3f us per call | max difference to full %e AU | bound %e AU\n\r",
+                sun_refresh[i], (float)sun_time/SUN_STEPS, sun_diff_max, sun_bound_max);
+        #endif
+    }
+
+    /************** ECLIPSE ***************/
+    // Predicted entry and exit of the next eclipse, checked by stepping the orbit by
+    // 1 s and looking at the illumination, with the time spent in the umbra and in the
+    // cylindrical shadow for comparison
+    Orbit ecl_orbit;
+    float ecl_entry = -1, ecl_exit = -1, ecl_pred_entry = -1, ecl_pred_exit = -1;
+    float ecl_light, ecl_umbra = 0, ecl_cylinder = 0;
+    float ecl_rsat[3];
+    int ecl_found;
+    ecl_orbit.setJulianDate(JulianDate(year,month,day,hours,minutes,seconds));
+    ecl_orbit.setOrbit(6878000.0f, 0.001f, 51.6f*DEG2RAD, 0.0f, 0.0f, 0.0f);
+    #ifdef MBED_H
+    time = t.read_us();
+    #endif
+    ecl_found = ecl_orbit.predictEclipse(&ecl_pred_entry, &ecl_pred_exit);
+    #ifdef MBED_H
+    time = t.read_us() - time;
+    #endif
+    // Invalid calls return at once: no orbit set, null step, and an entry without its exit
+    Orbit ecl_unset;
+    float ecl_e[3], ecl_x[3];
+    int ecl_invalid = ecl_unset.predictEclipse(&ecl_e[0], &ecl_x[0]);
+    ecl_invalid += ecl_orbit.predictEclipse(&ecl_e[1], &ecl_x[1], 0, 0);
+    ecl_invalid += ecl_orbit.predictEclipse(&ecl_e[2], &ecl_x[2], ecl_pred_entry + 60);
+    #ifdef MBED_H
+    printf("Eclipse | invalid calls found %d | unset [%4.0f, %4.0f] | null step [%4.0f, %4.0f] | short window [%7.1f, %4.0f]\n\r",
+            ecl_invalid, ecl_e[0], ecl_x[0], ecl_e[1], ecl_x[1], ecl_e[2], ecl_x[2]);
+    #endif
+    for(int k = 1; k <= 12000 && ecl_exit < 0; k++){
+        ecl_orbit.update(1.0f);
+        ecl_light = ecl_orbit.getIllumination();
+        ecl_orbit.getPositionVector(ecl_rsat);
+        ecl_orbit.getSunVector(sun_eci);
+        if(ecl_light < 1 && ecl_entry < 0){
+            ecl_entry = k;
+        }
+        if(ecl_light == 1 && ecl_entry >= 0){
+            ecl_exit = k;
+        }
+        ecl_umbra += (ecl_light == 0) ? 1 : 0;
+        ecl_cylinder += (ecl_entry >= 0 && Orbit::cylindricalShadow(ecl_rsat, sun_eci) == 0) ? 1 : 0;
+    }
+    #ifdef MBED_H
+    printf("Eclipse | found %d | predicted [%8.1f, %8.1f] s | stepped [%6.0f, %6.0f] s | umbra %4.0f s | cylinder %4.0f s | %7.1f us per prediction\n\r",
+            ecl_found, ecl_pred_entry, ecl_pred_exit, ecl_entry, ecl_exit, ecl_umbra, ecl_cylinder, (float)time);
+    #endif
+    // Calls that used to hang on the float precision of the time: a 0.01 s step past
+    // 2^18 s on an orbit without eclipse (3e7 evaluations of the shadow), and a crossing
+    // bisected past 2^20 s where the float spacing exceeds the tolerance
+    Orbit ecl_dusk;
+    float ecl_long_e[2], ecl_long_x[2];
+    int ecl_long;
+    ecl_dusk.setJulianDate(JulianDate(year,month,day,hours,minutes,seconds));
+    ecl_dusk.setOrbit(6878000.0f, 0.001f, 100.0f*DEG2RAD, 345.0f*DEG2RAD, 0.0f, 0.0f);
+    #ifdef MBED_H
+    time = t.read_us();
+    #endif
+    ecl_long = ecl_dusk.predictEclipse(&ecl_long_e[0], &ecl_long_x[0], 300000.0f, 0.01f);
+    ecl_long += ecl_orbit.predictEclipse(&ecl_long_e[1], &ecl_long_x[1], 3e6f, 1.2e6f);
+    #ifdef MBED_H
+    time = t.read_us() - time;
+    printf("Eclipse | long searches found %d | fine step [%4.0f, %4.0f] | coarse step [%9.1f, %9.1f] | %7.3f s\n\r",
+            ecl_long, ecl_long_e[0], ecl_long_x[0], ecl_long_e[1], ecl_long_x[1], time * 1e-6f);
+    #endif
+
+    /**************** IGRF ****************/
+    // Error of the IGRF model at the ground station against the reference field of
+    // the ground setting, and cost of an orbit magnetic field vector for several degrees
+    #define IGRF_RUNS 1000
+    int igrf_degree[5] = {1, 4, 6, 8, 13};
+    float ref_ned[3] = {17.3186f, -.6779f, 46.8663f};
+    float sta_ecef[3], mag_ecef[3], mag_ned[3];
+    float lat = 55.86515f*DEG2RAD, lon = -4.25763f*DEG2RAD;
+    float igrf_err;
+    IGRF igrf;
+    Orbit igrf_orbit;
+    Frames igrf_frames;
+    igrf_frames.setLocation(lat, lon);
+    orbit.getPositionVector(sta_ecef);
+    igrf.setJulianDate(orbit.getJulianDate());
+    igrf_orbit.setJulianDate(JulianDate(year,month,day,hours,minutes,seconds));
+    igrf_orbit.setOrbit(6878000.0f, 0.001f, 51.6f*DEG2RAD, 0.0f, 0.0f, 0.0f);
+    for(int i = 0; i < 5; i++){
+        igrf.setDegree(igrf_degree[i]);
+        igrf.getField(mag_ecef, sta_ecef);
+        igrf_frames.ecefToNed(mag_ned, mag_ecef);
+        igrf_err = sqrt((mag_ned[0]-ref_ned[0])*(mag_ned[0]-ref_ned[0]) + (mag_ned[1]-ref_ned[1])*(mag_ned[1]-ref_ned[1])
+                      + (mag_ned[2]-ref_ned[2])*(mag_ned[2]-ref_ned[2]));
+
+        #ifdef ORBIT_USE_IGRF
+        igrf_orbit.setMagDegree(igrf_degree[i]);
+        #endif
+        #ifdef MBED_H
+        time = t.read_us();
+        #endif
+        for(int run = 0; run < IGRF_RUNS; run++){
+            igrf_orbit.update(0.1f);
+            igrf_orbit.getMagVector(mag_eci);
+        }
+        #ifdef MBED_H
+        time = t.read_us() - time;
+        printf("IGRF | degree %2d | NED [%8.4f, %8.4f, %8.4f] uT | error %7.1f nT | %7.3f us per orbit update and vector\n\r",
+                igrf_degree[i], mag_ned[0], mag_ned[1], mag_ned[2], 1000.0f*igrf_err, (float)time/IGRF_RUNS);
+        #endif
+    }
+
+    /************** MAG GRID **************/
+    // 10 deg grid of the degree 13 model between 400 and 600 km, compared with the
+    // model along an orbit (orbit model with the grid against orbit model with IGRF)
+    #define GRID_NLAT 19
+    #define GRID_NLON 36
+    #define GRID_NALT 2
+    static float grid_table[MAG_GRID_HEADER_SIZE + GRID_NLAT * GRID_NLON * GRID_NALT * 3];
+    MagGrid grid;
+    Orbit grid_orbit;
+    float grid_err, grid_err_max = 0;
+    int grid_time = 0, model_time = 0;
+    igrf.setDegree(IGRF_MAX_DEGREE);
+    igrf.setJulianDate(JulianDate(year,month,day,hours,minutes,seconds));
+    int grid_size = MagGrid::sample(grid_table, sizeof(grid_table)/sizeof(float), igrf, GRID_NLAT, GRID_NLON, GRID_NALT, 400000.0f, 600000.0f);
+    grid.load(grid_table, grid_size);
+    grid_orbit.setJulianDate(JulianDate(year,month,day,hours,minutes,seconds));
+    grid_orbit.setOrbit(6878000.0f, 0.001f, 51.6f*DEG2RAD, 0.0f, 0.0f, 0.0f);
+    #ifdef ORBIT_USE_IGRF
+    grid_orbit.setMagDegree(IGRF_MAX_DEGREE);
+    #endif
+    for(int k = 0; k < 6000; k++){
+        grid_orbit.update(1.0f);
+        grid_orbit.setMagGrid(0);
+        #ifdef MBED_H
+        time = t.read_us();
+        #endif
+        grid_orbit.getMagVector(mag_eci);
+        #ifdef MBED_H
+        model_time += t.read_us() - time;
+        #endif
+        grid_orbit.setMagGrid(&grid);
+        #ifdef MBED_H
+        time = t.read_us();
+        #endif
+        grid_orbit.getMagVector(mag_ned);
+        #ifdef MBED_H
+        grid_time += t.read_us() - time;
+        #endif
+        grid_err = sqrt((mag_ned[0]-mag_eci[0])*(mag_ned[0]-mag_eci[0]) + (mag_ned[1]-mag_eci[1])*(mag_ned[1]-mag_eci[1])
+                      + (mag_ned[2]-mag_eci[2])*(mag_ned[2]-mag_eci[2]));
+        grid_err_max = (grid_err > grid_err_max) ? grid_err : grid_err_max;
+    }
+    #ifdef MBED_H
+    printf("Mag grid | %d bytes | model %7.3f us | grid %7.3f us | max error %7.1f nT\n\r",
+            (int)(grid_size * sizeof(float)), model_time/6000.0f, grid_time/6000.0f, 1000.0f*grid_err_max);
+    #endif
+
+    /**************** SGP4 ****************/
+    // Test case of "Revisiting Spacetrack Report #3" (satellite 88888), reference positions in km
+    SGP4 sgp4;
+    float sgp4_ref[3][4] = {{   0, 2328.96975, -5995.22051, 1719.97297},
+                            { 720, 2567.56230, -6112.50384,  713.96366},
+                            {1440, 2742.55480, -6079.67144, -326.38995}};
+    float sgp4_err;
+    sgp4.setTLE("1 88888U          80275.98708465  .00073094  13844-3  66816-4 0     8",
+                "2 88888  72.8435 115.9689 0086731  52.6988 110.5714 16.05824518  1058");
+    for(int i = 0; i < 3; i++){
+        #ifdef MBED_H
+        time = t.read_us();
+        #endif
+        sgp4.propagate(sgp4_ref[i][0]);
+        #ifdef MBED_H
+        time = t.read_us() - time;
+        #endif
+        sgp4.getPositionVector(sat_eci);
+        sgp4_err = 0;
+        for(int k = 0; k < 3; k++){
+            sgp4_err += (sat_eci[k]/1000.0f - sgp4_ref[i][k+1]) * (sat_eci[k]/1000.0f - sgp4_ref[i][k+1]);
+        }
+        #ifdef MBED_H
+        printf("SGP4 | t = %4.0f min | %d us | [% 10.4f, % 10.4f, % 10.4f] km | error %f km | error code %d\n\r", sgp4_ref[i][0],
+                time, sat_eci[0]/1000.0f, sat_eci[1]/1000.0f, sat_eci[2]/1000.0f, sqrt(sgp4_err), sgp4.getError());
+        #endif
+    }
+
+    /************* EPHEMERIS **************/
+    // Fit of a 3 hours window of the SGP4 satellite above (10 minutes segments, order 9),
+    // then comparison with the same propagator stepped in sync and cost of an evaluation
+    #define EPH_SEGMENTS 18
+    #define EPH_ORDER 9
+    #define EPH_STEP 1.0f
+    static float eph_table[EPHEMERIS_HEADER_SIZE + EPH_SEGMENTS * EPHEMERIS_CHANNELS * (EPH_ORDER + 1)];
+    SGP4 eph_orbit;
+    Ephemeris ephemeris;
+    float eph_vec[3];
+    float eph_err[3] = {0, 0, 0};   // Max error on sun (rad), position (m) and magnetic field
+    float eph_mag_max = 0;          // Max magnitude of the magnetic field
+    float err;
+    int eph_model_time = 0, eph_table_time = 0;
+    eph_orbit.setTLE("1 88888U          80275.98708465  .00073094  13844-3  66816-4 0     8",
+                     "2 88888  72.8435 115.9689 0086731  52.6988 110.5714 16.05824518  1058");
+    eph_orbit.setJulianDate(eph_orbit.getEpoch());
+    int eph_size = Ephemeris::fit(eph_table, sizeof(eph_table)/sizeof(float), eph_orbit, EPH_SEGMENTS, 600.0f, EPH_ORDER);
+    ephemeris.load(eph_table, eph_size);
+
+    eph_orbit.setTLE("1 88888U          80275.98708465  .00073094  13844-3  66816-4 0     8",
+                     "2 88888  72.8435 115.9689 0086731  52.6988 110.5714 16.05824518  1058");
+    eph_orbit.setJulianDate(eph_orbit.getEpoch());
+    for(float eph_t = 0; eph_t < EPH_SEGMENTS * 600.0f; eph_t += EPH_STEP){
+        ephemeris.update(EPH_STEP);
+
+        #ifdef MBED_H
+        time = t.read_us();
+        #endif
+        eph_orbit.update(EPH_STEP);
+        eph_orbit.getSunVector(sun_eci);
+        eph_orbit.getPositionVector(sat_eci);
+        eph_orbit.getMagVector(mag_eci);
+        #ifdef MBED_H
+        eph_model_time += t.read_us() - time;
+        time = t.read_us();
+        #endif
+        ephemeris.getSunVector(eph_vec);
+        #ifdef MBED_H
+        eph_table_time += t.read_us() - time;
+        #endif
+        err = sqrt(((eph_vec[0]-sun_eci[0])*(eph_vec[0]-sun_eci[0]) + (eph_vec[1]-sun_eci[1])*(eph_vec[1]-sun_eci[1])
+                  + (eph_vec[2]-sun_eci[2])*(eph_vec[2]-sun_eci[2]))
+                  / (sun_eci[0]*sun_eci[0] + sun_eci[1]*sun_eci[1] + sun_eci[2]*sun_eci[2]));
+        eph_err[0] = (err > eph_err[0]) ? err : eph_err[0];
+
+        #ifdef MBED_H
+        time = t.read_us();
+        #endif
+        ephemeris.getPositionVector(eph_vec);
+        #ifdef MBED_H
+        eph_table_time += t.read_us() - time;
+        #endif
+        err = sqrt((eph_vec[0]-sat_eci[0])*(eph_vec[0]-sat_eci[0]) + (eph_vec[1]-sat_eci[1])*(eph_vec[1]-sat_eci[1])
+                 + (eph_vec[2]-sat_eci[2])*(eph_vec[2]-sat_eci[2]));
+        eph_err[1] = (err > eph_err[1]) ? err : eph_err[1];
+
+        #ifdef MBED_H
+        time = t.read_us();
+        #endif
+        ephemeris.getMagVector(eph_vec);
+        #ifdef MBED_H
+        eph_table_time += t.read_us() - time;
+        #endif
+        err = sqrt((eph_vec[0]-mag_eci[0])*(eph_vec[0]-mag_eci[0]) + (eph_vec[1]-mag_eci[1])*(eph_vec[1]-mag_eci[1])
+                 + (eph_vec[2]-mag_eci[2])*(eph_vec[2]-mag_eci[2]));
+        norm = sqrt(mag_eci[0]*mag_eci[0] + mag_eci[1]*mag_eci[1] + mag_eci[2]*mag_eci[2]);
+        eph_mag_max = (norm > eph_mag_max) ? norm : eph_mag_max;
+        eph_err[2] = (err > eph_err[2]) ? err : eph_err[2];
+    }
+    #ifdef MBED_H
+    printf("Ephemeris | %d bytes | model %7.3f us | table %7.3f us | max error sun %e rad, position %f m, magnetic field %f %%\n\r",
+            (int)(eph_size * sizeof(float)), (float)eph_model_time * EPH_STEP / (EPH_SEGMENTS * 600.0f),
+            (float)eph_table_time * EPH_STEP / (EPH_SEGMENTS * 600.0f), eph_err[0], eph_err[1], 100.0f * eph_err[2] / eph_mag_max);
+    #endif
+
     while(1){
     
     #ifdef MBED_H
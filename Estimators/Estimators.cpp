@@ -23,107 +23,874 @@
  
 #include "Estimators.h"
 
+// Helpers
+    /**
+     * Solves lambda^4 - p2 lambda^2 - p1 lambda + p0 = 0 for its largest root,
+     * starting from the value in lambda (Estimators::QUESTSolver)
+     * Returns the number of iterations
+     */
+    static int maxEigenvalue(float *lambda, float p2, float p1, float p0, float tolerance, int solver, int max_iter){
+        float f, df, ddf, step;
+        float l = *lambda;
+        int iteration = 0;
+
+        if(solver == Estimators::QUEST_ANALYTIC){
+            // With two observations B is singular, hence p1 = 0 and the equation is
+            // quadratic in lambda^2, the largest root is taken
+            float delta = p2 * p2 - 4 * p0;
+            float l2 = 0.5f * (p2 + sqrt((delta > 0) ? delta : 0));
+            if(l2 > 0){
+                l = sqrt(l2);
+            }
+        }
+
+        // Iterative refinement of lambda
+        while(iteration < max_iter){
+            f   = l * l * l * l - p2 * l * l - p1 * l + p0;
+            df  = 4 * l * l * l - 2 * p2 * l - p1;
+            if(solver == Estimators::QUEST_NEWTON){
+                step = f / df;
+            }
+            else{
+                ddf = 12 * l * l - 2 * p2;
+                step = 2 * f * df / (2 * df * df - f * ddf);
+            }
+            if(!(fabs(step) > tolerance)){  // Also stops on NaN
+                break;
+            }
+            l -= step;
+            iteration++;
+        }
+
+        *lambda = l;
+        return iteration;
+    }
+
+    /**
+     * Converts an attitude matrix (ECI to body) to a quaternion [eta, x, y, z] with
+     * the same convention as QuEst, using the largest pivot for numerical stability
+     */
+    static void attitudeToQuaternion(const float A[9], float quat[4]){
+        float tr, q4;
+
+        tr = A[0] + A[4] + A[8];
+        if(tr >= A[0] && tr >= A[4] && tr >= A[8]){
+            q4 = 2 * sqrt(1 + tr);
+            quat[0] = 0.25f * q4;
+            quat[1] = -(A[5] - A[7]) / q4;
+            quat[2] = -(A[6] - A[2]) / q4;
+            quat[3] = -(A[1] - A[3]) / q4;
+        }
+        else if(A[0] >= A[4] && A[0] >= A[8]){
+            q4 = 2 * sqrt(1 + 2*A[0] - tr);
+            quat[0] = (A[5] - A[7]) / q4;
+            quat[1] = -0.25f * q4;
+            quat[2] = -(A[1] + A[3]) / q4;
+            quat[3] = -(A[2] + A[6]) / q4;
+        }
+        else if(A[4] >= A[8]){
+            q4 = 2 * sqrt(1 + 2*A[4] - tr);
+            quat[0] = (A[6] - A[2]) / q4;
+            quat[1] = -(A[1] + A[3]) / q4;
+            quat[2] = -0.25f * q4;
+            quat[3] = -(A[5] + A[7]) / q4;
+        }
+        else{
+            q4 = 2 * sqrt(1 + 2*A[8] - tr);
+            quat[0] = (A[1] - A[3]) / q4;
+            quat[1] = -(A[2] + A[6]) / q4;
+            quat[2] = -(A[5] + A[7]) / q4;
+            quat[3] = -0.25f * q4;
+        }
+        // The attitude matrix is not exactly orthogonal with float precision
+        q4 = sqrt(quat[0]*quat[0] + quat[1]*quat[1] + quat[2]*quat[2] + quat[3]*quat[3]);
+        if(quat[0] < 0){
+            q4 = -q4;
+        }
+        for(int i = 0; i < 4; i++){
+            quat[i] /= q4;
+        }
+    }
+
+    /**
+     * Builds the orthonormal triad [v1, v1 x v2, v1 x (v1 x v2)] (normalized) in the rows of t
+     */
+    static void triad(float t[9], const float v1[3], const float v2[3]){
+        float n;
+
+        n = sqrt(v1[0]*v1[0] + v1[1]*v1[1] + v1[2]*v1[2]);
+        t[0] = v1[0] / n;
+        t[1] = v1[1] / n;
+        t[2] = v1[2] / n;
+
+        t[3] = t[1]*v2[2] - t[2]*v2[1];
+        t[4] = t[2]*v2[0] - t[0]*v2[2];
+        t[5] = t[0]*v2[1] - t[1]*v2[0];
+        n = sqrt(t[3]*t[3] + t[4]*t[4] + t[5]*t[5]);
+        t[3] /= n;
+        t[4] /= n;
+        t[5] /= n;
+
+        t[6] = t[1]*t[5] - t[2]*t[4];
+        t[7] = t[2]*t[3] - t[0]*t[5];
+        t[8] = t[0]*t[4] - t[1]*t[3];
+    }
+
+    /**
+     * Computes the coefficients of the characteristic equation in the form of FOAM
+     * lambda^4 - 2 |B|^2 lambda^2 - 8 det(B) lambda + |B|^4 - 4 |adj(B)|^2 = 0
+     * Also returns the cofactor matrix of B (the transpose of its adjugate)
+     */
+    static void foamCoefficients(const float B[9], float cof[9], float *normB2, float *detB, float *p2, float *p1, float *p0){
+        float normAdj2 = 0;
+
+        cof[0] = B[4]*B[8] - B[5]*B[7];
+        cof[1] = B[5]*B[6] - B[3]*B[8];
+        cof[2] = B[3]*B[7] - B[4]*B[6];
+        cof[3] = B[2]*B[7] - B[1]*B[8];
+        cof[4] = B[0]*B[8] - B[2]*B[6];
+        cof[5] = B[1]*B[6] - B[0]*B[7];
+        cof[6] = B[1]*B[5] - B[2]*B[4];
+        cof[7] = B[2]*B[3] - B[0]*B[5];
+        cof[8] = B[0]*B[4] - B[1]*B[3];
+
+        *normB2 = 0;
+        for(int i = 0; i < 9; i++){
+            *normB2 += B[i] * B[i];
+            normAdj2 += cof[i] * cof[i];
+        }
+        *detB = B[0]*cof[0] + B[1]*cof[1] + B[2]*cof[2];
+
+        *p2 = 2 * (*normB2);
+        *p1 = 8 * (*detB);
+        *p0 = (*normB2) * (*normB2) - 4 * normAdj2;
+    }
+
 void Estimators::QUEST(float quat[4], int N, float **s_eci, float **s_body, float *omega, float tolerance = 1e-5){
-    Matrix q = Matrix::zeros(4,1);
-    Matrix s_a[N];      // ECI frame vector array
-    Matrix s_b[N];      // Body frame vector array
+    float B[9];         // Attitude profile matrix
+    float lambda0;      // A reasonable initial value for lambda is sum of weights
+
+    lambda0 = attitudeProfile(B, N, s_eci, s_body, omega);
+    QUESTCore(quat, B, lambda0, tolerance, QUEST_NEWTON, 10000);
+}
 
-    // Converting arrays to Matrix objects
+int Estimators::QUEST(float quat[4], int N, float **s_eci, float **s_body, float *omega, float tolerance, int solver, int max_iter){
+    float B[9];         // Attitude profile matrix
+    float lambda0;      // A reasonable initial value for lambda is sum of weights
+
+    lambda0 = attitudeProfile(B, N, s_eci, s_body, omega);
+    return QUESTCore(quat, B, lambda0, tolerance, solver, max_iter);
+}
+
+void Estimators::QUEST(Matrix *quat, int N, Matrix *s_eci, Matrix *s_body, float *omega, float tolerance){
+    float B[9] = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+    float lambda0 = 0;
+    float q[4];
+
+    // Normalization of all vectors
     for(int i = 0; i < N; i++){
-        s_a[i] = Matrix(3,1, s_eci[i]);
-        s_b[i] = Matrix(3,1, s_body[i]);
+        s_eci[i] /= s_eci[i].norm();
+        s_body[i] /= s_body[i].norm();
+    }
+
+    // Attitude profile matrix B = sum( w * s_body * s_eci^T )
+    for(int k = 0; k < N; k++){
+        lambda0 += omega[k];
+        for(int i = 0; i < 3; i++){
+            for(int j = 0; j < 3; j++){
+                B[i*3+j] += omega[k] * s_body[k](i+1) * s_eci[k](j+1);
+            }
+        }
     }
 
-    // Running the QUEST algo with matrices as inputs
-    QUEST(&q, N, s_a, s_b, omega, tolerance);
+    QUESTCore(q, B, lambda0, tolerance, QUEST_NEWTON, 10000);
 
-    // Returning the quaternion as an array
-    quat[0] = q(1);
-    quat[1] = q(2);
-    quat[2] = q(3);
-    quat[3] = q(4);
+    // Returning the quaternion
+    (*quat)(1) = q[0];
+    (*quat)(2) = q[1];
+    (*quat)(3) = q[2];
+    (*quat)(4) = q[3];
 }
 
-void Estimators::QUEST(Matrix *quat, int N, Matrix *s_eci, Matrix *s_body, float *omega, float tolerance){
+void Estimators::QUESTBatch(float *quat, int M, int N, const float * const eci[3], const float * const body[3], const float *omega,
+                            float tolerance, int solver, int *iterations){
+    #ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+    #endif
+    for(int m = 0; m < M; m++){
+        float B[9] = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+        float lambda0 = 0;
+        float wk, na, nb;
+        int it;
+
+        // Attitude profile matrix B = sum( w * s_body * s_eci^T )
+        for(int k = m * N; k < (m + 1) * N; k++){
+            na = eci[0][k]*eci[0][k] + eci[1][k]*eci[1][k] + eci[2][k]*eci[2][k];
+            nb = body[0][k]*body[0][k] + body[1][k]*body[1][k] + body[2][k]*body[2][k];
+            wk = omega[k] / sqrt(na * nb);
+            lambda0 += omega[k];
+            for(int i = 0; i < 3; i++){
+                for(int j = 0; j < 3; j++){
+                    B[i*3+j] += wk * body[i][k] * eci[j][k];
+                }
+            }
+        }
+
+        it = QUESTCore(quat + 4 * m, B, lambda0, tolerance, solver);
+        if(iterations){
+            iterations[m] = it;
+        }
+    }
+}
+
+float Estimators::attitudeProfile(float B[9], int N, float **s_eci, float **s_body, const float *omega){
+    float lambda0 = 0;
+    float wk;
+
+    for(int i = 0; i < 9; i++){
+        B[i] = 0;
+    }
+    for(int k = 0; k < N; k++){
+        lambda0 += omega[k];
+        // Normalization of the vectors through the weight
+        wk = omega[k] / sqrt( (s_eci[k][0]*s_eci[k][0] + s_eci[k][1]*s_eci[k][1] + s_eci[k][2]*s_eci[k][2])
+                            * (s_body[k][0]*s_body[k][0] + s_body[k][1]*s_body[k][1] + s_body[k][2]*s_body[k][2]) );
+        for(int i = 0; i < 3; i++){
+            for(int j = 0; j < 3; j++){
+                B[i*3+j] += wk * s_body[k][i] * s_eci[k][j];
+            }
+        }
+    }
+    return lambda0;
+}
+
+int Estimators::QUESTCore(float quat[4], const float B[9], float lambda0, float tolerance, int solver, int max_iter){
     // This algorithm is described in "Spacecraft Dynamics and Control An Introduction"
     // by de Ruiter, Damaren and Forbes, chapter 26
 
     // Variable to store the solution
     float lambda;       // The estimated eigen value of the problem
     float gamma;        // Quaternion's rotation (of the eigen vector)
-    Matrix x;           // Quaternion's vector (of the eigen vector)
-    
+    float x[3];         // Quaternion's vector (of the eigen vector)
+
     // Internal computation variables
-    float lambda0 = 0;  // A reasonable initial value for lambda is sum of weights
-    Matrix k12(3,1);
-    Matrix B(3,3), S(3,3), Id(3,3);
+    float Br[9];        // Attitude profile matrix in the rotated reference frame
+    float k12[3], Sk12[3], SSk12[3];
+    float S[9];
     float k22;
     float a, b, c, d;
     float alpha, beta;
     float detS;
     float trAdjS;
     float normQ;
+    float dchar = 0;    // Derivative of the characteristic equation at lambda
+    float q_best[4] = {0, 0, 0, 0};   // Best conditioned solution [gamma, x] and its norm
+    float norm_best = 0;
+    int axis = -1;      // Axis of the 180 deg rotation of the reference frame (-1 if none)
+    int axis_best = -1;
+    int axis_order[3] = {0, 1, 2};
+    int iteration = 0;
 
-    // Preparation of the Newton optimisation problem to find lambda
-    for(int i = 0; i < N; i++){
-        lambda0 += omega[i];
+    for(int i = 0; i < 9; i++){
+        Br[i] = B[i];
     }
 
-    // Normalization of all vectors
-    for(int i = 0; i < N; i++){
-        s_eci[i] /= s_eci[i].norm();
-        s_body[i] /= s_body[i].norm();
+    // Method of sequential rotations: if the rotation is close to 180 deg, gamma vanishes and
+    // the solution is ill-conditioned, so the problem is solved again in a reference frame
+    // rotated by 180 deg about one of its axes, then the rotation is undone.
+    // The best conditioned of the (at most 4) solutions is kept.
+    for(int pass = 0; pass < 4; pass++){
+        // Computation of the required factors
+        for(int i = 0; i < 3; i++){
+            for(int j = 0; j < 3; j++){
+                S[i*3+j] = Br[i*3+j] + Br[j*3+i];
+            }
+        }
+
+        detS = S[0] * (S[4]*S[8] - S[5]*S[7])
+             - S[1] * (S[3]*S[8] - S[5]*S[6])
+             + S[2] * (S[3]*S[7] - S[4]*S[6]);
+
+        k22 = Br[0] + Br[4] + Br[8];
+
+        k12[0] = Br[5] - Br[7];
+        k12[1] = Br[6] - Br[2];
+        k12[2] = Br[1] - Br[3];
+
+        trAdjS  = S[4]*S[8] - S[7]*S[5]
+                + S[0]*S[8] - S[2]*S[6]
+                + S[0]*S[4] - S[1]*S[3];
+
+        for(int i = 0; i < 3; i++){
+            Sk12[i] = S[i*3]*k12[0] + S[i*3+1]*k12[1] + S[i*3+2]*k12[2];
+        }
+        for(int i = 0; i < 3; i++){
+            SSk12[i] = S[i*3]*Sk12[0] + S[i*3+1]*Sk12[1] + S[i*3+2]*Sk12[2];
+        }
+
+        a = k22 * k22 - trAdjS;
+        b = k22 * k22 + k12[0]*k12[0] + k12[1]*k12[1] + k12[2]*k12[2];
+        c = detS + k12[0]*Sk12[0] + k12[1]*Sk12[1] + k12[2]*Sk12[2];
+        d = k12[0]*SSk12[0] + k12[1]*SSk12[1] + k12[2]*SSk12[2];
+
+        // Characteristic equation lambda^4 - (a + b) lambda^2 - c lambda + (a b + c k22 - d) = 0
+        // (the eigen values do not depend on the reference frame)
+        if(pass == 0){
+            lambda = lambda0;
+            iteration = maxEigenvalue(&lambda, a + b, c, a * b + c * k22 - d, tolerance, solver, max_iter);
+
+            // [x, gamma] is the eigen vector scaled by eta * dchar, so gamma = eta^2 * dchar
+            // (dchar is the product of the differences between lambda and the other eigen values)
+            dchar = 4 * lambda * lambda * lambda - 2 * (a + b) * lambda - c;
+        }
+
+        // Then find the eigen vector associated with the eigen value lambda
+        // x = (alpha * Id + beta * S + S * S) * k12
+        alpha = lambda * lambda - a;
+        beta = lambda - k22;
+        gamma = (lambda + k22) * alpha - detS;
+        for(int i = 0; i < 3; i++){
+            x[i] = alpha * k12[i] + beta * Sk12[i] + SSk12[i];
+        }
+
+        normQ = sqrt(gamma * gamma + x[0]*x[0] + x[1]*x[1] + x[2]*x[2]);
+
+        if(pass == 0 || gamma > q_best[0]){
+            norm_best = normQ;
+            axis_best = axis;
+            q_best[0] = gamma;
+            q_best[1] = x[0];
+            q_best[2] = x[1];
+            q_best[3] = x[2];
+        }
+        if(q_best[0] > QUEST_ROTATION_THRESHOLD * QUEST_ROTATION_THRESHOLD * dchar || pass == 3){
+            break;
+        }
+
+        // The rotation about the largest component of x should give the largest gamma in the
+        // rotated frame, the other axes are tried next
+        if(pass == 0){
+            if(fabs(x[1]) > fabs(x[0]) && fabs(x[1]) >= fabs(x[2])){
+                axis_order[0] = 1;
+                axis_order[1] = 0;
+            }
+            else if(fabs(x[2]) > fabs(x[0]) && fabs(x[2]) > fabs(x[1])){
+                axis_order[0] = 2;
+                axis_order[2] = 0;
+            }
+        }
+        axis = axis_order[pass];
+
+        // Rotating the reference vectors by 180 deg about the axis negates the other two columns of B
+        for(int i = 0; i < 3; i++){
+            for(int j = 0; j < 3; j++){
+                Br[i*3+j] = (j == axis) ? B[i*3+j] : -B[i*3+j];
+            }
+        }
     }
 
-    // Computation of the required factors
-    for(int i = 0; i < N; i++){
-        B += omega[i] * ( s_eci[i] * s_body[i].Transpose() );
+    gamma = q_best[0];
+    x[0] = q_best[1];
+    x[1] = q_best[2];
+    x[2] = q_best[3];
+    normQ = norm_best;
+    axis = axis_best;
+
+    if(axis >= 0){
+        // Undo the rotation of the reference frame: q = q_rotated * [e_axis, 0]
+        float e[3] = {0, 0, 0};
+        float gamma_rot = gamma;
+        e[axis] = 1;
+        gamma = -x[axis];
+        float x_cross_e[3] = {x[1]*e[2] - x[2]*e[1], x[2]*e[0] - x[0]*e[2], x[0]*e[1] - x[1]*e[0]};
+        for(int i = 0; i < 3; i++){
+            x[i] = gamma_rot * e[i] - x_cross_e[i];
+        }
     }
 
-    S = B + B.Transpose();
-    B = B.Transpose();
-    detS = S.det();
+    // Returning the quaternion
+    quat[0] = gamma / normQ;
+    quat[1] = -x[0] / normQ;
+    quat[2] = -x[1] / normQ;
+    quat[3] = -x[2] / normQ;
+
+    return iteration;
+}
 
-    k22 = B.trace();
+int Estimators::ESOQ2(float quat[4], int N, float **s_eci, float **s_body, float *omega, float tolerance, int max_iter){
+    // This algorithm is described in "ESOQ-2 single-point algorithm for fast optimal spacecraft
+    // attitude determination" by Mortari (1997)
+    float B[9];
+    float cof[9];
+    float M[9];
+    float z[3], e[3] = {0, 0, 0}, m[3];
+    float lambda, k22, normB2, detB, p2, p1, p0;
+    float n2, n2_max;
+    float gamma, normQ;
+    int iteration;
 
-    k12(1) = B(2,3) - B(3,2);
-    k12(2) = B(3,1) - B(1,3);
-    k12(3) = B(1,2) - B(2,1);
+    lambda = attitudeProfile(B, N, s_eci, s_body, omega);
 
-    trAdjS  = S(2,2)*S(3,3) - S(3,2)*S(2,3) 
-            + S(1,1)*S(3,3) - S(1,3)*S(3,1) 
-            + S(1,1)*S(2,2) - S(1,2)*S(2,1);
+    // Maximum eigen value from the characteristic equation (closed-form when N = 2)
+    foamCoefficients(B, cof, &normB2, &detB, &p2, &p1, &p0);
+    iteration = maxEigenvalue(&lambda, p2, p1, p0, tolerance, (N == 2) ? QUEST_ANALYTIC : QUEST_HALLEY, max_iter);
 
-    a = k22 * k22 - trAdjS;
-    b = k22 * k22 + Matrix::dot(k12, k12);
-    c = detS + Matrix::dot(k12, S * k12);
-    d = Matrix::dot(k12, S * S * k12);
+    k22 = B[0] + B[4] + B[8];
+    z[0] = B[5] - B[7];
+    z[1] = B[6] - B[2];
+    z[2] = B[1] - B[3];
 
-    // Newton's optimization method to find lambda
-    int iteration = 0;
-    lambda = lambda0;
-    float lambda_prev = 0;
-    while(fabs(lambda-lambda_prev) > tolerance && iteration < 10000){
-        lambda_prev = lambda;
-        lambda -= (lambda*lambda*lambda*lambda - (a + b) * lambda * lambda - c *lambda + (a * b + c * k22 - d)) / (4 * lambda * lambda * lambda - 2 * (a + b) * lambda - c);
-        iteration++;
+    // M = (lambda - k22) * ((lambda + k22) * Id - S) - z * z^T is singular and the rotation axis is its null vector
+    for(int i = 0; i < 3; i++){
+        for(int j = 0; j < 3; j++){
+            M[i*3+j] = (lambda - k22) * (((i == j) ? lambda + k22 : 0) - B[i*3+j] - B[j*3+i]) - z[i] * z[j];
+        }
     }
 
-    // Then find the eigen vector associated with the eigen value lambda
-    Id = Matrix::eye(3);
-
-    alpha = lambda * lambda - a;
-    beta = lambda - k22;
-    gamma = (lambda + k22) * alpha - detS; 
-    x = (alpha * Id + beta * S + S * S) * k12;
+    // The null vector is the largest cross product of two rows of M
+    n2_max = -1;
+    for(int r = 0; r < 3; r++){
+        const float *m1 = M + ((r+1)%3)*3;
+        const float *m2 = M + ((r+2)%3)*3;
+        m[0] = m1[1]*m2[2] - m1[2]*m2[1];
+        m[1] = m1[2]*m2[0] - m1[0]*m2[2];
+        m[2] = m1[0]*m2[1] - m1[1]*m2[0];
+        n2 = m[0]*m[0] + m[1]*m[1] + m[2]*m[2];
+        if(n2 > n2_max){
+            n2_max = n2;
+            e[0] = m[0];
+            e[1] = m[1];
+            e[2] = m[2];
+        }
+    }
+    if(!(n2_max > 0 && n2_max <= FLT_MAX)){
+        // No null vector (rank of M below 2, or NaN and infinite entries)
+        return QUEST(quat, N, s_eci, s_body, omega, tolerance, (N == 2) ? QUEST_ANALYTIC : QUEST_HALLEY, max_iter);
+    }
 
-    normQ = sqrt(gamma * gamma + Matrix::dot(x,x));
-    x *= -1/normQ;
-    gamma /= normQ;
+    // Eigen vector [(lambda - k22) e, z.e] without any division, hence no singularity at 180 deg
+    gamma = z[0]*e[0] + z[1]*e[1] + z[2]*e[2];
+    for(int i = 0; i < 3; i++){
+        e[i] *= (lambda - k22);
+    }
+    normQ = sqrt(gamma * gamma + e[0]*e[0] + e[1]*e[1] + e[2]*e[2]);
+    if(gamma < 0){
+        normQ = -normQ;
+    }
 
     // Returning the quaternion
-    (*quat)(1) = gamma;
-    (*quat)(2) = x(1);
-    (*quat)(3) = x(2);
-    (*quat)(4) = x(3);
-}
\ No newline at end of file
+    quat[0] = gamma / normQ;
+    quat[1] = -e[0] / normQ;
+    quat[2] = -e[1] / normQ;
+    quat[3] = -e[2] / normQ;
+
+    return iteration;
+}
+
+int Estimators::FOAM(float quat[4], int N, float **s_eci, float **s_body, float *omega, float tolerance, int max_iter){
+    // This algorithm is described in "Attitude Determination Using Vector Observations:
+    // A Fast Optimal Matrix Algorithm" by Markley (1993)
+    float B[9];
+    float cof[9];
+    float BBtB[9], BBt[9];
+    float A[9];
+    float lambda, normB2, detB, p2, p1, p0;
+    float kappa, zeta;
+    int iteration;
+
+    lambda = attitudeProfile(B, N, s_eci, s_body, omega);
+
+    // Maximum eigen value from the characteristic equation (closed-form when N = 2)
+    foamCoefficients(B, cof, &normB2, &detB, &p2, &p1, &p0);
+    iteration = maxEigenvalue(&lambda, p2, p1, p0, tolerance, (N == 2) ? QUEST_ANALYTIC : QUEST_HALLEY, max_iter);
+
+    // A = ((kappa + |B|^2) B + lambda adj(B)^T - B B^T B) / zeta
+    kappa = 0.5f * (lambda * lambda - normB2);
+    zeta = kappa * lambda - detB;
+    for(int i = 0; i < 3; i++){
+        for(int j = 0; j < 3; j++){
+            BBt[i*3+j] = B[i*3]*B[j*3] + B[i*3+1]*B[j*3+1] + B[i*3+2]*B[j*3+2];
+        }
+    }
+    for(int i = 0; i < 3; i++){
+        for(int j = 0; j < 3; j++){
+            BBtB[i*3+j] = BBt[i*3]*B[j] + BBt[i*3+1]*B[3+j] + BBt[i*3+2]*B[6+j];
+            A[i*3+j] = ((kappa + normB2) * B[i*3+j] + lambda * cof[i*3+j] - BBtB[i*3+j]) / zeta;
+        }
+    }
+
+    attitudeToQuaternion(A, quat);
+
+    return iteration;
+}
+
+void Estimators::TRIAD(float quat[4], float **s_eci, float **s_body, const float *omega){
+    // TRIAD algorithm as described in "Fundamentals of Spacecraft Attitude Determination
+    // and Control" by Markley and Crassidis, the observation with the largest weight is the anchor
+    int i1 = (omega[1] > omega[0]) ? 1 : 0;
+    int i2 = 1 - i1;
+    float tr[9], tb[9];     // Orthonormal triads of the reference (ECI) and body frames, one vector per row
+    float A[9];
+
+    triad(tr, s_eci[i1], s_eci[i2]);
+    triad(tb, s_body[i1], s_body[i2]);
+
+    // A = sum( t_body * t_eci^T )
+    for(int i = 0; i < 3; i++){
+        for(int j = 0; j < 3; j++){
+            A[i*3+j] = tb[i]*tr[j] + tb[3+i]*tr[3+j] + tb[6+i]*tr[6+j];
+        }
+    }
+
+    attitudeToQuaternion(A, quat);
+}
+
+float Estimators::Davenport(float quat[4], int N, float **s_eci, float **s_body, const float *omega){
+    float B[9];
+    float trB;
+    Matrix K(4,4);
+    Matrix values, vectors;
+    int imax = 1;
+
+    attitudeProfile(B, N, s_eci, s_body, omega);
+    trB = B[0] + B[4] + B[8];
+
+    // Davenport matrix K = [trB, z^T ; z, B + B^T - trB*Id] for the eigen vector [gamma, x]
+    K(1,1) = trB;
+    K(1,2) = B[5] - B[7];
+    K(1,3) = B[6] - B[2];
+    K(1,4) = B[1] - B[3];
+    for(int i = 0; i < 3; i++){
+        for(int j = i; j < 3; j++){
+            K(i+2,j+2) = B[i*3+j] + B[j*3+i] - ((i == j) ? trB : 0);
+        }
+    }
+
+    K.Eigen(&values, &vectors);
+
+    for(int i = 2; i <= 4; i++){
+        if(values(i) > values(imax)){
+            imax = i;
+        }
+    }
+
+    // Same convention as QUEST: [gamma, -x]
+    quat[0] =  vectors(1, imax);
+    quat[1] = -vectors(2, imax);
+    quat[2] = -vectors(3, imax);
+    quat[3] = -vectors(4, imax);
+    if(quat[0] < 0){
+        for(int i = 0; i < 4; i++){
+            quat[i] = -quat[i];
+        }
+    }
+    return values(imax);
+}
+
+void Estimators::QUESTCovariance(float P[9], int N, float **s_body, const float *omega){
+    float F[9] = {0, 0, 0, 0, 0, 0, 0, 0, 0};  // Fisher information matrix
+    float cof[9];
+    float n2, detF, trF;
+
+    // F = sum( w * (Id - b * b^T) )
+    for(int k = 0; k < N; k++){
+        n2 = s_body[k][0]*s_body[k][0] + s_body[k][1]*s_body[k][1] + s_body[k][2]*s_body[k][2];
+        for(int i = 0; i < 3; i++){
+            for(int j = 0; j < 3; j++){
+                F[i*3+j] += omega[k] * (((i == j) ? 1.0f : 0.0f) - s_body[k][i] * s_body[k][j] / n2);
+            }
+        }
+    }
+
+    // P = F^-1 using the cofactors (F is symmetric)
+    cof[0] = F[4]*F[8] - F[5]*F[7];
+    cof[1] = F[5]*F[6] - F[3]*F[8];
+    cof[2] = F[3]*F[7] - F[4]*F[6];
+    cof[4] = F[0]*F[8] - F[2]*F[6];
+    cof[5] = F[1]*F[6] - F[0]*F[7];
+    cof[8] = F[0]*F[4] - F[1]*F[3];
+    cof[3] = cof[1];
+    cof[6] = cof[2];
+    cof[7] = cof[5];
+    detF = F[0]*cof[0] + F[1]*cof[1] + F[2]*cof[2];
+    trF = F[0] + F[4] + F[8];
+
+    if(!(detF > 1e-6f * trF * trF * trF) || detF * QUEST_MAX_VARIANCE < cof[0] || detF * QUEST_MAX_VARIANCE < cof[4] || detF * QUEST_MAX_VARIANCE < cof[8]){
+        // Degenerate geometry, the attitude is unobservable about at least one axis
+        for(int i = 0; i < 9; i++){
+            P[i] = (i % 4 == 0) ? QUEST_MAX_VARIANCE : 0;
+        }
+        return;
+    }
+    for(int i = 0; i < 9; i++){
+        P[i] = cof[i] / detF;
+    }
+}
+
+void Estimators::propagateQuaternion(float quat[4], const float w[3], float dt){
+    // q(k+1) = [cos(|w|dt/2), -sin(|w|dt/2) w/|w|] * q(k): the inverse rotation of the step, multiplied on the left
+    float q[4] = {quat[0], quat[1], quat[2], quat[3]};
+    float rate = sqrt(w[0]*w[0] + w[1]*w[1] + w[2]*w[2]);
+    float c = cos(0.5f * rate * dt);
+    float s = (rate > 1e-9f) ? -sin(0.5f * rate * dt) / rate : -0.5f * dt;
+    float norm;
+
+    quat[0] = c * q[0] + s * (-w[0]*q[1] - w[1]*q[2] - w[2]*q[3]);
+    quat[1] = c * q[1] + s * ( w[0]*q[0] - w[2]*q[2] + w[1]*q[3]);
+    quat[2] = c * q[2] + s * ( w[1]*q[0] + w[2]*q[1] - w[0]*q[3]);
+    quat[3] = c * q[3] + s * ( w[2]*q[0] - w[1]*q[1] + w[0]*q[2]);
+
+    norm = sqrt(quat[0]*quat[0] + quat[1]*quat[1] + quat[2]*quat[2] + quat[3]*quat[3]);
+    for(int i = 0; i < 4; i++){
+        quat[i] /= norm;
+    }
+}
+
+void Estimators::TRIADCovariance(float P[9], float **s_body, const float *omega){
+    // Same anchor as Estimators::TRIAD
+    int i1 = (omega[1] > omega[0]) ? 1 : 0;
+    int i2 = 1 - i1;
+    float b1[3], b2[3], cross[3];
+    float n1, n2, dot, cross2;
+    float var1 = 1.0f / omega[i1];
+    float var2 = 1.0f / omega[i2];
+
+    n1 = sqrt(s_body[i1][0]*s_body[i1][0] + s_body[i1][1]*s_body[i1][1] + s_body[i1][2]*s_body[i1][2]);
+    n2 = sqrt(s_body[i2][0]*s_body[i2][0] + s_body[i2][1]*s_body[i2][1] + s_body[i2][2]*s_body[i2][2]);
+    for(int i = 0; i < 3; i++){
+        b1[i] = s_body[i1][i] / n1;
+        b2[i] = s_body[i2][i] / n2;
+    }
+    cross[0] = b1[1]*b2[2] - b1[2]*b2[1];
+    cross[1] = b1[2]*b2[0] - b1[0]*b2[2];
+    cross[2] = b1[0]*b2[1] - b1[1]*b2[0];
+    cross2 = cross[0]*cross[0] + cross[1]*cross[1] + cross[2]*cross[2];
+    dot = b1[0]*b2[0] + b1[1]*b2[1] + b1[2]*b2[2];
+
+    if(!(cross2 * QUEST_MAX_VARIANCE > var1 + var2)){
+        // Degenerate geometry, the attitude is unobservable about the common direction
+        for(int i = 0; i < 9; i++){
+            P[i] = (i % 4 == 0) ? QUEST_MAX_VARIANCE : 0;
+        }
+        return;
+    }
+    for(int i = 0; i < 3; i++){
+        for(int j = 0; j < 3; j++){
+            P[i*3+j] = ((i == j) ? var1 : 0)
+                     + ((var2 - var1) * b1[i] * b1[j] + var1 * dot * (b1[i] * b2[j] + b2[i] * b1[j])) / cross2;
+        }
+    }
+}
+
+void Estimators::quaternionCovariance(float Pq[16], const float quat[4], const float P[9]){
+    float Xi[12];       // (4x3) Derivative of the quaternion with respect to the rotation vector
+    float XiP[12];
+
+    Xi[0] = -quat[1];   Xi[1]  = -quat[2];  Xi[2]  = -quat[3];
+    Xi[3] =  quat[0];   Xi[4]  =  quat[3];  Xi[5]  = -quat[2];
+    Xi[6] = -quat[3];   Xi[7]  =  quat[0];  Xi[8]  =  quat[1];
+    Xi[9] =  quat[2];   Xi[10] = -quat[1];  Xi[11] =  quat[0];
+
+    for(int i = 0; i < 4; i++){
+        for(int j = 0; j < 3; j++){
+            XiP[i*3+j] = Xi[i*3]*P[j] + Xi[i*3+1]*P[3+j] + Xi[i*3+2]*P[6+j];
+        }
+    }
+    for(int i = 0; i < 4; i++){
+        for(int j = 0; j < 4; j++){
+            Pq[i*4+j] = 0.25f * (XiP[i*3]*Xi[j*3] + XiP[i*3+1]*Xi[j*3+1] + XiP[i*3+2]*Xi[j*3+2]);
+        }
+    }
+}
+
+// ------------------- Recursive QUEST -------------------//
+using namespace Estimators;
+
+// Constructors
+    RecursiveQUEST::RecursiveQUEST(float fading, float tolerance, int solver):
+        _fading(fading),
+        _tolerance(tolerance),
+        _solver(solver){
+        reset();
+    }
+
+// Setters
+    void RecursiveQUEST::reset(){
+        for(int i = 0; i < 9; i++){
+            _B[i] = 0;
+        }
+        _lambda0 = 0;
+    }
+
+    void RecursiveQUEST::setFading(float fading){ _fading = fading; }
+
+// Estimator
+    void RecursiveQUEST::propagate(const float w[3], float dt){
+        float theta = sqrt(w[0]*w[0] + w[1]*w[1] + w[2]*w[2]) * dt;
+        float s, c;
+        float n[3] = {0, 0, 0};
+        float Phi[9];
+        float B[9];
+
+        // Rotation of the body frame: Phi = exp(-[w x] dt) (Rodrigues' formula)
+        if(theta > 0){
+            n[0] = w[0] * dt / theta;
+            n[1] = w[1] * dt / theta;
+            n[2] = w[2] * dt / theta;
+        }
+        s = sin(theta);
+        c = 1 - cos(theta);
+        Phi[0] = 1 - c * (n[1]*n[1] + n[2]*n[2]);
+        Phi[1] =  s * n[2] + c * n[0]*n[1];
+        Phi[2] = -s * n[1] + c * n[0]*n[2];
+        Phi[3] = -s * n[2] + c * n[0]*n[1];
+        Phi[4] = 1 - c * (n[0]*n[0] + n[2]*n[2]);
+        Phi[5] =  s * n[0] + c * n[1]*n[2];
+        Phi[6] =  s * n[1] + c * n[0]*n[2];
+        Phi[7] = -s * n[0] + c * n[1]*n[2];
+        Phi[8] = 1 - c * (n[0]*n[0] + n[1]*n[1]);
+
+        // B = fading * Phi * B
+        for(int i = 0; i < 3; i++){
+            for(int j = 0; j < 3; j++){
+                B[i*3+j] = _fading * (Phi[i*3]*_B[j] + Phi[i*3+1]*_B[3+j] + Phi[i*3+2]*_B[6+j]);
+            }
+        }
+        for(int i = 0; i < 9; i++){
+            _B[i] = B[i];
+        }
+        _lambda0 *= _fading;
+    }
+
+    void RecursiveQUEST::addObservation(const float s_eci[3], const float s_body[3], float omega){
+        float wk = omega / sqrt( (s_eci[0]*s_eci[0] + s_eci[1]*s_eci[1] + s_eci[2]*s_eci[2])
+                               * (s_body[0]*s_body[0] + s_body[1]*s_body[1] + s_body[2]*s_body[2]) );
+        for(int i = 0; i < 3; i++){
+            for(int j = 0; j < 3; j++){
+                _B[i*3+j] += wk * s_body[i] * s_eci[j];
+            }
+        }
+        _lambda0 += omega;
+    }
+
+    int RecursiveQUEST::getQuaternion(float quat[4]) const {
+        return QUESTCore(quat, _B, _lambda0, _tolerance, _solver);
+    }
+
+    float RecursiveQUEST::getWeight() const { return _lambda0; }
+
+// ----------------- Observation Manager -----------------//
+
+// Constructors
+    ObservationManager::ObservationManager(float downweight_angle, float rejection_angle, int max_rejections):
+        _downweight_angle(downweight_angle),
+        _rejection_angle(rejection_angle),
+        _max_rejections(max_rejections){
+        reset();
+    }
+
+// Setters
+    void ObservationManager::reset(){
+        for(int k = 0; k < OBS_MAX_OBSERVATIONS; k++){
+            _residual[k] = 0;
+        }
+        _rejections = 0;
+        _rejected = 0;
+    }
+
+    void ObservationManager::setThresholds(float downweight_angle, float rejection_angle){
+        _downweight_angle = downweight_angle;
+        _rejection_angle = rejection_angle;
+    }
+
+// Screening
+    int ObservationManager::process(float *omega_out, int N, float **s_eci, float **s_body, const float *omega, const float *quat_pred,
+                                    int min_accepted){
+        float A[9];             // Predicted attitude matrix (ECI to body)
+        float p[3];             // Predicted measurement
+        float cross[3];
+        float ratio;
+        int accepted = 0;
+
+        _rejected = 0;
+        for(int k = 0; k < N; k++){
+            omega_out[k] = omega[k];
+        }
+        for(int k = 0; k < OBS_MAX_OBSERVATIONS; k++){
+            _residual[k] = 0;
+        }
+        if(!quat_pred){
+            return N;
+        }
+        if(N > OBS_MAX_OBSERVATIONS){
+            // The extra observations are accepted without screening
+            accepted = N - OBS_MAX_OBSERVATIONS;
+            N = OBS_MAX_OBSERVATIONS;
+        }
+
+        // Same convention as Matrix::quat2rot
+        float qw = quat_pred[0], qx = quat_pred[1], qy = quat_pred[2], qz = quat_pred[3];
+        A[0] = qw*qw + qx*qx - qy*qy - qz*qz;
+        A[4] = qw*qw - qx*qx + qy*qy - qz*qz;
+        A[8] = qw*qw - qx*qx - qy*qy + qz*qz;
+        A[1] = 2 * (qx*qy - qz*qw);
+        A[3] = 2 * (qx*qy + qz*qw);
+        A[2] = 2 * (qx*qz + qy*qw);
+        A[6] = 2 * (qx*qz - qy*qw);
+        A[5] = 2 * (qy*qz - qx*qw);
+        A[7] = 2 * (qy*qz + qx*qw);
+
+        for(int k = 0; k < N; k++){
+            for(int i = 0; i < 3; i++){
+                p[i] = A[i*3]*s_eci[k][0] + A[i*3+1]*s_eci[k][1] + A[i*3+2]*s_eci[k][2];
+            }
+            cross[0] = s_body[k][1]*p[2] - s_body[k][2]*p[1];
+            cross[1] = s_body[k][2]*p[0] - s_body[k][0]*p[2];
+            cross[2] = s_body[k][0]*p[1] - s_body[k][1]*p[0];
+            // atan2 is accurate for both small and large angles and needs no normalization
+            _residual[k] = atan2(sqrt(cross[0]*cross[0] + cross[1]*cross[1] + cross[2]*cross[2]),
+                                 s_body[k][0]*p[0] + s_body[k][1]*p[1] + s_body[k][2]*p[2]);
+
+            if(!(omega_out[k] > 0)){
+                continue;       // Unavailable sensor, neither accepted nor rejected
+            }
+            if(_residual[k] > _rejection_angle){
+                omega_out[k] = 0;
+                _rejected |= 1 << k;
+            }
+            else{
+                if(_residual[k] > _downweight_angle){
+                    ratio = _downweight_angle / _residual[k];
+                    omega_out[k] *= ratio * ratio;
+                }
+                accepted++;
+            }
+        }
+
+        if(_rejected && accepted < min_accepted){
+            // Too few observations left: the prediction or the rejected sensors are wrong
+            _rejections++;
+            if(_rejections >= _max_rejections){
+                // The prediction has disagreed for too long: it is the prediction that is lost
+                for(int k = 0; k < N; k++){
+                    if(omega_out[k] == 0 && omega[k] > 0){
+                        omega_out[k] = omega[k];
+                        accepted++;
+                    }
+                }
+                _rejected = 0;
+                _rejections = 0;
+            }
+        }
+        else{
+            _rejections = 0;
+        }
+        return accepted;
+    }
+
+// Getters
+    float ObservationManager::getResidual(int k) const {
+        return (k >= 0 && k < OBS_MAX_OBSERVATIONS) ? _residual[k] : 0;
+    }
+
+    int ObservationManager::getRejected() const { return _rejected; }
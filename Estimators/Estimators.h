@@ -68,6 +68,9 @@
  * eigenvalue, then calculate the eigenvector. For that, it needs an initial value to converge in
  * the right direction.
  * 
+ * Near 180 deg rotations, where the QuEst eigen vector degenerates, the method of sequential
+ * rotations is used (see Estimators::QUESTCore).
+ * 
  * See _Spacecraft dynamics and control: An introduction_ for the full derivation of the implemented algorithm.
  * 
  * 
@@ -105,6 +108,15 @@
 #ifndef ESTIMATORS_H
 #define ESTIMATORS_H
 #include "Matrix.h"
+#include <cfloat>
+
+#define QUEST_MAX_ITERATIONS 10     ///< Hard cap on the iterations of the eigen value solver
+#define QUEST_ROTATION_THRESHOLD 0.3f   ///< Scalar part of the quaternion below which QuEst uses sequential rotations
+#define QUEST_MAX_VARIANCE 1.0f     ///< Variance (rad^2) returned by the covariance for a degenerate geometry
+#define OBS_MAX_OBSERVATIONS 8      ///< Maximum number of observations handled by the ObservationManager
+#define OBS_DOWNWEIGHT_ANGLE 0.087f ///< Residual angle (rad, 5 deg) above which an observation is down-weighted
+#define OBS_REJECTION_ANGLE 0.35f   ///< Residual angle (rad, 20 deg) above which an observation is rejected
+#define OBS_MAX_REJECTIONS 10       ///< Consecutive steps with too few observations accepted before the prediction is distrusted
 
 /**
  * @brief
@@ -115,6 +127,26 @@
  */
 namespace Estimators{
 
+/**
+ * @ingroup EstimatorsGr
+ * @brief
+ * Solvers for the maximum eigen value of the QuEst algorithm
+ * @details
+ * - QUEST_NEWTON: Newton's method started from the sum of the weights (original implementation)
+ * - QUEST_HALLEY: Halley's method started from the sum of the weights, cubic convergence
+ * - QUEST_ANALYTIC: Closed-form root of the characteristic equation, exact for two observations.
+ *   With two observations B is singular and the quartic reduces to a quadratic in lambda^2.
+ *   With more observations, the root is refined by Halley's method.
+ * 
+ * Whatever the solver, the number of iterations is bounded by the max_iter parameter
+ * of Estimators::QUESTCore so that the worst-case execution time is known.
+ */
+enum QUESTSolver{
+    QUEST_NEWTON = 0,   ///< Newton's method
+    QUEST_HALLEY,       ///< Halley's method
+    QUEST_ANALYTIC      ///< Closed-form solution for two observations, refined by Halley's method otherwise
+};
+
 /**
  * @ingroup EstimatorsGr
  * @brief
@@ -173,5 +205,483 @@ void QUEST(float quat[4], int N, float **s_eci, float **s_body, float *omega, fl
  */
 void QUEST(Matrix *quat, int N, Matrix *s_eci, Matrix *s_body, float *omega, float tolerance);
 
+/**
+ * @ingroup EstimatorsGr
+ * @brief
+ * Return the quaternion estimate from the QuEst Algorithm with a given eigen value solver
+ * @details
+ * Same as the other overloads, but with a choice of the solver used to find the
+ * maximum eigen value and a bounded number of iterations (Estimators::QUESTSolver).
+ * 
+ * @param quat The quaternion to update [eta, x, y, z]
+ * @param N The number of measurements
+ * @param s_eci  A pointer to N 3-element array (the vectors) of the normalized models in the ECI frame [x, y, z]
+ * @param s_body A pointer to N 3-element array (the vectors) of the normalized measurements in the satellite body frame [x, y, z]
+ * @param omega An N-element array containing the weight of each measurement
+ * @param tolerance The tolerance on the eigen value
+ * @param solver The solver to use (Estimators::QUESTSolver)
+ * @param max_iter The maximum number of iterations of the solver
+ * @return The number of iterations used by the solver
+ */
+int QUEST(float quat[4], int N, float **s_eci, float **s_body, float *omega, float tolerance, int solver, int max_iter = QUEST_MAX_ITERATIONS);
+
+/**
+ * @ingroup EstimatorsGr
+ * @brief
+ * Solves M independent QuEst problems from Structure-of-Arrays inputs
+ * @details
+ * Meant for ground-side Monte-Carlo runs where a large number of attitude problems
+ * with the same number of observations are solved. The vectors are given as one
+ * contiguous array per component, the k-th observation of the m-th problem being at
+ * index m * N + k. The problems are solved with Estimators::QUESTCore without any
+ * dynamic allocation.
+ * 
+ * If the code is compiled with OpenMP (-fopenmp), the problems are distributed over
+ * the available threads.
+ * 
+ * @param quat The 4*M-element array where to store the quaternions [eta, x, y, z] of each problem
+ * @param M The number of problems
+ * @param N The number of observations of each problem
+ * @param eci  The 3 component arrays [x, y, z] (M*N elements each) of the models in the ECI frame
+ * @param body The 3 component arrays [x, y, z] (M*N elements each) of the measurements in the satellite body frame
+ * @param omega The M*N-element array of the weights of each observation
+ * @param tolerance The tolerance on the eigen value
+ * @param solver The solver to use (Estimators::QUESTSolver)
+ * @param iterations An optional M-element array where to store the number of iterations of each problem
+ */
+void QUESTBatch(float *quat, int M, int N, const float * const eci[3], const float * const body[3], const float *omega,
+                float tolerance = 1e-5f, int solver = QUEST_HALLEY, int *iterations = 0);
+
+/**
+ * @ingroup EstimatorsGr
+ * @brief
+ * Return the quaternion estimate from the ESOQ2 Algorithm
+ * @details
+ * Algorithm from "ESOQ-2 single-point algorithm for fast optimal spacecraft
+ * attitude determination" by Mortari
+ * 
+ * Same inputs and output as Estimators::QUEST. The maximum eigen value is found as
+ * in QuEst, but the eigen vector is obtained from the null space of a symmetric
+ * (3x3) matrix using cross products, without any division by the scalar part.
+ * Hence, unlike QuEst, the solution does not degrade for rotations close to 180 deg.
+ * When no null vector is found (degenerate or invalid observations), the result of
+ * Estimators::QUEST with its sequential rotations is returned.
+ * 
+ * @param quat The quaternion to update [eta, x, y, z]
+ * @param N The number of measurements
+ * @param s_eci  A pointer to N 3-element array (the vectors) of the models in the ECI frame [x, y, z]
+ * @param s_body A pointer to N 3-element array (the vectors) of the measurements in the satellite body frame [x, y, z]
+ * @param omega An N-element array containing the weight of each measurement
+ * @param tolerance The tolerance on the eigen value
+ * @param max_iter The maximum number of iterations of the eigen value solver
+ * @return The number of iterations used by the solver
+ */
+int ESOQ2(float quat[4], int N, float **s_eci, float **s_body, float *omega, float tolerance = 1e-5f, int max_iter = QUEST_MAX_ITERATIONS);
+
+/**
+ * @ingroup EstimatorsGr
+ * @brief
+ * Return the quaternion estimate from the FOAM Algorithm
+ * @details
+ * Algorithm from "Attitude Determination Using Vector Observations: A Fast Optimal
+ * Matrix Algorithm" by Markley
+ * 
+ * Same inputs and output as Estimators::QUEST. The characteristic equation is built from
+ * the norms and determinant of B and the attitude matrix is computed directly, then
+ * converted to a quaternion.
+ * 
+ * @param quat The quaternion to update [eta, x, y, z]
+ * @param N The number of measurements
+ * @param s_eci  A pointer to N 3-element array (the vectors) of the models in the ECI frame [x, y, z]
+ * @param s_body A pointer to N 3-element array (the vectors) of the measurements in the satellite body frame [x, y, z]
+ * @param omega An N-element array containing the weight of each measurement
+ * @param tolerance The tolerance on the eigen value
+ * @param max_iter The maximum number of iterations of the eigen value solver
+ * @return The number of iterations used by the solver
+ */
+int FOAM(float quat[4], int N, float **s_eci, float **s_body, float *omega, float tolerance = 1e-5f, int max_iter = QUEST_MAX_ITERATIONS);
+
+/**
+ * @ingroup EstimatorsGr
+ * @brief
+ * Return the quaternion estimate from the TRIAD Algorithm using two observations
+ * @details
+ * The TRIAD algorithm builds an orthonormal triad from the two observations in both
+ * frames and the attitude matrix that maps one onto the other. It only needs a few
+ * cross products and no iterative solve, but it is not optimal in the sense of Wahba's
+ * problem: the observation with the largest weight is trusted entirely (it is the anchor)
+ * and only the direction of the other one is used.
+ * 
+ * Same output as Estimators::QUEST.
+ * 
+ * @param quat The quaternion to update [eta, x, y, z]
+ * @param s_eci  A pointer to 2 3-element array (the vectors) of the models in the ECI frame [x, y, z]
+ * @param s_body A pointer to 2 3-element array (the vectors) of the measurements in the satellite body frame [x, y, z]
+ * @param omega A 2-element array containing the weight of each measurement
+ */
+void TRIAD(float quat[4], float **s_eci, float **s_body, const float *omega);
+
+/**
+ * @ingroup EstimatorsGr
+ * @brief
+ * Return the quaternion estimate from Davenport's q-method
+ * @details
+ * The optimal quaternion of Wahba's problem is the eigen vector of the 4x4 Davenport
+ * matrix K associated with its largest eigen value. It is computed here with a full
+ * Jacobi eigen decomposition (Matrix::Eigen) instead of the characteristic equation,
+ * so it is robust to any geometry including 180 deg rotations but far too slow for the
+ * control loop: it is the accuracy reference against which QUEST, ESOQ2, FOAM and TRIAD
+ * are benchmarked.
+ * 
+ * Same inputs and output as Estimators::QUEST.
+ * 
+ * @param quat The quaternion to update [eta, x, y, z]
+ * @param N The number of measurements
+ * @param s_eci  A pointer to N 3-element array (the vectors) of the models in the ECI frame [x, y, z]
+ * @param s_body A pointer to N 3-element array (the vectors) of the measurements in the satellite body frame [x, y, z]
+ * @param omega An N-element array containing the weight of each measurement
+ * @return The largest eigen value of K (the optimal value of the gain function)
+ */
+float Davenport(float quat[4], int N, float **s_eci, float **s_body, const float *omega);
+
+/**
+ * @ingroup EstimatorsGr
+ * @brief
+ * Computes the attitude profile matrix B of the QuEst algorithm from a set of observations
+ * @details
+ * The matrix is computed as
+ * @f$ B = \left(\sum_{k=1}^{N} w_{k} \hat{\mathbf{s}}_{a k} \hat{\mathbf{s}}_{b k}^{T}\right)^T @f$
+ * on plain float arrays, without any dynamic allocation. The vectors do not need to be normalized,
+ * their norm is taken into account in the weights, and they are left untouched.
+ * 
+ * @param B The 9-element array where to store the (3x3) attitude profile matrix (row-major)
+ * @param N The number of measurements
+ * @param s_eci  A pointer to N 3-element array (the vectors) of the models in the ECI frame [x, y, z]
+ * @param s_body A pointer to N 3-element array (the vectors) of the measurements in the satellite body frame [x, y, z]
+ * @param omega An N-element array containing the weight of each measurement
+ * @return The sum of the weights, a reasonable initial value for the eigen value of the problem
+ */
+float attitudeProfile(float B[9], int N, float **s_eci, float **s_body, const float *omega);
+
+/**
+ * @ingroup EstimatorsGr
+ * @brief
+ * Core of the QuEst algorithm on plain float arrays
+ * @details
+ * Solves for the maximum eigen value of the K matrix built from the attitude profile matrix
+ * and computes the associated quaternion using only fixed-size (3x3) arithmetic on the stack.
+ * Both Estimators::QUEST overloads rely on this function.
+ * 
+ * For rotations close to 180 deg, the scalar part of the unnormalized eigen vector vanishes
+ * and the solution is ill-conditioned. When the scalar part of the quaternion is estimated
+ * below QUEST_ROTATION_THRESHOLD, the method of sequential rotations is used: the problem
+ * is solved again in a reference frame rotated by 180 deg about one of its axes (at most
+ * three times) and the rotation is undone on the best conditioned solution.
+ * 
+ * @param quat The quaternion to update [eta, x, y, z]
+ * @param B The (3x3) attitude profile matrix (row-major) from Estimators::attitudeProfile
+ * @param lambda0 The initial value of the eigen value (usually the sum of the weights)
+ * @param tolerance The tolerance on the eigen value
+ * @param solver The solver to use (Estimators::QUESTSolver)
+ * @param max_iter The maximum number of iterations of the solver
+ * @return The number of iterations used by the solver
+ */
+int QUESTCore(float quat[4], const float B[9], float lambda0, float tolerance, int solver = QUEST_NEWTON, int max_iter = QUEST_MAX_ITERATIONS);
+
+/**
+ * @ingroup EstimatorsGr
+ * @brief
+ * Computes the covariance of the attitude error of the QuEst solution
+ * @details
+ * Algorithm from "Three-Axis Attitude Determination from Vector Observations" by
+ * Shuster and Oh
+ * 
+ * For weights chosen as the inverse of the variance of each measurement
+ * (omega = 1 / sigma^2), the covariance of the small rotation error (rad^2) in the
+ * body frame is
+ * 
+ * @f{equation}{
+ *     \mathbf{P}_{\theta\theta} = \left[ \sum_{k=1}^{N} w_{k} \left( \mathbf{1} - \hat{\mathbf{s}}_{b k} \hat{\mathbf{s}}_{b k}^{T} \right) \right]^{-1}
+ * @f}
+ * 
+ * The covariance grows when the observations are close to parallel. When the geometry
+ * is degenerate (all the observations parallel), QUEST_MAX_VARIANCE is returned on the diagonal.
+ * 
+ * @param P The 9-element array where to store the (3x3) covariance (row-major)
+ * @param N The number of measurements
+ * @param s_body A pointer to N 3-element array (the vectors) of the measurements in the satellite body frame [x, y, z]
+ * @param omega An N-element array containing the weight of each measurement (1 / sigma^2)
+ */
+void QUESTCovariance(float P[9], int N, float **s_body, const float *omega);
+
+/**
+ * @ingroup EstimatorsGr
+ * @brief
+ * Propagates a quaternion with the angular rate of the body frame
+ * @details
+ * Exact rotation for a constant rate over the step, in the convention of QUEST (the
+ * attitude matrix maps the ECI frame to the body frame, so that the body vectors of a
+ * fixed direction follow s' = -w x s). Used to predict the attitude between two fixes.
+ * @param quat The quaternion to propagate in place [eta, x, y, z]
+ * @param w The angular rate of the body frame (rad/s)
+ * @param dt The time step (s)
+ */
+void propagateQuaternion(float quat[4], const float w[3], float dt);
+
+/**
+ * @ingroup EstimatorsGr
+ * @brief
+ * Computes the covariance of the attitude error of the TRIAD solution
+ * @details
+ * Algorithm from "Three-Axis Attitude Determination from Vector Observations" by
+ * Shuster and Oh
+ * 
+ * TRIAD trusts the anchor @f$ \hat{\mathbf{b}}_1 @f$ (the observation with the largest
+ * weight, as in Estimators::TRIAD) entirely, so its covariance is larger than the one of
+ * QUEST. With @f$ \sigma_k^2 = 1 / w_k @f$ ,
+ * 
+ * @f{equation}{
+ *     \mathbf{P}_{\theta\theta} = \sigma_1^2 \mathbf{1} + \frac{1}{\left| \hat{\mathbf{b}}_1 \times \hat{\mathbf{b}}_2 \right|^2}
+ *     \left[ \left( \sigma_2^2 - \sigma_1^2 \right) \hat{\mathbf{b}}_1 \hat{\mathbf{b}}_1^T
+ *     + \sigma_1^2 \left( \hat{\mathbf{b}}_1 \cdot \hat{\mathbf{b}}_2 \right) \left( \hat{\mathbf{b}}_1 \hat{\mathbf{b}}_2^T + \hat{\mathbf{b}}_2 \hat{\mathbf{b}}_1^T \right) \right]
+ * @f}
+ * 
+ * For two orthogonal observations of equal weights, the variance about their normal is
+ * twice the one of QUEST. When the geometry is degenerate (parallel observations),
+ * QUEST_MAX_VARIANCE is returned on the diagonal.
+ * 
+ * @param P The 9-element array where to store the (3x3) covariance (row-major)
+ * @param s_body A pointer to 2 3-element array (the vectors) of the measurements in the satellite body frame [x, y, z]
+ * @param omega A 2-element array containing the weight of each measurement (1 / sigma^2)
+ */
+void TRIADCovariance(float P[9], float **s_body, const float *omega);
+
+/**
+ * @ingroup EstimatorsGr
+ * @brief
+ * Maps the covariance of the attitude error to the covariance of the quaternion
+ * @details
+ * For a small rotation error, the quaternion error is half the rotation vector, so that
+ * @f$ \mathbf{P}_{qq} = \frac{1}{4} \Xi(\mathbf{q}) \mathbf{P}_{\theta\theta} \Xi(\mathbf{q})^T @f$ .
+ * The result is singular along the quaternion itself (the norm of the quaternion is not uncertain).
+ * 
+ * @param Pq The 16-element array where to store the (4x4) quaternion covariance (row-major)
+ * @param quat The quaternion [eta, x, y, z]
+ * @param P The (3x3) attitude error covariance (row-major) from Estimators::QUESTCovariance
+ */
+void quaternionCovariance(float Pq[16], const float quat[4], const float P[9]);
+
+/**
+ * @ingroup EstimatorsGr
+ * @brief
+ * Recursive QuEst (REQUEST) estimator that accumulates observations over time
+ * 
+ * @class Estimators::RecursiveQUEST
+ * 
+ * @details
+ * # Description
+ * Algorithm from "REQUEST: A Recursive QUEST Algorithm for Sequential Attitude
+ * Determination" by Bar-Itzhack
+ * 
+ * Instead of solving Wahba's problem from scratch with the observations of the current
+ * cycle, the attitude profile matrix B is kept between cycles. At each gyro step, B is
+ * propagated to the new body frame with the measured angular rate and multiplied by a
+ * fading-memory factor, so that old observations are progressively forgotten:
+ * 
+ * @f{equation}{
+ *     \mathbf{B}_{k+1} = \rho \, \mathbf{\Phi}_k \mathbf{B}_k + \sum_{i} w_{i} \hat{\mathbf{s}}_{b i} \hat{\mathbf{s}}_{a i}^{T}
+ * @f}
+ * 
+ * where @f$ \mathbf{\Phi}_k = \exp\left(-[\omega \times] \Delta t\right) @f$ is the rotation of the body frame
+ * during the step. Observations from sensors with different rates are added whenever they
+ * are available, and the quaternion is solved with Estimators::QUESTCore on demand.
+ * 
+ * # Example code
+ * @code
+ * Estimators::RecursiveQUEST request(0.95f);
+ * while(1){
+ *     request.propagate(gyro, dt);
+ *     if(mag_ready){ request.addObservation(mag_eci, mag_body, 1.0f); }
+ *     if(sun_ready){ request.addObservation(sun_eci, sun_body, 10.0f); }
+ *     request.getQuaternion(quat);
+ * }
+ * @endcode
+ */
+class RecursiveQUEST{
+public:
+// Constructors
+    /**
+     * @brief
+     * Creates a recursive QuEst estimator
+     * @param fading The fading-memory factor applied at each propagation (between 0 and 1)
+     * @param tolerance The tolerance on the eigen value
+     * @param solver The solver to use for the eigen value (Estimators::QUESTSolver)
+     */
+    RecursiveQUEST(float fading = 0.9f, float tolerance = 1e-5f, int solver = QUEST_HALLEY);
+
+// Setters
+    /**
+     * @brief
+     * Forgets all the accumulated observations
+     */
+    void reset();
+
+    /**
+     * @brief
+     * Sets the fading-memory factor
+     * @param fading The fading-memory factor applied at each propagation (between 0 and 1)
+     */
+    void setFading(float fading);
+
+// Estimator
+    /**
+     * @brief
+     * Propagates the accumulated observations to the new body frame and fades them
+     * @param w The angular rate of the body frame (rad/s) [x, y, z]
+     * @param dt The time step (s)
+     */
+    void propagate(const float w[3], float dt);
+
+    /**
+     * @brief
+     * Adds an observation to the accumulated attitude profile matrix
+     * @param s_eci The model of the observation in the ECI frame [x, y, z]
+     * @param s_body The measurement in the satellite body frame [x, y, z]
+     * @param omega The weight of the observation
+     */
+    void addObservation(const float s_eci[3], const float s_body[3], float omega);
+
+    /**
+     * @brief
+     * Solves for the quaternion with the accumulated observations
+     * @param quat The quaternion to update [eta, x, y, z]
+     * @return The number of iterations used by the eigen value solver
+     */
+    int getQuaternion(float quat[4]) const;
+
+    /**
+     * @brief
+     * Gets the accumulated weight of the observations
+     * @return The sum of the faded weights
+     */
+    float getWeight() const;
+
+private:
+    float _B[9];        ///< The accumulated attitude profile matrix (row-major)
+    float _lambda0;     ///< The accumulated weight, initial value of the eigen value
+    float _fading;      ///< The fading-memory factor
+    float _tolerance;   ///< The tolerance on the eigen value
+    int _solver;        ///< The eigen value solver
+}; // class RecursiveQUEST
+
+/**
+ * @ingroup EstimatorsGr
+ * @class Estimators::ObservationManager
+ * 
+ * @details
+ * # Description
+ * Screens the observation pairs before they are fed to QuEst. Each pair is scored by
+ * its residual angle, the angle between the measurement and the model rotated in the
+ * body frame by the predicted attitude (the previous estimate or the propagated state
+ * of the Kalman filter):
+ * 
+ * @f{equation}{
+ *     \theta_k = \angle \left( \hat{\mathbf{s}}_{b k}, \mathbf{A}(\mathbf{q}_{pred}) \hat{\mathbf{s}}_{a k} \right)
+ * @f}
+ * 
+ * - Below the down-weighting angle the weight is kept.
+ * - Between the down-weighting and the rejection angles, the weight is divided by
+ *   @f$ (\theta_k / \theta_{dw})^2 @f$, as if the variance of the sensor grew with the residual.
+ * - Above the rejection angle the weight is set to 0 (the observation is dropped).
+ * 
+ * A sun sensor seeing the Earth albedo or a noisy light source in eclipse is
+ * dropped this way instead of corrupting the attitude and making the Kalman filter
+ * reconverge. If the rejections leave fewer observations than the caller needs
+ * (min_accepted, e.g. 2 for QuEst) for OBS_MAX_REJECTIONS consecutive steps, it is the
+ * prediction that is wrong (lost attitude): the observations are then all accepted again
+ * so that QuEst can reacquire the attitude. The prediction should be propagated with the
+ * gyrometer between the steps (see Estimators::propagateQuaternion), otherwise a rotating
+ * spacecraft is rejected against a frozen attitude until this reacquisition.
+ * 
+ * # Example code
+ * @code
+ * Estimators::ObservationManager manager;
+ * float w[2];
+ * if(manager.process(w, 2, s_eci, s_body, omega, q_pred, 2) >= 2){
+ *     Estimators::QUEST(q, 2, s_eci, s_body, w, 1e-5f, Estimators::QUEST_HALLEY);
+ * }
+ * @endcode
+ */
+class ObservationManager{
+public:
+// Constructors
+    /**
+     * @brief
+     * Creates an observation manager
+     * @param downweight_angle The residual angle (rad) above which the observations are down-weighted
+     * @param rejection_angle The residual angle (rad) above which the observations are rejected
+     * @param max_rejections The number of consecutive steps with too few observations accepted before the prediction is distrusted
+     */
+    ObservationManager(float downweight_angle = OBS_DOWNWEIGHT_ANGLE, float rejection_angle = OBS_REJECTION_ANGLE,
+                       int max_rejections = OBS_MAX_REJECTIONS);
+
+// Setters
+    /**
+     * @brief
+     * Resets the rejection counter and the residuals
+     */
+    void reset();
+
+    /**
+     * @brief
+     * Sets the thresholds on the residual angle
+     * @param downweight_angle The residual angle (rad) above which the observations are down-weighted
+     * @param rejection_angle The residual angle (rad) above which the observations are rejected
+     */
+    void setThresholds(float downweight_angle, float rejection_angle);
+
+// Screening
+    /**
+     * @brief
+     * Scores the observations against the predicted attitude and computes their new weights
+     * @param omega_out An N-element array to fill with the new weights (0 for a rejected observation)
+     * @param N The number of measurements (only the first OBS_MAX_OBSERVATIONS are screened)
+     * @param s_eci  A pointer to N 3-element array (the vectors) of the models in the ECI frame [x, y, z]
+     * @param s_body A pointer to N 3-element array (the vectors) of the measurements in the satellite body frame [x, y, z]
+     * @param omega An N-element array containing the weight of each measurement
+     * @param quat_pred The predicted quaternion [eta, x, y, z] (same convention as QUEST),
+     * or a null pointer when no prediction is available (every observation is then accepted)
+     * @param min_accepted The number of observations the caller needs: a step leaving fewer
+     * because of rejections counts towards the distrust of the prediction
+     * @return The number of accepted observations (non-zero weight)
+     */
+    int process(float *omega_out, int N, float **s_eci, float **s_body, const float *omega, const float *quat_pred,
+                int min_accepted = 1);
+
+// Getters
+    /**
+     * @brief
+     * Gets the residual angle of an observation at the last step
+     * @param k The index of the observation
+     * @return The residual angle (rad), 0 if it was not computed
+     */
+    float getResidual(int k) const;
+
+    /**
+     * @brief
+     * Gets the observations rejected at the last step
+     * @return A bit mask with the bit k set if the observation k was rejected
+     */
+    int getRejected() const;
+
+private:
+    float _residual[OBS_MAX_OBSERVATIONS];  ///< The residual angles of the last step (rad)
+    float _downweight_angle;    ///< The residual angle above which the observations are down-weighted
+    float _rejection_angle;     ///< The residual angle above which the observations are rejected
+    int _max_rejections;        ///< The number of steps with every observation rejected before distrusting the prediction
+    int _rejections;            ///< The current number of consecutive steps with every observation rejected
+    int _rejected;              ///< The bit mask of the observations rejected at the last step
+}; // class ObservationManager
+
 } // namespace Estimators
 #endif // ESTIMATORS_H
\ No newline at end of file
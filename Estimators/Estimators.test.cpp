@@ -28,6 +28,19 @@
 
 #define LOOP_TIME 5                     ///< Time between loops
 
+/**
+ * Angle (deg) of the rotation between two quaternions, computed from the vector part
+ * of the error quaternion, which is accurate for small angles unlike acos(q1.q2)
+ */
+static float quatAngle(const float q1[4], const float q2[4]){
+    float e[3];
+    e[0] = q1[0]*q2[1] - q2[0]*q1[1] - (q1[2]*q2[3] - q1[3]*q2[2]);
+    e[1] = q1[0]*q2[2] - q2[0]*q1[2] - (q1[3]*q2[1] - q1[1]*q2[3]);
+    e[2] = q1[0]*q2[3] - q2[0]*q1[3] - (q1[1]*q2[2] - q1[2]*q2[1]);
+    float sin_half = sqrt(e[0]*e[0] + e[1]*e[1] + e[2]*e[2]);
+    return 2*asin((sin_half>1)?1:sin_half)*RAD2DEG;
+}
+
 int QuestTest(){
     
     int lastUpdate = 0;
@@ -151,6 +164,214 @@ int QuestTest(){
     printf("Angular error Euler\n\r");
     (RAD2DEG*Matrix::quat2euler(q_error)).print();
 
+    /************* SOLVERS ****************/
+    // Bounded eigen value solvers: iterations and loop time for 5 and 2 observations
+    const char *solver_name[3] = {"Newton  ", "Halley  ", "Analytic"};
+    int iterations;
+    for(int solver = Estimators::QUEST_NEWTON; solver <= Estimators::QUEST_ANALYTIC; solver++){
+        for(int n = 5; n >= 2; n -= 3){
+            lastUpdate = t.read_us();
+            iterations = Estimators::QUEST(q, n, sbn, san, om, 1e-5, solver);
+            ellapsed = t.read_us()-lastUpdate;
+            printf("%s | %d obs | %d iterations (max %d) | %d us | q = [%f, %f, %f, %f]\n\r",
+                    solver_name[solver], n, iterations, QUEST_MAX_ITERATIONS, ellapsed, q[0], q[1], q[2], q[3]);
+        }
+    }
+
+    /************ ESTIMATORS **************/
+    // Comparison of the estimators against Davenport's q-method (the accuracy oracle):
+    // timing on the vector sets above averaged over BENCH_RUNS runs, then mean and worst
+    // error over BENCH_TRIALS random attitudes and vector sets with BENCH_NOISE noise
+    #define BENCH_RUNS 1000
+    #define BENCH_TRIALS 500
+    #define BENCH_NOISE 0.01f
+    const char *estimator_name[5] = {"QUEST", "ESOQ2", "FOAM ", "TRIAD", "q-method"};
+    float q_ref[4];
+    float q_est[4];
+    float dot, err;
+    float err_mean, err_max;
+    float rnd_eci[5][3], rnd_body[5][3], rnd_om[5], q_rnd[4];
+    float *rnd_eci_ptr[5] = {rnd_eci[0], rnd_eci[1], rnd_eci[2], rnd_eci[3], rnd_eci[4]};
+    float *rnd_body_ptr[5] = {rnd_body[0], rnd_body[1], rnd_body[2], rnd_body[3], rnd_body[4]};
+    Matrix rot_rnd(3,3);
+    srand(42);
+    for(int n = 5; n >= 2; n -= 3){
+        for(int estimator = 0; estimator < 5; estimator++){
+            if(estimator == 3 && n != 2){
+                continue;   // TRIAD only uses two observations
+            }
+            lastUpdate = t.read_us();
+            for(int run = 0; run < ((estimator == 4) ? BENCH_RUNS/10 : BENCH_RUNS); run++){
+                switch(estimator){
+                    case 0: Estimators::QUEST(q_est, n, sbn, san, om, 1e-5, Estimators::QUEST_HALLEY); break;
+                    case 1: Estimators::ESOQ2(q_est, n, sbn, san, om, 1e-5); break;
+                    case 2: Estimators::FOAM (q_est, n, sbn, san, om, 1e-5); break;
+                    case 3: Estimators::TRIAD(q_est, sbn, san, om); break;
+                    case 4: Estimators::Davenport(q_est, n, sbn, san, om); break;
+                }
+            }
+            ellapsed = t.read_us()-lastUpdate;
+
+            // Random problems, the same for all the estimators
+            srand(42);
+            err_mean = 0;
+            err_max = 0;
+            for(int trial = 0; trial < BENCH_TRIALS; trial++){
+                for(int i = 0; i < 4; i++){
+                    q_rnd[i] = 2.0f*rand()/RAND_MAX - 1.0f;
+                }
+                rot_rnd = Matrix::quat2rot(Matrix(4,1, q_rnd)/Matrix(4,1, q_rnd).norm());
+                for(int k = 0; k < n; k++){
+                    for(int i = 0; i < 3; i++){
+                        rnd_eci[k][i] = 2.0f*rand()/RAND_MAX - 1.0f;
+                    }
+                    for(int i = 0; i < 3; i++){
+                        rnd_body[k][i] = rot_rnd(i+1,1)*rnd_eci[k][0] + rot_rnd(i+1,2)*rnd_eci[k][1] + rot_rnd(i+1,3)*rnd_eci[k][2]
+                                       + BENCH_NOISE*(2.0f*rand()/RAND_MAX - 1.0f);
+                    }
+                    rnd_om[k] = 0.1f + 0.9f*rand()/RAND_MAX;
+                }
+                Estimators::Davenport(q_ref, n, rnd_eci_ptr, rnd_body_ptr, rnd_om);
+                switch(estimator){
+                    case 0: Estimators::QUEST(q_est, n, rnd_eci_ptr, rnd_body_ptr, rnd_om, 1e-5, Estimators::QUEST_HALLEY); break;
+                    case 1: Estimators::ESOQ2(q_est, n, rnd_eci_ptr, rnd_body_ptr, rnd_om, 1e-5); break;
+                    case 2: Estimators::FOAM (q_est, n, rnd_eci_ptr, rnd_body_ptr, rnd_om, 1e-5); break;
+                    case 3: Estimators::TRIAD(q_est, rnd_eci_ptr, rnd_body_ptr, rnd_om); break;
+                    case 4: Estimators::Davenport(q_est, n, rnd_eci_ptr, rnd_body_ptr, rnd_om); break;
+                }
+                err = quatAngle(q_ref, q_est);
+                err_mean += err/BENCH_TRIALS;
+                err_max = (err > err_max) ? err : err_max;
+            }
+            printf("%s | %d obs | %8.3f us | Error to q-method: mean %f deg, max %f deg\n\r",
+                    estimator_name[estimator], n, (float)ellapsed/((estimator == 4) ? BENCH_RUNS/10 : BENCH_RUNS), err_mean, err_max);
+        }
+    }
+
+    /************* COVARIANCE *************/
+    // Attitude error standard deviation expected from the weights and the geometry
+    // The weights are taken as the inverse variances of sensors with standard deviations 'om'
+    float P_att[9];
+    float om_var[5];
+    for(int i = 0; i < 5; i++){
+        om_var[i] = 1.0f/(om[i]*om[i]);
+    }
+    for(int n = 5; n >= 2; n -= 3){
+        Estimators::QUESTCovariance(P_att, n, san, om_var);
+        printf("Covariance | %d obs | sigma = [%f, %f, %f] deg\n\r", n,
+                sqrt(P_att[0])*RAD2DEG, sqrt(P_att[4])*RAD2DEG, sqrt(P_att[8])*RAD2DEG);
+    }
+    Estimators::TRIADCovariance(P_att, san, om_var);
+    printf("Covariance | TRIAD | sigma = [%f, %f, %f] deg\n\r",
+            sqrt(P_att[0])*RAD2DEG, sqrt(P_att[4])*RAD2DEG, sqrt(P_att[8])*RAD2DEG);
+
+    /************ QUEST BATCH *************/
+    // The 5-vector problem replicated BATCH_SIZE times in Structure-of-Arrays
+    #define BATCH_SIZE 20
+    static float eci_soa[3][BATCH_SIZE*5], body_soa[3][BATCH_SIZE*5], om_soa[BATCH_SIZE*5], q_soa[4*BATCH_SIZE];
+    const float *eci_ptr[3] = {eci_soa[0], eci_soa[1], eci_soa[2]};
+    const float *body_ptr[3] = {body_soa[0], body_soa[1], body_soa[2]};
+    for(int m = 0; m < BATCH_SIZE; m++){
+        for(int k = 0; k < 5; k++){
+            for(int i = 0; i < 3; i++){
+                eci_soa[i][m*5+k] = sbn[k][i];
+                body_soa[i][m*5+k] = san[k][i];
+            }
+            om_soa[m*5+k] = om[k];
+        }
+    }
+    Estimators::QUEST(q_ref, 5, sbn, san, om, 1e-5, Estimators::QUEST_HALLEY);
+    lastUpdate = t.read_us();
+    Estimators::QUESTBatch(q_soa, BATCH_SIZE, 5, eci_ptr, body_ptr, om_soa);
+    ellapsed = t.read_us()-lastUpdate;
+    dot = fabs(q_ref[0]*q_soa[4*(BATCH_SIZE-1)] + q_ref[1]*q_soa[4*(BATCH_SIZE-1)+1] + q_ref[2]*q_soa[4*(BATCH_SIZE-1)+2] + q_ref[3]*q_soa[4*(BATCH_SIZE-1)+3]);
+    printf("Batch | %d x 5 obs | %7.3f us per problem | Difference with QUEST %f deg\n\r",
+            BATCH_SIZE, (float)ellapsed/BATCH_SIZE, 2*acos((dot>1)?1:dot)*RAD2DEG);
+
+    /********** RECURSIVE QUEST ***********/
+    // Observations fed one at a time to a static spacecraft without fading should give the batch solution
+    Estimators::RecursiveQUEST request(1.0f, 1e-5, Estimators::QUEST_HALLEY);
+    float w_null[3] = {0, 0, 0};
+    for(int i = 0; i < 5; i++){
+        request.propagate(w_null, 0.1f);
+        request.addObservation(sbn[i], san[i], om[i]);
+    }
+    request.getQuaternion(q_est);
+    dot = fabs(q_ref[0]*q_est[0] + q_ref[1]*q_est[1] + q_ref[2]*q_est[2] + q_ref[3]*q_est[3]);
+    printf("REQUEST | 5 obs | Difference with QUEST %f deg\n\r", 2*acos((dot>1)?1:dot)*RAD2DEG);
+
+    /******** OBSERVATION MANAGER *********/
+    // The last measurement is replaced by a vector 10 deg then 40 deg away (e.g. the Earth albedo
+    // on the sun sensor), the attitude is solved without then with the screening of the observations
+    Estimators::ObservationManager manager;
+    float om_screen[5];
+    float sa_outlier[3];
+    float *san_outlier[5] = {san[0], san[1], san[2], san[3], sa_outlier};
+    int accepted;
+    Estimators::QUEST(q_est, 4, sbn, san, om, 1e-5, Estimators::QUEST_HALLEY);
+    printf("Outlier removed | Difference with QUEST %f deg\n\r", quatAngle(q_ref, q_est));
+    for(int deg = 10; deg <= 40; deg += 30){
+        // Rotation of the measurement about the x axis
+        sa_outlier[0] = san[4][0];
+        sa_outlier[1] = cos(deg*DEG2RAD)*san[4][1] - sin(deg*DEG2RAD)*san[4][2];
+        sa_outlier[2] = sin(deg*DEG2RAD)*san[4][1] + cos(deg*DEG2RAD)*san[4][2];
+        Estimators::QUEST(q_est, 5, sbn, san_outlier, om, 1e-5, Estimators::QUEST_HALLEY);
+        printf("Outlier %2d deg | Without screening | Difference with QUEST %f deg\n\r", deg, quatAngle(q_ref, q_est));
+        accepted = manager.process(om_screen, 5, sbn, san_outlier, om, q_ref);
+        Estimators::QUEST(q_est, 5, sbn, san_outlier, om_screen, 1e-5, Estimators::QUEST_HALLEY);
+        printf("Outlier %2d deg | With screening    | Difference with QUEST %f deg | %d accepted, residual %f deg\n\r",
+                deg, quatAngle(q_ref, q_est), accepted, manager.getResidual(4)*RAD2DEG);
+    }
+
+    // Spacecraft rotating at 30 deg/s about the first measurement (e.g. the magnetic field line) for
+    // 20 s with 2 observations, the second one seeing a 90 deg glint for 0.8 s: a fix needs both,
+    // and the prediction is either the last fix (frozen) or the last fix propagated with the rate
+    // (Estimators::propagateQuaternion)
+    #define ROT_STEPS 200
+    Estimators::ObservationManager rot_manager[3];
+    const char *rot_name[3] = {"frozen, 1 needed", "frozen, 2 needed", "propagated      "};
+    float rot_body[2][3], rot_pred[4], rot_w[3], rot_om[2];
+    float *rot_body_ptr[2] = {rot_body[0], rot_body[1]};
+    float rot_rate = 30*DEG2RAD, rot_dt = 0.1f;
+    float rot_res_max;
+    int rot_fixes;
+    for(int m = 0; m < 3; m++){
+        Estimators::QUEST(rot_pred, 2, sbn, san, om, 1e-5, Estimators::QUEST_HALLEY);
+        rot_fixes = 0;
+        rot_res_max = 0;
+        for(int i = 0; i < 3; i++){
+            rot_w[i] = rot_rate * san[0][i];
+        }
+        for(int k = 1; k <= ROT_STEPS; k++){
+            // Body vectors rotated by -rate*t about the first one (s' = -w x s)
+            float phi = -rot_rate * rot_dt * k;
+            for(int n = 0; n < 2; n++){
+                float *a = san[0], *b = san[n];
+                float ab = a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+                rot_body[n][0] = b[0]*cos(phi) + (a[1]*b[2] - a[2]*b[1])*sin(phi) + a[0]*ab*(1 - cos(phi));
+                rot_body[n][1] = b[1]*cos(phi) + (a[2]*b[0] - a[0]*b[2])*sin(phi) + a[1]*ab*(1 - cos(phi));
+                rot_body[n][2] = b[2]*cos(phi) + (a[0]*b[1] - a[1]*b[0])*sin(phi) + a[2]*ab*(1 - cos(phi));
+            }
+            if(k > 20 && k <= 28){
+                float y = rot_body[1][1], z = rot_body[1][2];
+                rot_body[1][1] = cos(90*DEG2RAD)*y - sin(90*DEG2RAD)*z;
+                rot_body[1][2] = sin(90*DEG2RAD)*y + cos(90*DEG2RAD)*z;
+            }
+            if(m == 2){
+                Estimators::propagateQuaternion(rot_pred, rot_w, rot_dt);
+            }
+            if(rot_manager[m].process(rot_om, 2, sbn, rot_body_ptr, om, rot_pred, (m == 0) ? 1 : 2) >= 2){
+                Estimators::QUEST(rot_pred, 2, sbn, rot_body_ptr, rot_om, 1e-5, Estimators::QUEST_HALLEY);
+                rot_fixes++;
+            }
+            if(k > 28){
+                rot_res_max = (rot_manager[m].getResidual(1) > rot_res_max) ? rot_manager[m].getResidual(1) : rot_res_max;
+            }
+        }
+        printf("Rotation | prediction %s | %3d fixes out of %d steps | max residual after the glint %f deg\n\r",
+                rot_name[m], rot_fixes, ROT_STEPS, rot_res_max*RAD2DEG);
+    }
+
     /************* PRINTS END **************/
 
     seconds+=LOOP_TIME;
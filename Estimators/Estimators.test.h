@@ -18,6 +18,18 @@
  * in order to generate fake measurements. The model-measurement vector pair
  * are then fed to the QuEst algorithm and the output error is computed.
  * 
+ * The estimators (QuEst, ESOQ2, FOAM, TRIAD) are then benchmarked for their
+ * timing and for their error over random vector sets, using Davenport's
+ * q-method as the accuracy reference. Finally, one measurement is corrupted to
+ * check that the ObservationManager drops it.
+ * 
+ * The number of iterations and the loop time of each eigen value solver
+ * (Estimators::QUESTSolver) are then printed, followed by a bench of the
+ * QuEst, ESOQ2 and FOAM estimators on the same vector sets (and TRIAD for
+ * the two-vector set), the expected attitude covariance, and the batch QuEst
+ * over replicated problems. Finally, the recursive QuEst is fed the observations
+ * one at a time and compared to the batch solution.
+ * 
  * @see Estimators.h
  * 
  * # Dependencies and data type
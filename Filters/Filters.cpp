@@ -30,6 +30,193 @@
 
 using namespace Filters;
 
+// ------------------- Process model -------------------//
+    void Filters::stateDerivative(const float x[7], const float I_sat[9], const float I_sat_inv[9], const float h_rw[3], const float torque[3], float xdot[7]){
+        float h[3], m[3];
+
+        // Quaternion kinematics: q' = 0.5 * Omega(w) * q
+        xdot[0] = 0.5f * (-x[4]*x[1] - x[5]*x[2] - x[6]*x[3]);
+        xdot[1] = 0.5f * ( x[4]*x[0] + x[6]*x[2] - x[5]*x[3]);
+        xdot[2] = 0.5f * ( x[5]*x[0] - x[6]*x[1] + x[4]*x[3]);
+        xdot[3] = 0.5f * ( x[6]*x[0] + x[5]*x[1] - x[4]*x[2]);
+
+        // Rigid-body dynamics: w' = I^-1 * (T - w x (I w + h_rw))
+        for(int i = 0; i < 3; i++){
+            h[i] = I_sat[3*i] * x[4] + I_sat[3*i+1] * x[5] + I_sat[3*i+2] * x[6] + h_rw[i];
+        }
+        m[0] = torque[0] - (x[5]*h[2] - x[6]*h[1]);
+        m[1] = torque[1] - (x[6]*h[0] - x[4]*h[2]);
+        m[2] = torque[2] - (x[4]*h[1] - x[5]*h[0]);
+        for(int i = 0; i < 3; i++){
+            xdot[4+i] = I_sat_inv[3*i] * m[0] + I_sat_inv[3*i+1] * m[1] + I_sat_inv[3*i+2] * m[2];
+        }
+    }
+
+    int Filters::cholesky(int n, const float *A, float *L){
+        for(int i = 0; i < n*n; i++){
+            L[i] = 0;
+        }
+        for(int j = 0; j < n; j++){
+            float sum = A[j*n+j];
+            for(int k = 0; k < j; k++){
+                sum -= L[j*n+k] * L[j*n+k];
+            }
+            if(sum <= 0){
+                return 0;
+            }
+            L[j*n+j] = sqrt(sum);
+            for(int i = j+1; i < n; i++){
+                float tmp = A[i*n+j];
+                for(int k = 0; k < j; k++){
+                    tmp -= L[i*n+k] * L[j*n+k];
+                }
+                L[i*n+j] = tmp / L[j*n+j];
+            }
+        }
+        return 1;
+    }
+
+    void Filters::choleskySolve(int n, const float *L, float *b){
+        // Forward substitution L y = b
+        for(int i = 0; i < n; i++){
+            for(int k = 0; k < i; k++){
+                b[i] -= L[i*n+k] * b[k];
+            }
+            b[i] /= L[i*n+i];
+        }
+        // Backward substitution L^T x = y
+        for(int i = n-1; i >= 0; i--){
+            for(int k = i+1; k < n; k++){
+                b[i] -= L[k*n+i] * b[k];
+            }
+            b[i] /= L[i*n+i];
+        }
+    }
+
+    void Filters::stateJacobian(const float x[7], const float I_sat[9], const float I_sat_inv[9], const float h_rw[3], float A[49]){
+        float h[3];     // Total angular momentum I w + h_rw
+        float M[9];     // (I w + h)x - wx I
+
+        for(int i = 0; i < 49; i++){
+            A[i] = 0;
+        }
+
+        // Quaternion rows: 0.5 * [Omega(w), Xi(q)]
+        A[ 1] = -0.5f*x[4]; A[ 2] = -0.5f*x[5]; A[ 3] = -0.5f*x[6];
+        A[ 7] =  0.5f*x[4]; A[ 9] =  0.5f*x[6]; A[10] = -0.5f*x[5];
+        A[14] =  0.5f*x[5]; A[15] = -0.5f*x[6]; A[17] =  0.5f*x[4];
+        A[21] =  0.5f*x[6]; A[22] =  0.5f*x[5]; A[23] = -0.5f*x[4];
+
+        A[ 4] = -0.5f*x[1]; A[ 5] = -0.5f*x[2]; A[ 6] = -0.5f*x[3];
+        A[11] =  0.5f*x[0]; A[12] = -0.5f*x[3]; A[13] =  0.5f*x[2];
+        A[18] =  0.5f*x[3]; A[19] =  0.5f*x[0]; A[20] = -0.5f*x[1];
+        A[25] = -0.5f*x[2]; A[26] =  0.5f*x[1]; A[27] =  0.5f*x[0];
+
+        // Angular rate rows: I^-1 * ( (I w + h)x - wx I )
+        for(int i = 0; i < 3; i++){
+            h[i] = I_sat[3*i] * x[4] + I_sat[3*i+1] * x[5] + I_sat[3*i+2] * x[6] + h_rw[i];
+        }
+        float hx[9] = {    0, -h[2],  h[1],
+                        h[2],     0, -h[0],
+                       -h[1],  h[0],     0};
+        float wx[9] = {    0, -x[6],  x[5],
+                        x[6],     0, -x[4],
+                       -x[5],  x[4],     0};
+        for(int i = 0; i < 3; i++){
+            for(int j = 0; j < 3; j++){
+                M[3*i+j] = hx[3*i+j] - (wx[3*i] * I_sat[j] + wx[3*i+1] * I_sat[3+j] + wx[3*i+2] * I_sat[6+j]);
+            }
+        }
+        for(int i = 0; i < 3; i++){
+            for(int j = 0; j < 3; j++){
+                A[7*(4+i)+4+j] = I_sat_inv[3*i] * M[j] + I_sat_inv[3*i+1] * M[3+j] + I_sat_inv[3*i+2] * M[6+j];
+            }
+        }
+    }
+
+    void Filters::numericJacobian(const float x[7], const float I_sat[9], const float I_sat_inv[9], const float h_rw[3], const float torque[3], float eps, float A[49]){
+        float xp[7], xm[7], fp[7], fm[7];
+        for(int j = 0; j < 7; j++){
+            for(int i = 0; i < 7; i++){
+                xp[i] = x[i];
+                xm[i] = x[i];
+            }
+            xp[j] += eps;
+            xm[j] -= eps;
+            stateDerivative(xp, I_sat, I_sat_inv, h_rw, torque, fp);
+            stateDerivative(xm, I_sat, I_sat_inv, h_rw, torque, fm);
+            for(int i = 0; i < 7; i++){
+                A[7*i+j] = (fp[i] - fm[i]) / (2 * eps);
+            }
+        }
+    }
+
+    float Filters::checkJacobian(const float x[7], const float I_sat[9], const float I_sat_inv[9], const float h_rw[3], const float torque[3], float eps){
+        float analytic[49], numeric[49];
+        float error = 0;
+        stateJacobian(x, I_sat, I_sat_inv, h_rw, analytic);
+        numericJacobian(x, I_sat, I_sat_inv, h_rw, torque, eps, numeric);
+        for(int i = 0; i < 49; i++){
+            error = fmax(error, fabs(analytic[i] - numeric[i]));
+        }
+        return error;
+    }
+
+    void Filters::propagateState(float x[7], float dt, const float I_sat[9], const float I_sat_inv[9], const float h_rw[3], const float torque[3], int integrator){
+        float k1[7], k2[7], k3[7], k4[7], tmp[7];
+        float norm;
+
+        if(integrator == INTEGRATOR_EULER){
+            stateDerivative(x, I_sat, I_sat_inv, h_rw, torque, k1);
+            for(int i = 0; i < 7; i++){
+                x[i] += k1[i] * dt;
+            }
+        } else {
+            // Runge-Kutta 4 (on the angular rates only for the quaternion exponential)
+            float q_prev[4] = {x[0], x[1], x[2], x[3]};
+            float w_prev[3] = {x[4], x[5], x[6]};
+            stateDerivative(x, I_sat, I_sat_inv, h_rw, torque, k1);
+            for(int i = 0; i < 7; i++){ tmp[i] = x[i] + 0.5f * dt * k1[i]; }
+            stateDerivative(tmp, I_sat, I_sat_inv, h_rw, torque, k2);
+            for(int i = 0; i < 7; i++){ tmp[i] = x[i] + 0.5f * dt * k2[i]; }
+            stateDerivative(tmp, I_sat, I_sat_inv, h_rw, torque, k3);
+            for(int i = 0; i < 7; i++){ tmp[i] = x[i] + dt * k3[i]; }
+            stateDerivative(tmp, I_sat, I_sat_inv, h_rw, torque, k4);
+            for(int i = 0; i < 7; i++){
+                x[i] += dt / 6.0f * (k1[i] + 2.0f * k2[i] + 2.0f * k3[i] + k4[i]);
+            }
+
+            if(integrator == INTEGRATOR_QUATEXP){
+                // Rotation vector over the step: Simpson integral of the rate (cubic Hermite
+                // interpolation from the Runge-Kutta derivatives) plus the coning term of the
+                // non-commuting rotations, dt^2/12 (w(k) x w(k+1)), for a fourth order update
+                float *w = w_prev;
+                float th[3];
+                for(int i = 0; i < 3; i++){
+                    th[i] = 0.5f * dt * (w[i] + x[4+i]) + dt * dt / 12.0f * (k1[4+i] - k4[4+i]);
+                }
+                th[0] += dt * dt / 12.0f * (w[1] * x[6] - w[2] * x[5]);
+                th[1] += dt * dt / 12.0f * (w[2] * x[4] - w[0] * x[6]);
+                th[2] += dt * dt / 12.0f * (w[0] * x[5] - w[1] * x[4]);
+
+                // q(k+1) = [cos(|th|/2) 1 + sin(|th|/2)/|th| Omega(th)] q(k)
+                float angle = sqrt(th[0]*th[0] + th[1]*th[1] + th[2]*th[2]);
+                float c = cos(0.5f * angle);
+                float s = (angle > 1e-9f) ? sin(0.5f * angle) / angle : 0.5f;
+                float *q = q_prev;
+                x[0] = c * q[0] + s * (-th[0]*q[1] - th[1]*q[2] - th[2]*q[3]);
+                x[1] = c * q[1] + s * ( th[0]*q[0] + th[2]*q[2] - th[1]*q[3]);
+                x[2] = c * q[2] + s * ( th[1]*q[0] - th[2]*q[1] + th[0]*q[3]);
+                x[3] = c * q[3] + s * ( th[2]*q[0] + th[1]*q[1] - th[0]*q[2]);
+            }
+        }
+
+        norm = sqrt(x[0]*x[0] + x[1]*x[1] + x[2]*x[2] + x[3]*x[3]);
+        for(int i = 0; i < 4; i++){
+            x[i] /= norm;
+        }
+    }
+
 // Constructors
     KalmanFilter::KalmanFilter(){
         I_sat = Matrix::zeros(3, 3);
@@ -42,6 +229,18 @@ using namespace Filters;
 
         _kalman_q = Matrix::zeros(7, 7);
         _kalman_r = Matrix::zeros(7, 7);
+
+        x_propagate = Matrix::zeros(7, 1);
+        p_propagate = Matrix::zeros(7, 7);
+        f_transition = Matrix::eye(7);
+
+        _gain = Matrix::zeros(7, 7);
+        _steady_tol = 0;
+        _steady_steps = 0;
+        _steady_count = 0;
+        _steady = 0;
+        _scheduled = 0;
+        _integrator = INTEGRATOR_EULER;
     }
 
     KalmanFilter::KalmanFilter(Matrix I_sat_init, Matrix I_wheel_init, Matrix p_init, Matrix kalman_q, Matrix kalman_r, Matrix q_init, Matrix w_init){
@@ -58,6 +257,18 @@ using namespace Filters;
 
         q_predict = q_init;
         w_predict = w_init;
+
+        x_propagate = Matrix::zeros(7, 1);
+        p_propagate = Matrix::zeros(7, 7);
+        f_transition = Matrix::eye(7);
+
+        _gain = Matrix::zeros(7, 7);
+        _steady_tol = 0;
+        _steady_steps = 0;
+        _steady_count = 0;
+        _steady = 0;
+        _scheduled = 0;
+        _integrator = INTEGRATOR_EULER;
     }
 
     KalmanFilter::~KalmanFilter(void){}
@@ -66,6 +277,78 @@ using namespace Filters;
     Matrix KalmanFilter::getQuaternion()  const {return q_predict;}
     Matrix KalmanFilter::getAngularRate() const {return w_predict;}
     Matrix KalmanFilter::getCovariance()  const {return p_predict;}
+    Matrix KalmanFilter::getGain()        const {return _gain;}
+    Matrix KalmanFilter::getPropagatedState()      const {return x_propagate;}
+    Matrix KalmanFilter::getPropagatedCovariance() const {return p_propagate;}
+    Matrix KalmanFilter::getTransition()           const {return f_transition;}
+
+// Steady-state mode
+    void KalmanFilter::setSteadyState(float tolerance, int steps){
+        _steady_tol = tolerance;
+        _steady_steps = (steps < 1) ? 1 : steps;
+        resetSteadyState();
+    }
+
+    int KalmanFilter::setGainSchedule(int n, const float *rates, const Matrix *gains){
+        if(n < 0 || n == 1){
+            // A single entry would only apply at exactly its rate
+            return 0;
+        }
+        _sched_rates.resize(n);
+        _sched_gains.resize(n);
+        for(int i = 0; i < n; i++){
+            _sched_rates[i] = rates[i];
+            _sched_gains[i] = gains[i];
+        }
+        return 1;
+    }
+
+    void KalmanFilter::resetSteadyState(){
+        _steady = 0;
+        _steady_count = 0;
+    }
+
+    int KalmanFilter::isSteadyState() const {
+        return steadyGain(w_predict, 0) ? 1 : 0;
+    }
+
+    void KalmanFilter::setIntegrator(int integrator){
+        _integrator = integrator;
+    }
+
+// Measurement noise
+    void KalmanFilter::setMeasurementNoise(Matrix kalman_r){
+        if(_steady){
+            // The frozen gain was computed with the previous noise
+            float change = 0;
+            float scale = 0;
+            for(int i = 1; i <= 7; i++){
+                for(int j = 1; j <= 7; j++){
+                    change = fmax(change, fabs(kalman_r(i,j) - _kalman_r(i,j)));
+                    scale  = fmax(scale,  fabs(_kalman_r(i,j)));
+                }
+            }
+            if(change > KALMAN_NOISE_TOLERANCE * scale){
+                resetSteadyState();
+            }
+        }
+        _kalman_r = kalman_r;
+    }
+
+    Matrix KalmanFilter::getMeasurementNoise() const {return _kalman_r;}
+
+    float KalmanFilter::checkJacobian(Matrix w_rw, Matrix T_bf, Matrix T_rw, float eps) const {
+        float x[7] = { q_predict(1), q_predict(2), q_predict(3), q_predict(4),
+                       w_predict(1), w_predict(2), w_predict(3) };
+        float I_coef[9], I_inv_coef[9], h_coef[3], T_coef[3];
+        I_sat.getCoef(I_coef);
+        I_sat_inv.getCoef(I_inv_coef);
+        (I_wheel * w_rw).getCoef(h_coef);
+        for(int i = 0; i < 3; i++){
+            T_coef[i] = T_bf(i+1) - T_rw(i+1);
+        }
+        return Filters::checkJacobian(x, I_coef, I_inv_coef, h_coef, T_coef, eps);
+    }
 
 // Filters
     Matrix KalmanFilter::filter(Matrix q_measured, Matrix w_measured, float dt, Matrix w_rw_prev, Matrix T_bf_prev, Matrix T_rw_prev){
@@ -73,57 +356,51 @@ using namespace Filters;
         Matrix q_predict_prev = Matrix(q_predict);
         Matrix w_predict_prev = Matrix(w_predict);
         Matrix p_predict_prev = Matrix(p_predict);
+        Matrix kalman;
 
-        // (1) Propagate the covariance
-        Matrix h_rw_prev   = I_wheel * w_rw_prev;
-        float f56 = (1/I_sat(1,1))*(-I_sat(2,2)*w_predict_prev(3)+I_sat(3,3)*w_predict_prev(3) - h_rw_prev(3));
-        float f57 = (1/I_sat(1,1))*(-I_sat(2,2)*w_predict_prev(2)+I_sat(3,3)*w_predict_prev(2) + h_rw_prev(2));
-        float f65 = (1/I_sat(2,2))*(-I_sat(3,3)*w_predict_prev(3)+I_sat(1,1)*w_predict_prev(3) + h_rw_prev(3));
-        float f67 = (1/I_sat(2,2))*(-I_sat(3,3)*w_predict_prev(1)+I_sat(1,1)*w_predict_prev(1) - h_rw_prev(1));
-        float f75 = (1/I_sat(3,3))*(-I_sat(1,1)*w_predict_prev(2)+I_sat(2,2)*w_predict_prev(2) - h_rw_prev(2));
-        float f76 = (1/I_sat(3,3))*(-I_sat(1,1)*w_predict_prev(1)+I_sat(2,2)*w_predict_prev(1) + h_rw_prev(1));
-        
-        float f_coef[49] = {0                   ,-w_predict_prev(1) ,-w_predict_prev(2) ,-w_predict_prev(3) ,-q_predict_prev(2) ,-q_predict_prev(3) ,-q_predict_prev(4) ,
-                            w_predict_prev(1)   ,0                  ,w_predict_prev(3)  ,-w_predict_prev(2) ,q_predict_prev(1)  ,-q_predict_prev(4) ,q_predict_prev(3)  ,
-                            w_predict_prev(2)   ,-w_predict_prev(3) ,0,w_predict_prev(1),q_predict_prev(4)  ,q_predict_prev(4)  ,-q_predict_prev(2) ,
-                            w_predict_prev(2)   ,w_predict_prev(3)  ,w_predict_prev(1)  ,0,q_predict_prev(3),q_predict_prev(2)  ,q_predict_prev(1)  ,
-                            0                   ,0                  ,0                  ,0                  ,0                  ,f56                ,f57                ,
-                            0                   ,0                  ,0                  ,0                  ,f65                ,0                  ,f67                ,
-                            0                   ,0                  ,0                  ,0                  ,f75                ,f76                ,0                  };
-        Matrix f(7,7, f_coef);
-        
-        f *= dt;
-        Matrix p_propagate = (Matrix::eye(7) + f) * p_predict_prev * (Matrix::eye(7) + f).Transpose() + _kalman_q;
-        
-        // (2) Predict the state ahead
-        float temp_coef[16] = { 0                   ,-w_predict_prev(1) ,-w_predict_prev(2) ,-w_predict_prev(3) ,
-                                w_predict_prev(1)   ,0                  ,w_predict_prev(3)  ,-w_predict_prev(2) ,
-                                w_predict_prev(2)   ,-w_predict_prev(3) ,0                  , w_predict_prev(1) ,
-                                w_predict_prev(3)   ,w_predict_prev(2)  ,-w_predict_prev(1) , 0                 };
-                                
-        Matrix tmp(4,4, temp_coef);
+        // Once in steady state, the gain is known and the covariance is not propagated
+        int steady = steadyGain(w_predict_prev, &kalman);
+        if(!steady && _scheduled){
+            // Leaving the gain schedule: the covariance was not propagated meanwhile, the one
+            // consistent with the last scheduled gain K = P (P + R)^-1 is (I - K) P = K R
+            p_predict = _gain * _kalman_r;
+            p_predict_prev = p_predict;
+        }
+        _scheduled = (steady == 2);
 
-        Matrix q_propagate = q_predict_prev + (0.5 * tmp * q_predict_prev) * dt;     
+        // Raw copies of the model inputs at step k-1
+        Matrix h_rw_prev   = I_wheel * w_rw_prev;
+        float x_coef[7] = { q_predict_prev(1), q_predict_prev(2), q_predict_prev(3), q_predict_prev(4),
+                            w_predict_prev(1), w_predict_prev(2), w_predict_prev(3) };
+        float I_coef[9], I_inv_coef[9], h_coef[3], T_coef[3];
+        I_sat.getCoef(I_coef);
+        I_sat_inv.getCoef(I_inv_coef);
+        h_rw_prev.getCoef(h_coef);
+        for(int i = 0; i < 3; i++){
+            T_coef[i] = T_bf_prev(i+1) - T_rw_prev(i+1);
+        }
 
-        q_propagate = q_propagate * (1 / q_propagate.norm());
-                        
-        Matrix w_x_hr = Matrix::cross(w_predict_prev, h_rw_prev);
+        // (1) Propagate the covariance
+        if(!steady){
+            float f_coef[49];
+            stateJacobian(x_coef, I_coef, I_inv_coef, h_coef, f_coef);
+            Matrix f(7,7, f_coef);
 
-        Matrix w_x_Iw = Matrix::cross(w_predict_prev,I_sat * w_predict_prev);   // cross product of satellite angular velocity in bf [rad/s], and the product of the satellite inertia [kgm2] and the satellite angular velocity in bf [rad/s].                              
+            f *= dt;
+            f_transition = Matrix::eye(7) + f;
+            p_propagate = f_transition * p_predict_prev * f_transition.Transpose() + _kalman_q;
+        }
 
-        Matrix w_propagate = w_predict_prev + (I_sat_inv * (T_bf_prev - w_x_Iw - w_x_hr - T_rw_prev)) * dt; // state propagated to next time step using the satellite dynamics model.
+        // (2) Predict the state ahead
+        propagateState(x_coef, dt, I_coef, I_inv_coef, h_coef, T_coef, _integrator); // state propagated to next time step using the satellite dynamics model.
 
-        Matrix x_propagate(7,1);
-        x_propagate(1) = q_propagate(1);
-        x_propagate(2) = q_propagate(2);
-        x_propagate(3) = q_propagate(3);
-        x_propagate(4) = q_propagate(4);
-        x_propagate(5) = w_propagate(1);
-        x_propagate(6) = w_propagate(2);
-        x_propagate(7) = w_propagate(3);
+        x_propagate = Matrix(7,1, x_coef);
 
         // (3) Calculate the Kalman Gain
-        Matrix kalman = p_propagate * ( p_propagate + _kalman_r ).TaylorInv(3);
+        if(!steady){
+            kalman = p_propagate * ( p_propagate + _kalman_r ).TaylorInv(3);
+        }
+        _gain = kalman;
     
         // (5) Update the state
         Matrix z(7,1);
@@ -147,12 +424,442 @@ using namespace Filters;
         w_predict(2) = x_predict(6);
         w_predict(3) = x_predict(7);
 
-        // Renormalize vectors
+        // Renormalize the quaternion
         q_predict /= q_predict.norm();
-        w_predict /= w_predict.norm();
 
         // (6) Precict the next covariance
-        p_predict = ( Matrix::eye(7) - kalman ) * p_propagate;
+        if(!steady){
+            p_predict = ( Matrix::eye(7) - kalman ) * p_propagate;
+
+            // (7) Detect the convergence of the covariance to freeze the gain
+            if(_steady_tol > 0){
+                float change = 0;
+                float scale = 0;
+                for(int i = 1; i <= 7; i++){
+                    for(int j = 1; j <= 7; j++){
+                        change = fmax(change, fabs(p_predict(i,j) - p_predict_prev(i,j)));
+                        scale  = fmax(scale,  fabs(p_predict(i,j)));
+                    }
+                }
+                _steady_count = (change <= _steady_tol * scale) ? _steady_count + 1 : 0;
+                _steady = (_steady_count >= _steady_steps) ? 1 : 0;
+            }
+        }
 
         return q_predict;
-    }
\ No newline at end of file
+    }
+
+// Private methods
+    int KalmanFilter::steadyGain(const Matrix& w, Matrix *gain) const {
+        int n = _sched_rates.size();
+        if(n > 0){
+            // Gain schedule: linear interpolation on the norm of the angular rate
+            float rate = w.norm();
+            if(rate < _sched_rates[0] || rate > _sched_rates[n-1]){
+                return 0;
+            }
+            int i = 0;
+            while(i < n-2 && rate > _sched_rates[i+1]){
+                i++;
+            }
+            if(gain != 0){
+                if(_sched_rates[i+1] == _sched_rates[i]){
+                    *gain = _sched_gains[i];
+                } else {
+                    float t = (rate - _sched_rates[i]) / (_sched_rates[i+1] - _sched_rates[i]);
+                    *gain = (1 - t) * _sched_gains[i] + t * _sched_gains[i+1];
+                }
+            }
+            return 2;
+        }
+        if(_steady){
+            // Frozen gain
+            if(gain != 0){
+                *gain = _gain;
+            }
+            return 1;
+        }
+        return 0;
+    }
+
+// ------------------- Unscented Kalman Filter -------------------//
+// Constructors
+    UnscentedKalmanFilter::UnscentedKalmanFilter(){
+        for(int i = 0; i < 9; i++){
+            _I_sat[i] = 0;
+            _I_sat_inv[i] = 0;
+            _I_wheel[i] = 0;
+        }
+        for(int i = 0; i < UKF_NSTATE; i++){
+            _x[i] = 0;
+        }
+        for(int i = 0; i < UKF_NSTATE*UKF_NSTATE; i++){
+            _p[i] = 0;
+            _kalman_q[i] = 0;
+            _kalman_r[i] = 0;
+        }
+        setSpread(1.0f, 2.0f, 0.0f);
+        _integrator = INTEGRATOR_EULER;
+    }
+
+    UnscentedKalmanFilter::UnscentedKalmanFilter(Matrix I_sat_init, Matrix I_wheel_init, Matrix p_init, Matrix kalman_q, Matrix kalman_r, Matrix q_init, Matrix w_init){
+        I_sat_init.getCoef(_I_sat);
+        I_sat_init.Inv().getCoef(_I_sat_inv);
+        I_wheel_init.getCoef(_I_wheel);
+
+        p_init.getCoef(_p);
+        kalman_q.getCoef(_kalman_q);
+        kalman_r.getCoef(_kalman_r);
+
+        for(int i = 0; i < 4; i++){
+            _x[i] = q_init(i+1);
+        }
+        for(int i = 0; i < 3; i++){
+            _x[4+i] = w_init(i+1);
+        }
+        setSpread(1.0f, 2.0f, 0.0f);
+        _integrator = INTEGRATOR_EULER;
+    }
+
+    UnscentedKalmanFilter::~UnscentedKalmanFilter(void){}
+
+// Getters and Setters
+    Matrix UnscentedKalmanFilter::getQuaternion() const {
+        return Matrix(4, 1, (float*)_x);
+    }
+
+    Matrix UnscentedKalmanFilter::getAngularRate() const {
+        return Matrix(3, 1, (float*)(_x+4));
+    }
+
+    Matrix UnscentedKalmanFilter::getCovariance() const {
+        return Matrix(UKF_NSTATE, UKF_NSTATE, (float*)_p);
+    }
+
+    void UnscentedKalmanFilter::setSpread(float alpha, float beta, float kappa){
+        _lambda = alpha * alpha * (UKF_NSTATE + kappa) - UKF_NSTATE;
+        _wm[0] = _lambda / (UKF_NSTATE + _lambda);
+        _wc[0] = _wm[0] + (1 - alpha * alpha + beta);
+        for(int j = 1; j < UKF_NSIGMA; j++){
+            _wm[j] = 0.5f / (UKF_NSTATE + _lambda);
+            _wc[j] = _wm[j];
+        }
+    }
+
+    void UnscentedKalmanFilter::setIntegrator(int integrator){
+        _integrator = integrator;
+    }
+
+// Measurement noise
+    void UnscentedKalmanFilter::setMeasurementNoise(Matrix kalman_r){
+        kalman_r.getCoef(_kalman_r);
+    }
+
+    Matrix UnscentedKalmanFilter::getMeasurementNoise() const {return Matrix(UKF_NSTATE, UKF_NSTATE, (float*)_kalman_r);}
+
+// Filters
+    Matrix UnscentedKalmanFilter::filter(Matrix q_measured, Matrix w_measured, float dt, Matrix w_rw_prev, Matrix T_bf_prev, Matrix T_rw_prev){
+        const int n = UKF_NSTATE;
+        float h_rw[3], torque[3];
+        float z[UKF_NSTATE];
+        float gain[UKF_NSTATE*UKF_NSTATE];
+        float dx[UKF_NSTATE];
+        float norm;
+
+        // (0) Reaction wheels momentum and net torque at step k-1
+        for(int i = 0; i < 3; i++){
+            h_rw[i] = _I_wheel[3*i] * w_rw_prev(1) + _I_wheel[3*i+1] * w_rw_prev(2) + _I_wheel[3*i+2] * w_rw_prev(3);
+            torque[i] = T_bf_prev(i+1) - T_rw_prev(i+1);
+        }
+
+        // (1) Draw the sigma points and propagate them through the model
+        generateSigmaPoints();
+        propagateSigmaPoints(dt, h_rw, torque);
+
+        // (2) Predict the state ahead as the weighted mean of the sigma points
+        for(int i = 0; i < n; i++){
+            _x[i] = 0;
+            for(int j = 0; j < UKF_NSIGMA; j++){
+                _x[i] += _wm[j] * _chi[j][i];
+            }
+        }
+        norm = sqrt(_x[0]*_x[0] + _x[1]*_x[1] + _x[2]*_x[2] + _x[3]*_x[3]);
+        for(int i = 0; i < 4; i++){
+            _x[i] /= norm;
+        }
+
+        // (3) Propagate the covariance as the weighted spread of the sigma points
+        for(int i = 0; i < n*n; i++){
+            _p[i] = _kalman_q[i];
+        }
+        for(int j = 0; j < UKF_NSIGMA; j++){
+            for(int i = 0; i < n; i++){
+                dx[i] = _chi[j][i] - _x[i];
+            }
+            for(int r = 0; r < n; r++){
+                for(int c = 0; c <= r; c++){
+                    _p[r*n+c] += _wc[j] * dx[r] * dx[c];
+                }
+            }
+        }
+        for(int r = 0; r < n; r++){
+            for(int c = r+1; c < n; c++){
+                _p[r*n+c] = _p[c*n+r];
+            }
+        }
+
+        // (4) Calculate the Kalman Gain K = P (P + R)^-1
+        // The measurement is the state itself so the cross covariance is P
+        for(int i = 0; i < n*n; i++){
+            _work[i] = _p[i] + _kalman_r[i];
+        }
+        if(!cholesky(n, _work, _sqrt)){
+            #ifdef FILTERS_USE_PRINTF
+            printf("Error in UnscentedKalmanFilter::filter > Innovation covariance is not positive definite\r\n");
+            #endif
+            return getQuaternion();
+        }
+        for(int r = 0; r < n; r++){
+            // Solve (L L^T) k = p for the r-th row of the gain (P and S are symmetric)
+            for(int i = 0; i < n; i++){
+                gain[r*n+i] = _p[r*n+i];
+            }
+            choleskySolve(n, _sqrt, gain + r*n);
+        }
+
+        // (5) Update the state
+        for(int i = 0; i < 4; i++){
+            z[i] = q_measured(i+1);
+        }
+        for(int i = 0; i < 3; i++){
+            z[4+i] = w_measured(i+1);
+        }
+        for(int i = 0; i < n; i++){
+            dx[i] = z[i] - _x[i];
+        }
+        for(int i = 0; i < n; i++){
+            for(int k = 0; k < n; k++){
+                _x[i] += gain[i*n+k] * dx[k];
+            }
+        }
+        norm = sqrt(_x[0]*_x[0] + _x[1]*_x[1] + _x[2]*_x[2] + _x[3]*_x[3]);
+        for(int i = 0; i < 4; i++){
+            _x[i] /= norm;
+        }
+
+        // (6) Predict the next covariance P = (1 - K) P
+        for(int i = 0; i < n*n; i++){
+            _work[i] = _p[i];
+        }
+        for(int r = 0; r < n; r++){
+            for(int c = 0; c <= r; c++){
+                float sum = 0;
+                for(int k = 0; k < n; k++){
+                    sum += gain[r*n+k] * _work[k*n+c];
+                }
+                _p[r*n+c] = _work[r*n+c] - sum;
+                _p[c*n+r] = _p[r*n+c];
+            }
+        }
+
+        return getQuaternion();
+    }
+
+// Private methods
+    void UnscentedKalmanFilter::generateSigmaPoints(){
+        const int n = UKF_NSTATE;
+
+        for(int i = 0; i < n*n; i++){
+            _work[i] = (n + _lambda) * _p[i];
+        }
+        if(!cholesky(n, _work, _sqrt)){
+            // Loss of positiveness (round-off), fall back on the diagonal spread
+            for(int i = 0; i < n*n; i++){
+                _sqrt[i] = 0;
+            }
+            for(int i = 0; i < n; i++){
+                _sqrt[i*n+i] = sqrt(fabs(_work[i*n+i]));
+            }
+        }
+
+        for(int i = 0; i < n; i++){
+            _chi[0][i] = _x[i];
+        }
+        for(int j = 0; j < n; j++){
+            for(int i = 0; i < n; i++){
+                _chi[1+j][i]   = _x[i] + _sqrt[i*n+j];
+                _chi[1+n+j][i] = _x[i] - _sqrt[i*n+j];
+            }
+        }
+    }
+
+    void UnscentedKalmanFilter::propagateSigmaPoints(float dt, const float h_rw[3], const float torque[3]){
+        for(int j = 0; j < UKF_NSIGMA; j++){
+            propagateState(_chi[j], dt, _I_sat, _I_sat_inv, h_rw, torque, _integrator);
+        }
+    }
+
+
+// ------------------- Kalman Smoother -------------------//
+// Layout of one slot of the ring buffer
+#define SMOOTHER_XF 0                   // Filtered state x(k|k)
+#define SMOOTHER_PF 7                   // Filtered covariance P(k|k)
+#define SMOOTHER_XP 56                  // Propagated state x(k|k-1)
+#define SMOOTHER_PP 63                  // Propagated covariance P(k|k-1)
+#define SMOOTHER_F  112                 // Transition from k-1 to k
+#define SMOOTHER_SLOT 161               // Size of a slot
+
+// Constructors
+    KalmanSmoother::KalmanSmoother(int lag):_lag((lag < 0) ? 0 : lag){
+        _buffer.resize((_lag + 1) * SMOOTHER_SLOT);
+        _buffer.shrink_to_fit();
+        reset();
+    }
+
+    KalmanSmoother::~KalmanSmoother(void){}
+
+// Getters
+    Matrix KalmanSmoother::getQuaternion()  const {return Matrix(4, 1, (float*)_xs);}
+    Matrix KalmanSmoother::getAngularRate() const {return Matrix(3, 1, (float*)(_xs+4));}
+    Matrix KalmanSmoother::getCovariance()  const {return Matrix(7, 7, (float*)_ps);}
+    int KalmanSmoother::getLag() const {return _lag;}
+
+// Smoother
+    int KalmanSmoother::push(const KalmanFilter& kalman){
+        _head = (_head + 1) % (_lag + 1);
+        float *slot = &_buffer[_head * SMOOTHER_SLOT];
+
+        kalman.getQuaternion().getCoef(slot + SMOOTHER_XF);
+        kalman.getAngularRate().getCoef(slot + SMOOTHER_XF + 4);
+        kalman.getCovariance().getCoef(slot + SMOOTHER_PF);
+        kalman.getPropagatedState().getCoef(slot + SMOOTHER_XP);
+        kalman.getPropagatedCovariance().getCoef(slot + SMOOTHER_PP);
+        kalman.getTransition().getCoef(slot + SMOOTHER_F);
+
+        if(_count < _lag + 1){
+            _count++;
+        }
+        if(_count < _lag + 1){
+            _pending = _count;
+            return 0;
+        }
+        smooth(_lag);
+        _pending = _lag;
+        return 1;
+    }
+
+    int KalmanSmoother::flush(){
+        if(_pending == 0){
+            reset();
+            return 0;
+        }
+        _pending--;
+        smooth(_pending);
+        return 1;
+    }
+
+    void KalmanSmoother::reset(){
+        _head = _lag;
+        _count = 0;
+        _pending = 0;
+        for(int i = 0; i < 7; i++){
+            _xs[i] = 0;
+        }
+        for(int i = 0; i < 49; i++){
+            _ps[i] = 0;
+        }
+    }
+
+    void KalmanSmoother::smooth(int depth){
+        const int n = 7;
+        float L[49];        // Cholesky factor of P(k+1|k)
+        float FP[49];       // F(k+1) P(k|k)
+        float C[49];        // Smoother gain
+        float dx[7], dP[49], CdP[49];
+        float norm;
+
+        // Start from the filtered estimate of the last step
+        float *slot = &_buffer[_head * SMOOTHER_SLOT];
+        for(int i = 0; i < n; i++){
+            _xs[i] = slot[SMOOTHER_XF + i];
+        }
+        for(int i = 0; i < n*n; i++){
+            _ps[i] = slot[SMOOTHER_PF + i];
+        }
+
+        for(int step = 0; step < depth; step++){
+            float *next = &_buffer[((_head - step + _lag + 1) % (_lag + 1)) * SMOOTHER_SLOT];
+            float *curr = &_buffer[((_head - step + _lag) % (_lag + 1)) * SMOOTHER_SLOT];
+            const float *pf = curr + SMOOTHER_PF;
+            const float *pp = next + SMOOTHER_PP;
+            const float *F  = next + SMOOTHER_F;
+
+            // C = P(k|k) F^T P(k+1|k)^-1, i.e. the rows of C solve P(k+1|k) c = (F P(k|k))[:, r]
+            if(!cholesky(n, pp, L)){
+                // Singular prediction: keep the filtered estimate at this step
+                for(int i = 0; i < n; i++){
+                    _xs[i] = curr[SMOOTHER_XF + i];
+                }
+                for(int i = 0; i < n*n; i++){
+                    _ps[i] = pf[i];
+                }
+                continue;
+            }
+            for(int i = 0; i < n; i++){
+                for(int j = 0; j < n; j++){
+                    float sum = 0;
+                    for(int k = 0; k < n; k++){
+                        sum += F[i*n+k] * pf[k*n+j];
+                    }
+                    FP[i*n+j] = sum;
+                }
+            }
+            for(int r = 0; r < n; r++){
+                for(int i = 0; i < n; i++){
+                    C[r*n+i] = FP[i*n+r];
+                }
+                choleskySolve(n, L, C + r*n);
+            }
+
+            // x(k|N) = x(k|k) + C (x(k+1|N) - x(k+1|k))
+            for(int i = 0; i < n; i++){
+                dx[i] = _xs[i] - next[SMOOTHER_XP + i];
+            }
+            for(int i = 0; i < n; i++){
+                float sum = curr[SMOOTHER_XF + i];
+                for(int k = 0; k < n; k++){
+                    sum += C[i*n+k] * dx[k];
+                }
+                _xs[i] = sum;
+            }
+
+            // P(k|N) = P(k|k) + C (P(k+1|N) - P(k+1|k)) C^T
+            for(int i = 0; i < n*n; i++){
+                dP[i] = _ps[i] - pp[i];
+            }
+            for(int i = 0; i < n; i++){
+                for(int j = 0; j < n; j++){
+                    float sum = 0;
+                    for(int k = 0; k < n; k++){
+                        sum += C[i*n+k] * dP[k*n+j];
+                    }
+                    CdP[i*n+j] = sum;
+                }
+            }
+            for(int i = 0; i < n; i++){
+                for(int j = 0; j < n; j++){
+                    float sum = pf[i*n+j];
+                    for(int k = 0; k < n; k++){
+                        sum += CdP[i*n+k] * C[j*n+k];
+                    }
+                    _ps[i*n+j] = sum;
+                }
+            }
+        }
+
+        // Renormalize the quaternion
+        norm = sqrt(_xs[0]*_xs[0] + _xs[1]*_xs[1] + _xs[2]*_xs[2] + _xs[3]*_xs[3]);
+        for(int i = 0; i < 4; i++){
+            _xs[i] /= norm;
+        }
+    }
@@ -12,12 +12,14 @@
  * @details
  * # Description
  * A set of algorithm to filter the attitude quaternion of a spacecraft. It implements
- * a 7 state (quaternion and angular rates) Extended Kalman Filter.
+ * a 7 state (quaternion and angular rates) Extended Kalman Filter, and an Unscented
+ * Kalman Filter for the same model.
  * 
  * It can be use to filter out noise in space applications for instance in Atitude
  * Determination and Control Systems. 
  * 
  * @see Filters::KalmanFilter
+ * @see Filters::UnscentedKalmanFilter
  * 
  * ## Working principle of the filter
  * Now that the attitude quaternion has been estimated with QuEst, it is very likely
@@ -91,6 +93,10 @@
 #define FILTERS_H
 #include "Matrix.h"
 
+#define UKF_NSTATE 7                    ///< Number of states of the Unscented Kalman Filter
+#define UKF_NSIGMA (2*UKF_NSTATE+1)     ///< Number of sigma points of the Unscented Kalman Filter
+#define KALMAN_NOISE_TOLERANCE 0.1f     ///< Relative change of the measurement noise above which a frozen gain is released
+
 /**
  * @brief 
  * A namespace to hold the filtering processes
@@ -101,6 +107,136 @@
  */
 namespace Filters{
 
+/**
+ * @ingroup FiltersGr
+ * @brief
+ * The integration schemes available to propagate the state in the predict step
+ * 
+ * @see Filters::propagateState
+ */
+enum Integrator{
+    INTEGRATOR_EULER = 0,   ///< First order Euler integration (default)
+    INTEGRATOR_RK4,         ///< Fourth order Runge-Kutta integration
+    INTEGRATOR_QUATEXP      ///< Quaternion exponential with coning correction, with Runge-Kutta 4 on the angular rates
+};
+
+/**
+ * @ingroup FiltersGr
+ * @brief
+ * Computes the time derivative of the 7-state [q, w] from the rigid-body model
+ * @details
+ * The quaternion [eta, x, y, z] follows q' = 0.5 * Omega(w) * q and the angular
+ * rates follow w' = I^-1 * (T - w x (I w + h_rw)).
+ * @param x         The state [eta, x, y, z, wx, wy, wz]
+ * @param I_sat     The inertia matrix of the satellite (row-major 3x3 array, kg.m2)
+ * @param I_sat_inv The inverse of the inertia matrix of the satellite (row-major 3x3 array)
+ * @param h_rw      The angular momentum of the reaction wheels (N.m.s)
+ * @param torque    The net external torque applied to the satellite (N.m)
+ * @param xdot      The array where to store the derivative of the state
+ */
+void stateDerivative(const float x[7], const float I_sat[9], const float I_sat_inv[9], const float h_rw[3], const float torque[3], float xdot[7]);
+
+/**
+ * @ingroup FiltersGr
+ * @brief
+ * Computes the analytic Jacobian of the rigid-body model with respect to the 7-state [q, w]
+ * @details
+ * With Omega(w) and Xi(q) such that q' = 0.5 * Omega(w) * q = 0.5 * Xi(q) * w, the
+ * Jacobian is:
+ * 
+ * @f{equation}{
+ *     \mathbf{A} = \left[\begin{array}{cc}
+ *         \frac{1}{2}\mathbf{\Omega}(\mathbf{\omega}) & \frac{1}{2}\mathbf{\Xi}(\mathbf{q}) \\
+ *         \mathbf{0} & I^{-1}\left( (I\mathbf{\omega} + \mathbf{h})^\times - \mathbf{\omega}^\times I \right)
+ *     \end{array}\right]
+ * @f}
+ * 
+ * The torque does not appear as it does not depend on the state.
+ * @param x         The state [eta, x, y, z, wx, wy, wz]
+ * @param I_sat     The inertia matrix of the satellite (row-major 3x3 array, kg.m2)
+ * @param I_sat_inv The inverse of the inertia matrix of the satellite (row-major 3x3 array)
+ * @param h_rw      The angular momentum of the reaction wheels (N.m.s)
+ * @param A         The array where to store the (7x7) Jacobian (row-major)
+ */
+void stateJacobian(const float x[7], const float I_sat[9], const float I_sat_inv[9], const float h_rw[3], float A[49]);
+
+/**
+ * @ingroup FiltersGr
+ * @brief
+ * Computes the Jacobian of the rigid-body model by central finite differences
+ * @details
+ * This is much slower than stateJacobian() and only meant to verify it.
+ * @param x         The state [eta, x, y, z, wx, wy, wz]
+ * @param I_sat     The inertia matrix of the satellite (row-major 3x3 array, kg.m2)
+ * @param I_sat_inv The inverse of the inertia matrix of the satellite (row-major 3x3 array)
+ * @param h_rw      The angular momentum of the reaction wheels (N.m.s)
+ * @param torque    The net external torque applied to the satellite (N.m)
+ * @param eps       The perturbation applied to each state
+ * @param A         The array where to store the (7x7) Jacobian (row-major)
+ */
+void numericJacobian(const float x[7], const float I_sat[9], const float I_sat_inv[9], const float h_rw[3], const float torque[3], float eps, float A[49]);
+
+/**
+ * @ingroup FiltersGr
+ * @brief
+ * Compares the analytic Jacobian of the model to its finite differences estimate
+ * @param x         The state [eta, x, y, z, wx, wy, wz]
+ * @param I_sat     The inertia matrix of the satellite (row-major 3x3 array, kg.m2)
+ * @param I_sat_inv The inverse of the inertia matrix of the satellite (row-major 3x3 array)
+ * @param h_rw      The angular momentum of the reaction wheels (N.m.s)
+ * @param torque    The net external torque applied to the satellite (N.m)
+ * @param eps       The perturbation applied to each state
+ * @return The largest absolute difference between the two Jacobians
+ */
+float checkJacobian(const float x[7], const float I_sat[9], const float I_sat_inv[9], const float h_rw[3], const float torque[3], float eps);
+
+/**
+ * @ingroup FiltersGr
+ * @brief
+ * Propagates the 7-state [q, w] over a time step with the chosen integration scheme
+ * @details
+ * - INTEGRATOR_EULER is the first order scheme q += 0.5 * Omega(w) * q * dt,
+ * w += w' * dt, followed by the renormalization of the quaternion,
+ * - INTEGRATOR_RK4 applies the classic fourth order Runge-Kutta to the whole state,
+ * - INTEGRATOR_QUATEXP integrates the angular rates with Runge-Kutta 4, then rotates
+ * the quaternion with the exact exponential of the rotation vector over the step: the
+ * Simpson integral of the rate plus the coning term dt^2/12 (w(k) x w(k+1)) of the
+ * non-commuting rotations. It keeps the quaternion normalized by construction.
+ * 
+ * Euler is first order, RK4 and QUATEXP are fourth order. For a satellite tumbling at
+ * 0.45 rad/s, both stay within 0.1 deg over 100 s with 1 s steps, which allows to run
+ * the filter at a lower rate (see KalmanIntegratorTest).
+ * @param x          The state [eta, x, y, z, wx, wy, wz] to propagate in place
+ * @param dt         The time step (s)
+ * @param I_sat      The inertia matrix of the satellite (row-major 3x3 array, kg.m2)
+ * @param I_sat_inv  The inverse of the inertia matrix of the satellite (row-major 3x3 array)
+ * @param h_rw       The angular momentum of the reaction wheels (N.m.s)
+ * @param torque     The net external torque applied to the satellite (N.m)
+ * @param integrator The integration scheme (see Filters::Integrator)
+ */
+void propagateState(float x[7], float dt, const float I_sat[9], const float I_sat_inv[9], const float h_rw[3], const float torque[3], int integrator);
+
+/**
+ * @ingroup FiltersGr
+ * @brief
+ * Computes the lower triangular Cholesky factor L of a symmetric (n x n) matrix A = L L^T
+ * @param n The size of the matrix
+ * @param A The matrix to factorize (row-major n*n array)
+ * @param L The array where to store the factor (row-major n*n array)
+ * @return 1 if successful, 0 if the matrix is not positive definite
+ */
+int cholesky(int n, const float *A, float *L);
+
+/**
+ * @ingroup FiltersGr
+ * @brief
+ * Solves (L L^T) x = b in place from the Cholesky factor of a matrix
+ * @param n The size of the system
+ * @param L The Cholesky factor (row-major n*n array) from Filters::cholesky
+ * @param b The n-element right hand side, replaced by the solution
+ */
+void choleskySolve(int n, const float *L, float *b);
+
 /**
  * @ingroup FiltersGr
  * @brief
@@ -181,6 +317,137 @@ public:
      */
     Matrix getCovariance() const;
 
+    /**
+     * @brief
+     * Fetched the last Kalman gain used to update the state
+     * @return The Kalman gain (7x7) Matrix
+     */
+    Matrix getGain() const;
+
+    /**
+     * @brief
+     * Fetched the state propagated by the model before the last update
+     * @return The propagated state [q, w] (7x1) Matrix
+     */
+    Matrix getPropagatedState() const;
+
+    /**
+     * @brief
+     * Fetched the covariance propagated by the model before the last update
+     * @return The propagated covariance (7x7) Matrix
+     */
+    Matrix getPropagatedCovariance() const;
+
+    /**
+     * @brief
+     * Fetched the state transition matrix used to propagate the covariance at the last update
+     * @return The state transition matrix (7x7) Matrix
+     */
+    Matrix getTransition() const;
+
+// Steady-state mode
+    /**
+     * @brief
+     * Enables the detection of the steady state of the filter
+     * @details
+     * During long stable phases (e.g. inertial pointing), the covariance and therefore
+     * the Kalman gain converge. Once the relative change of the covariance stays
+     * below the tolerance for the given number of consecutive steps, the gain is
+     * frozen and the covariance propagation is skipped entirely, reducing the filter
+     * step to the state propagation and a (7x7)*(7x1) product.
+     * 
+     * The covariance of the quaternion components follows the attitude, so it only
+     * converges while the attitude is held: a slow rotation (0.01 rad/s) keeps it
+     * changing by about 1e-4 per step. The frozen gain is about ten times the
+     * tolerance away from the converged one (see KalmanSteadyStateTest).
+     * 
+     * Use resetSteadyState() to resume the full filter, for instance before a slew. A
+     * change of the measurement noise above KALMAN_NOISE_TOLERANCE also resumes it (see
+     * KalmanFilter::setMeasurementNoise).
+     * @param tolerance The maximum relative change of the covariance between two steps (0 disables the detection)
+     * @param steps     The number of consecutive steps below the tolerance before freezing the gain (at least 1)
+     */
+    void setSteadyState(float tolerance, int steps);
+
+    /**
+     * @brief
+     * Sets a precomputed table of Kalman gains keyed on the angular rate
+     * @details
+     * When a table is set, the gain is linearly interpolated on the norm of the
+     * predicted angular rate and the covariance propagation is skipped. Outside of
+     * the range of the table, the full filter is run again, starting from the
+     * covariance consistent with the last scheduled gain K (K R for the posterior).
+     * 
+     * The rates must be sorted in increasing order, and a table needs at least 2 entries
+     * to cover a range. Setting a table of size 0 removes it.
+     * 
+     * The scheduled gains do not depend on the measurement noise: while the rate is
+     * covered, KalmanFilter::setMeasurementNoise has no effect on the update.
+     * @param n     The number of entries in the table (0, or at least 2)
+     * @param rates The n norms of the angular rate (rad/s) at which the gains were computed
+     * @param gains The n Kalman gains (7x7) Matrix
+     * @return 1 if the table was set or removed, 0 if n is invalid (the previous table is kept)
+     */
+    int setGainSchedule(int n, const float *rates, const Matrix *gains);
+
+    /**
+     * @brief
+     * Unfreezes the gain and resumes the full propagation of the covariance
+     */
+    void resetSteadyState();
+
+    /**
+     * @brief
+     * Tells if the gain is currently frozen or scheduled
+     * @details
+     * This also returns 1 whenever a gain schedule covers the current angular rate, even
+     * if the detection of the convergence is disabled (see KalmanFilter::setSteadyState).
+     * @return 1 if the covariance propagation is skipped, 0 otherwise
+     */
+    int isSteadyState() const;
+
+    /**
+     * @brief
+     * Sets the integration scheme of the predict step
+     * @param integrator The integration scheme (see Filters::Integrator, default is INTEGRATOR_EULER)
+     */
+    void setIntegrator(int integrator);
+
+// Measurement noise
+    /**
+     * @brief
+     * Sets the sensor noise covariance used at the next updates
+     * @details
+     * Meant to be called at each step with the covariance of the attitude estimator
+     * (see Estimators::QUESTCovariance) so that the update is weighted by the quality
+     * of the current measurement.
+     * 
+     * A frozen gain (see KalmanFilter::setSteadyState) was computed with the previous
+     * noise: when an entry changes by more than KALMAN_NOISE_TOLERANCE of the largest
+     * one, the full filter resumes. A gain schedule ignores the noise.
+     * @param kalman_r The sensor noise covariance (7x7) Matrix
+     */
+    void setMeasurementNoise(Matrix kalman_r);
+
+    /**
+     * @brief
+     * Fetched the sensor noise covariance
+     * @return The sensor noise covariance (7x7) Matrix
+     */
+    Matrix getMeasurementNoise() const;
+
+    /**
+     * @brief
+     * Verifies the Jacobian used to propagate the covariance at the current state
+     * @param w_rw      Reaction wheel angular velocity [rad/s] (3x1) Matrix
+     * @param T_bf      Torque applied to the satellite by anything but the reaction wheels [Nm] (3x1) Matrix
+     * @param T_rw      Torque applied to the satellite by the reaction wheels [Nm] (3x1) Matrix
+     * @param eps       The perturbation of the finite differences (default is 1e-3)
+     * @return The largest absolute difference between the analytic and numeric Jacobians
+     * @see Filters::checkJacobian
+     */
+    float checkJacobian(Matrix w_rw, Matrix T_bf, Matrix T_rw, float eps = 1e-3f) const;
+
 // Filters
     /**
      * @brief
@@ -196,6 +463,15 @@ public:
     Matrix filter(Matrix q_measured, Matrix w_measured, float dt, Matrix w_rw_prev, Matrix T_bf_prev, Matrix T_rw_prev);
 
 private:
+    /**
+     * @brief
+     * Provides the frozen or scheduled gain if the filter is in steady state
+     * @param w The current angular rates (3x1) Matrix
+     * @param gain The Matrix where to store the gain (can be NULL)
+     * @return 2 if the gain comes from the schedule, 1 if it is frozen, 0 if the full filter must be run
+     */
+    int steadyGain(const Matrix& w, Matrix *gain) const;
+
     Matrix I_sat;       /**< Inertia matrix of the spacecraft (in kg.m2) (3x3) Matrix */
     Matrix I_sat_inv;
     Matrix I_wheel;     /**< Inertia matrix of the reaction wheels (in kg.m2) (3x3) Matrix */
@@ -207,6 +483,332 @@ private:
     Matrix _kalman_q;   /**< Process noise covariance */
     Matrix _kalman_r;   /**< Sensor noise covariance */
 
+    Matrix x_propagate; /**< The state propagated before the update at step k (7x1) Matrix */
+    Matrix p_propagate; /**< The covariance propagated before the update at step k (7x7) Matrix */
+    Matrix f_transition;/**< The state transition matrix from step k-1 to k (7x7) Matrix */
+
+    Matrix _gain;                       /**< The last Kalman gain (7x7) Matrix */
+    float _steady_tol;                  /**< Relative tolerance on the covariance change for the steady state */
+    int _steady_steps;                  /**< Number of steps below tolerance before freezing the gain */
+    int _steady_count;                  /**< Number of consecutive steps below tolerance */
+    int _steady;                        /**< 1 if the gain is frozen */
+    int _scheduled;                     /**< 1 if the gain came from the schedule at the last update */
+    int _integrator;                    /**< The integration scheme of the predict step */
+    std::vector<float> _sched_rates;    /**< Angular rates of the gain schedule (rad/s) */
+    std::vector<Matrix> _sched_gains;   /**< Kalman gains of the gain schedule */
+
 }; // class KalmanFilter
+
+/**
+ * @ingroup FiltersGr
+ * @brief
+ * This class implements a 7-state (quaternion and angular rates)
+ * Unscented Kalman Filter for spacecraft atitude filtering.
+ * 
+ * @class Filters::UnscentedKalmanFilter
+ * 
+ * @details
+ * # Description
+ * This class is a drop-in replacement for Filters::KalmanFilter using the
+ * same rigid-body model (satellite and reaction wheels inertia) and the same
+ * inputs and outputs.
+ * 
+ * Instead of linearising the model around the last estimate, the Unscented
+ * Kalman Filter propagates 2n+1 sigma points (n = 7 states) through the
+ * non-linear dynamics. The resulting mean and covariance are exact up to the
+ * second order, which keeps the filter accurate at high tumble rates where the
+ * Jacobian of the Extended Kalman Filter is a poor approximation.
+ * The gain only shows with an accurate propagation (INTEGRATOR_RK4 or
+ * INTEGRATOR_QUATEXP, see setIntegrator): with Euler steps, the model error
+ * dominates both filters (see KalmanUKFTest).
+ * 
+ * The sigma points, their weights and all the intermediate matrices are stored
+ * in fixed-size arrays allocated with the object, so that a filter update does
+ * not perform any dynamic allocation. All the sigma points are propagated
+ * together in a single pass over the storage.
+ * 
+ * The spread of the sigma points is set by the usual (alpha, beta, kappa)
+ * parameters, see setSpread().
+ * 
+ * # References
+ * - "Unscented Filtering for Spacecraft Attitude Estimation", by
+ * J. Crassidis and F. Markley
+ * - "The Unscented Kalman Filter for Nonlinear Estimation", by
+ * E. Wan and R. van der Merwe
+ * 
+ * @see Filters
+ */
+class UnscentedKalmanFilter{
+public:
+// Constructors
+    /**
+     * @brief
+     * Default constructor for the Unscented Kalman filter class
+     */
+    UnscentedKalmanFilter();
+
+    /**
+     * @brief
+     * Initialize the Unscented Kalman filter with the spacecraft and filter parameters
+     * @param I_sat_init    The inertia matrix of the satellite (in kg.m2) (3x3) Matrix
+     * @param I_wheel_init  The inertia matrix of the reation wheels (in kg.m2) (3x3) Matrix
+     * @param p_init        The initial covariance matrix (7x7) Matrix
+     * @param kalman_q      The process noise covariance for the Kalman filter (7x7) Matrix
+     * @param kalman_r      The sensor noise covariance for the Kalman filter (7x7) Matrix
+     * @param q_init        The initial quaternion
+     * @param w_init        The initial angular rates
+     */
+    UnscentedKalmanFilter(Matrix I_sat_init, Matrix I_wheel_init, Matrix p_init, Matrix kalman_q, Matrix kalman_r, Matrix q_init, Matrix w_init);
+
+    /**
+     * @brief
+     * Default destructor for the Unscented Kalman filter class
+     */
+    ~UnscentedKalmanFilter(void);
+
+// Getters and Setters
+    /**
+     * @brief
+     * Fetched the predicted quaternion
+     * @return The predicted quaternion
+     */
+    Matrix getQuaternion() const;
+
+    /**
+     * @brief
+     * Fetched the predicted Angular Rate
+     * @return The predicted Angular Rate
+     */
+    Matrix getAngularRate() const;
+
+    /**
+     * @brief
+     * Fetched the predicted Covariance
+     * @return The predicted Covariance
+     */
+    Matrix getCovariance() const;
+
+    /**
+     * @brief
+     * Sets the spread of the sigma points and recomputes their weights
+     * @param alpha The spread of the sigma points around the mean (default is 1)
+     * @param beta  The prior knowledge of the distribution (2 is optimal for gaussian, default)
+     * @param kappa The secondary scaling parameter (default is 0)
+     */
+    void setSpread(float alpha, float beta, float kappa);
+
+    /**
+     * @brief
+     * Sets the integration scheme used to propagate the sigma points
+     * @param integrator The integration scheme (see Filters::Integrator, default is INTEGRATOR_EULER)
+     */
+    void setIntegrator(int integrator);
+
+// Measurement noise
+    /**
+     * @brief
+     * Sets the sensor noise covariance used at the next updates
+     * @details
+     * Meant to be called at each step with the covariance of the attitude estimator
+     * (see Estimators::QUESTCovariance) so that the update is weighted by the quality
+     * of the current measurement.
+     * 
+     * A frozen gain (see KalmanFilter::setSteadyState) was computed with the previous
+     * noise: when an entry changes by more than KALMAN_NOISE_TOLERANCE of the largest
+     * one, the full filter resumes. A gain schedule ignores the noise.
+     * @param kalman_r The sensor noise covariance (7x7) Matrix
+     */
+    void setMeasurementNoise(Matrix kalman_r);
+
+    /**
+     * @brief
+     * Fetched the sensor noise covariance
+     * @return The sensor noise covariance (7x7) Matrix
+     */
+    Matrix getMeasurementNoise() const;
+
+// Filters
+    /**
+     * @brief
+     * Filter the measured quaternion using an Unscented Kalman filter
+     * @param q_measured      (@ step k)      Attitude quaternion measured from sensors (4x1) Matrix
+     * @param w_measured      (@ step k)      Angular velocities in bf measured from sensors [rad/s] (3x1) Matrix
+     * @param w_rw_prev       (@ step k-1)    Reaction wheel angular velocity [rad/s] at the previous time step (3x1) Matrix
+     * @param T_bf_prev       (@ step k-1)    Total torque commanded to satellite in bf by external environment and magnetorquers (not reaction wheels!) [Nm] (3x1) Matrix  
+     * @param T_rw_prev       (@ step k-1)    Torque commanded to satellite in bf by only reaction wheels [Nm] (3x1) Matrix
+     * @param dt              (@ step k)      Simulation time step [sec].
+     * @return The new predicted quaternion
+     */
+    Matrix filter(Matrix q_measured, Matrix w_measured, float dt, Matrix w_rw_prev, Matrix T_bf_prev, Matrix T_rw_prev);
+
+private:
+    /**
+     * @brief
+     * Generates the sigma points around the current state from the current covariance
+     */
+    void generateSigmaPoints();
+
+    /**
+     * @brief
+     * Propagates all the sigma points through the rigid-body model in one pass
+     * @param dt        The integration time step (s)
+     * @param h_rw      The angular momentum of the reaction wheels (3-element array)
+     * @param torque    The net external torque applied to the satellite (3-element array)
+     */
+    void propagateSigmaPoints(float dt, const float h_rw[3], const float torque[3]);
+
+    float _I_sat[9];        /**< Inertia matrix of the spacecraft (in kg.m2) (row-major) */
+    float _I_sat_inv[9];    /**< Inverse of the inertia matrix of the spacecraft (row-major) */
+    float _I_wheel[9];      /**< Inertia matrix of the reaction wheels (in kg.m2) (row-major) */
+
+    float _x[UKF_NSTATE];                   /**< The predicted state [q, w] at step k */
+    float _p[UKF_NSTATE*UKF_NSTATE];        /**< The predicted covariance at step k (row-major) */
+    float _kalman_q[UKF_NSTATE*UKF_NSTATE]; /**< Process noise covariance (row-major) */
+    float _kalman_r[UKF_NSTATE*UKF_NSTATE]; /**< Sensor noise covariance (row-major) */
+
+    int _integrator;                        /**< The integration scheme of the sigma points */
+    float _lambda;                          /**< Scaling of the sigma points */
+    float _wm[UKF_NSIGMA];                  /**< Weights of the sigma points for the mean */
+    float _wc[UKF_NSIGMA];                  /**< Weights of the sigma points for the covariance */
+    float _chi[UKF_NSIGMA][UKF_NSTATE];     /**< The sigma points */
+    float _sqrt[UKF_NSTATE*UKF_NSTATE];     /**< Work storage for the Cholesky factors */
+    float _work[UKF_NSTATE*UKF_NSTATE];     /**< Work storage for the innovation covariance */
+
+}; // class UnscentedKalmanFilter
+
+/**
+ * @ingroup FiltersGr
+ * @brief
+ * This class implements a fixed-lag Rauch-Tung-Striebel smoother on top
+ * of the Filters::KalmanFilter.
+ * 
+ * @class Filters::KalmanSmoother
+ * 
+ * @details
+ * # Description
+ * The smoother is meant for the ground reconstruction of the attitude from
+ * downlinked logs. After each call to KalmanFilter::filter, the filtered and
+ * propagated states and covariances are pushed in a ring buffer of the size of
+ * the lag. A backward Rauch-Tung-Striebel pass over the buffer then provides the
+ * smoothed state of the step that is lag steps in the past:
+ * 
+ * @f{align}{
+ *     \mathbf{C}_k & = \mathbf{P}_{k|k} \mathbf{F}_{k+1}^T \mathbf{P}_{k+1|k}^{-1} \\
+ *     \mathbf{x}_{k|N} & = \mathbf{x}_{k|k} + \mathbf{C}_k \left( \mathbf{x}_{k+1|N} - \mathbf{x}_{k+1|k} \right) \\
+ *     \mathbf{P}_{k|N} & = \mathbf{P}_{k|k} + \mathbf{C}_k \left( \mathbf{P}_{k+1|N} - \mathbf{P}_{k+1|k} \right) \mathbf{C}_k^T
+ * @f}
+ * 
+ * The memory is allocated once at construction and does not depend on the length
+ * of the log, so that logs of any size can be smoothed in a single streaming pass.
+ * At the end of the log, the last lag steps are still in the buffer: they are
+ * smoothed and output one by one by KalmanSmoother::flush.
+ * 
+ * @attention The smoother needs the propagated covariance, so the steady-state
+ * mode of the Kalman filter must not be used while smoothing.
+ * 
+ * # Example code
+ * @code
+ * Filters::KalmanSmoother smoother(50);
+ * while(readLog(&q_measured, &w_measured, &dt)){
+ *     kalman.filter(q_measured, w_measured, dt, w_rw, T_bf, T_rw);
+ *     if(smoother.push(kalman)){
+ *         writeLog(smoother.getQuaternion(), smoother.getAngularRate());
+ *     }
+ * }
+ * while(smoother.flush()){
+ *     writeLog(smoother.getQuaternion(), smoother.getAngularRate());
+ * }
+ * @endcode
+ * 
+ * @see Filters
+ */
+class KalmanSmoother{
+public:
+// Constructors
+    /**
+     * @brief
+     * Creates a fixed-lag smoother
+     * @param lag The number of steps between the last filtered step and the smoothed output
+     * (a negative lag is taken as 0, which outputs the filtered states)
+     */
+    KalmanSmoother(int lag);
+
+    /**
+     * @brief
+     * Default destructor for the smoother class
+     */
+    ~KalmanSmoother(void);
+
+// Getters
+    /**
+     * @brief
+     * Fetched the smoothed quaternion of the last output step
+     * @return The smoothed quaternion (4x1) Matrix
+     */
+    Matrix getQuaternion() const;
+
+    /**
+     * @brief
+     * Fetched the smoothed Angular Rate of the last output step
+     * @return The smoothed Angular Rate (3x1) Matrix
+     */
+    Matrix getAngularRate() const;
+
+    /**
+     * @brief
+     * Fetched the smoothed Covariance of the last output step
+     * @return The smoothed Covariance (7x7) Matrix
+     */
+    Matrix getCovariance() const;
+
+    /**
+     * @brief
+     * Gets the lag of the smoother
+     * @return The lag in number of steps
+     */
+    int getLag() const;
+
+// Smoother
+    /**
+     * @brief
+     * Stores the last step of the Kalman filter and smooths the oldest step of the buffer
+     * @param kalman The Kalman filter, right after a call to KalmanFilter::filter
+     * @return 1 if a smoothed output is available, 0 while the buffer is filling up
+     */
+    int push(const KalmanFilter& kalman);
+
+    /**
+     * @brief
+     * Smooths the oldest step of the buffer that was not output yet, at the end of a log
+     * @details
+     * Each call outputs the next step, with the backward pass running from the last
+     * step of the log. Once all the steps were output, the buffer is emptied for a new log.
+     * @return 1 if a smoothed output is available, 0 when the buffer is empty
+     */
+    int flush();
+
+    /**
+     * @brief
+     * Empties the buffer, for instance between two independent logs
+     */
+    void reset();
+
+private:
+    /**
+     * @brief
+     * Runs the backward pass over the buffer
+     * @param depth The number of steps between the last step and the smoothed one
+     */
+    void smooth(int depth);
+
+    int _lag;                   /**< The lag of the smoother (in steps) */
+    int _head;                  /**< Index of the slot of the last step in the ring buffer */
+    int _count;                 /**< Number of steps stored in the ring buffer */
+    int _pending;               /**< Number of stored steps not output yet */
+    std::vector<float> _buffer; /**< Ring buffer of the filtered and propagated states and covariances */
+
+    float _xs[7];               /**< The smoothed state */
+    float _ps[49];              /**< The smoothed covariance (row-major) */
+}; // class KalmanSmoother
 }; // namespace Filters
 #endif // FILTERS_H
\ No newline at end of file
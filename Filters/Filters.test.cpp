@@ -27,6 +27,7 @@
 #define RAD2DEG 180.0f/3.1415926535f    ///< Conversion factor from radians to degrees
 
 #define LOOP_TIME 1                     ///< Controls the time between loops
+// #define TEST_UKF                     ///< Uncomment to test the Unscented Kalman Filter instead of the Extended one
 
 int KalmanFilterTest(){
     int size=0;
@@ -78,7 +79,11 @@ int KalmanFilterTest(){
     Matrix I_wheel = Matrix::zeros(3,3);
     Matrix q_init(4,1, quat);
     Matrix w_init(3,1, omega);
+    #ifdef TEST_UKF
+    UnscentedKalmanFilter kalman(I_sat, I_wheel, p_init, kalman_q, kalman_r, q_init, w_init);
+    #else
     KalmanFilter kalman(I_sat, I_wheel, p_init, kalman_q, kalman_r, q_init, w_init);
+    #endif
 
     Matrix q_predicted(4,1);
     Matrix w_predicted(3,1);
@@ -119,4 +124,395 @@ int KalmanFilterTest(){
         // wait_ms(10);
     }
     return 1;
-}
\ No newline at end of file
+}
+
+int KalmanJacobianTest(){
+    using namespace Filters;
+
+    const int n_states = 1000;          // Number of random states to check
+    const float eps = 1e-3f;            // Perturbation of the finite differences
+    const float tolerance = 1e-3f;      // Largest acceptable error on a coefficient
+
+    Timer t;
+    t.start();
+    printf("\n\r\n\r------------------------------\n\r");
+    printf("Connection OK\n\r");
+
+    // Satellite with a non diagonal inertia and spinning reaction wheels
+    float I_sat_coef[9] = {27, 1, 0.5, 1, 17, 0.3, 0.5, 0.3, 25};
+    float I_inv_coef[9];
+    Matrix(3,3, I_sat_coef).Inv().getCoef(I_inv_coef);
+    float h_rw[3] = {0.1f, -0.2f, 0.3f};
+    float torque[3] = {0.01f, 0.0f, -0.01f};
+
+    float x[7];
+    float jac[49];
+    float error = 0;
+    int analytic_time = 0;
+    int numeric_time = 0;
+    int start;
+
+    srand(1);
+    for(int k = 0; k < n_states; k++){
+        for(int i = 0; i < 7; i++){
+            x[i] = 2.0f * rand() / (float)RAND_MAX - 1.0f;
+        }
+        error = fmax(error, checkJacobian(x, I_sat_coef, I_inv_coef, h_rw, torque, eps));
+
+        start = t.read_us();
+        stateJacobian(x, I_sat_coef, I_inv_coef, h_rw, jac);
+        analytic_time += t.read_us() - start;
+
+        start = t.read_us();
+        numericJacobian(x, I_sat_coef, I_inv_coef, h_rw, torque, eps, jac);
+        numeric_time += t.read_us() - start;
+    }
+
+    printf("Largest Jacobian error over %d states: %g\n\r", n_states, error);
+    printf("Analytic Jacobian: %f us per call\n\r", analytic_time / (float)n_states);
+    printf("Numeric Jacobian:  %f us per call\n\r", numeric_time / (float)n_states);
+
+    return (error < tolerance) ? 1 : 0;
+}
+
+int KalmanIntegratorTest(){
+    using namespace Filters;
+
+    const float duration = 100;         // Length of the propagation (s)
+    const float dt_ref = 0.01f;         // Time step of the reference
+    const float tolerance = 0.1f;       // Largest acceptable error at 1 s steps (deg)
+
+    Timer t;
+    t.start();
+    printf("\n\r\n\r------------------------------\n\r");
+    printf("Connection OK\n\r");
+
+    // Asymmetric satellite tumbling at 0.45 rad/s without torque
+    float I_sat_coef[9] = {27, 0, 0, 0, 17, 0, 0, 0, 25};
+    float I_inv_coef[9] = {1/27.0f, 0, 0, 0, 1/17.0f, 0, 0, 0, 1/25.0f};
+    float h_rw[3] = {0, 0, 0};
+    float torque[3] = {0, 0, 0};
+    float x_init[7] = {1, 0, 0, 0, 0.3f, -0.2f, 0.27f};
+
+    // Reference propagated with Runge-Kutta 4 at a fine step
+    float x_ref[7];
+    for(int i = 0; i < 7; i++){
+        x_ref[i] = x_init[i];
+    }
+    for(int k = 0; k < (int)(duration / dt_ref + 0.5f); k++){
+        propagateState(x_ref, dt_ref, I_sat_coef, I_inv_coef, h_rw, torque, INTEGRATOR_RK4);
+    }
+
+    const char *name[3] = {"Euler  ", "RK4    ", "QuatExp"};
+    float dt[3] = {0.1f, 1.0f, 5.0f};
+    float x[7];
+    float error, error_1s = 0;
+    int steps, start, time;
+    for(int d = 0; d < 3; d++){
+        for(int m = INTEGRATOR_EULER; m <= INTEGRATOR_QUATEXP; m++){
+            for(int i = 0; i < 7; i++){
+                x[i] = x_init[i];
+            }
+            steps = (int)(duration / dt[d] + 0.5f);
+            start = t.read_us();
+            for(int k = 0; k < steps; k++){
+                propagateState(x, dt[d], I_sat_coef, I_inv_coef, h_rw, torque, m);
+            }
+            time = t.read_us() - start;
+
+            // Angle of the error quaternion q_ref^-1 * q from its vector part
+            float e[3] = {x_ref[0]*x[1] - x[0]*x_ref[1] - (x_ref[2]*x[3] - x_ref[3]*x[2]),
+                          x_ref[0]*x[2] - x[0]*x_ref[2] - (x_ref[3]*x[1] - x_ref[1]*x[3]),
+                          x_ref[0]*x[3] - x[0]*x_ref[3] - (x_ref[1]*x[2] - x_ref[2]*x[1])};
+            float sine = sqrt(e[0]*e[0] + e[1]*e[1] + e[2]*e[2]);
+            error = 2 * asin((sine > 1) ? 1 : sine) * RAD2DEG;
+            if(dt[d] == 1.0f && m != INTEGRATOR_EULER){
+                error_1s = fmax(error_1s, error);
+            }
+            printf("Integrator | %s | dt %3.1f s | attitude error after %3.0f s %10.6f deg | %7.3f us per step\n\r",
+                    name[m], dt[d], duration, error, time / (float)steps);
+        }
+    }
+
+    return (error_1s < tolerance) ? 1 : 0;
+}
+
+/**
+ * @brief
+ * Angle between a reference quaternion and an estimate
+ * @param q_ref The reference quaternion [eta, x, y, z]
+ * @param q     The estimated quaternion (4x1) Matrix
+ * @return The angle (deg)
+ */
+static float quatError(const float q_ref[4], const Matrix& q){
+    float dot = fabs(q_ref[0]*q(1) + q_ref[1]*q(2) + q_ref[2]*q(3) + q_ref[3]*q(4)) / q.norm();
+    return 2 * acos((dot > 1) ? 1 : dot) * RAD2DEG;
+}
+
+/**
+ * @brief
+ * Normally distributed random number
+ * @param sigma The standard deviation
+ * @return The random number
+ */
+static float gaussian(float sigma){
+    float u1 = (rand() + 1.0f) / ((float)RAND_MAX + 2.0f);
+    float u2 = rand() / (float)RAND_MAX;
+    return sigma * sqrt(-2 * log(u1)) * cos(2 * 3.1415926535f * u2);
+}
+
+int KalmanSmootherTest(){
+    using namespace Filters;
+
+    #define SMOOTHER_STEPS 600          // Number of steps of the simulated log
+    const int lag = 20;                 // Lag of the smoother (steps)
+    const float dt = 0.1f;              // Time step of the log (s)
+    const float sigma_q = 0.005f;       // Noise on the quaternion components
+    const float sigma_w = 0.01f;        // Noise on the angular rates (rad/s)
+
+    Timer t;
+    t.start();
+    printf("\n\r\n\r------------------------------\n\r");
+    printf("Connection OK\n\r");
+
+    // Simulated log of an asymmetric satellite tumbling without torque
+    float I_sat_coef[9] = {27, 0, 0, 0, 17, 0, 0, 0, 25};
+    float I_inv_coef[9] = {1/27.0f, 0, 0, 0, 1/17.0f, 0, 0, 0, 1/25.0f};
+    float h_rw[3] = {0, 0, 0};
+    float torque[3] = {0, 0, 0};
+    float x[7] = {1, 0, 0, 0, 0.1f, -0.05f, 0.08f};
+    static float q_true[SMOOTHER_STEPS][4];
+
+    Matrix q_measured(4,1), w_measured(3,1);
+    Matrix p_init = 1e-2f * Matrix::eye(7);
+    Matrix kalman_q = 1e-6f * Matrix::eye(7);
+    Matrix kalman_r = Matrix::eye(7);
+    for(int i = 1; i <= 7; i++){
+        kalman_r(i,i) = (i <= 4) ? sigma_q * sigma_q : sigma_w * sigma_w;
+    }
+    KalmanFilter kalman(Matrix(3,3, I_sat_coef), Matrix::zeros(3,3), p_init, kalman_q, kalman_r,
+                        Matrix(4,1, x), Matrix(3,1, x+4));
+    KalmanSmoother smoother(lag);
+
+    float filtered = 0, smoothed = 0;
+    int out = 0;
+    int smooth_time = 0, start;
+    srand(1);
+    for(int k = 0; k < SMOOTHER_STEPS; k++){
+        propagateState(x, dt, I_sat_coef, I_inv_coef, h_rw, torque, INTEGRATOR_RK4);
+        for(int i = 0; i < 4; i++){
+            q_true[k][i] = x[i];
+            q_measured(i+1) = x[i] + gaussian(sigma_q);
+        }
+        for(int i = 0; i < 3; i++){
+            w_measured(i+1) = x[4+i] + gaussian(sigma_w);
+        }
+        q_measured /= q_measured.norm();
+
+        kalman.filter(q_measured, w_measured, dt, Matrix::zeros(3,1), Matrix::zeros(3,1), Matrix::zeros(3,1));
+        filtered += quatError(q_true[k], kalman.getQuaternion());
+
+        start = t.read_us();
+        if(smoother.push(kalman)){
+            smoothed += quatError(q_true[out++], smoother.getQuaternion());
+        }
+        smooth_time += t.read_us() - start;
+    }
+    // The last lag steps of the log are smoothed from the end of the buffer
+    while(smoother.flush()){
+        smoothed += quatError(q_true[out++], smoother.getQuaternion());
+    }
+    filtered /= SMOOTHER_STEPS;
+    smoothed /= out;
+
+    printf("Smoother | lag %d | %d of %d steps output | mean error filtered %f deg, smoothed %f deg | %7.1f us per push\n\r",
+            lag, out, SMOOTHER_STEPS, filtered, smoothed, smooth_time / (float)SMOOTHER_STEPS);
+
+    return (out == SMOOTHER_STEPS && smoothed < filtered) ? 1 : 0;
+}
+
+/**
+ * @brief
+ * Largest difference between two matrices relative to the largest coefficient of the second one
+ * @param a The first (7x7) Matrix
+ * @param b The second (7x7) Matrix
+ * @return The relative difference
+ */
+static float relativeDifference(const Matrix& a, const Matrix& b){
+    float change = 0;
+    float scale = 0;
+    for(int i = 1; i <= 7; i++){
+        for(int j = 1; j <= 7; j++){
+            change = fmax(change, fabs(a(i,j) - b(i,j)));
+            scale  = fmax(scale,  fabs(b(i,j)));
+        }
+    }
+    return change / scale;
+}
+
+int KalmanSteadyStateTest(){
+    using namespace Filters;
+
+    const float dt = 0.1f;              // Time step of the filter (s)
+    const float tolerance = 1e-2f;      // Largest acceptable relative error
+
+    Timer t;
+    t.start();
+    printf("\n\r\n\r------------------------------\n\r");
+    printf("Connection OK\n\r");
+
+    float I_sat_coef[9] = {27, 0, 0, 0, 17, 0, 0, 0, 25};
+    Matrix I_sat(3,3, I_sat_coef);
+    Matrix p_init = 1e-1f * Matrix::eye(7);
+    Matrix kalman_q = 1e-6f * Matrix::eye(7);
+    Matrix kalman_r = 1e-3f * Matrix::eye(7);
+    Matrix q_init = Matrix::zeros(4,1);
+    q_init(1) = 1;
+    Matrix w_hold = Matrix::zeros(3,1);
+    Matrix w_slow = Matrix::zeros(3,1);
+    w_slow(1) = 0.01f;
+    Matrix zero = Matrix::zeros(3,1);
+    int start, full_time = 0, steady_time = 0;
+    int passed = 1;
+
+    // Detection of the convergence while the attitude is held (the covariance of the quaternion
+    // components follows the attitude): the frozen gain against the one of the full filter
+    KalmanFilter full(I_sat, Matrix::zeros(3,3), p_init, kalman_q, kalman_r, q_init, w_hold);
+    KalmanFilter steady(I_sat, Matrix::zeros(3,3), p_init, kalman_q, kalman_r, q_init, w_hold);
+    steady.setSteadyState(1e-4f, 5);
+    int frozen_at = -1;
+    for(int k = 0; k < 1000; k++){
+        start = t.read_us();
+        full.filter(full.getQuaternion(), w_hold, dt, zero, zero, zero);
+        full_time += t.read_us() - start;
+        start = t.read_us();
+        steady.filter(steady.getQuaternion(), w_hold, dt, zero, zero, zero);
+        steady_time += t.read_us() - start;
+        if(frozen_at < 0 && steady.isSteadyState()){
+            frozen_at = k + 1;
+        }
+    }
+    float gain_error = relativeDifference(steady.getGain(), full.getGain());
+    passed &= (frozen_at > 0 && gain_error < tolerance);
+    printf("Steady state | frozen after %d steps | gain error to the full filter %e | %7.1f us per step, %7.1f us full\n\r",
+            frozen_at, gain_error, steady_time / 1000.0f, full_time / 1000.0f);
+
+    // A new measurement noise releases the frozen gain
+    steady.setMeasurementNoise(4 * kalman_r);
+    int released = !steady.isSteadyState();
+    steady.setMeasurementNoise(kalman_r);
+    passed &= released;
+    printf("Steady state | released by a new measurement noise %d\n\r", released);
+
+    // Gain schedule: at half the range, the gain is the mean of the two entries
+    Matrix K = full.getGain();
+    Matrix P = full.getCovariance();
+    float rates[2] = {0.0f, 0.05f};
+    Matrix gains[2] = {K, 0.5f * K};
+    KalmanFilter scheduled(I_sat, Matrix::zeros(3,3), p_init, kalman_q, kalman_r, q_init, w_slow);
+    passed &= !scheduled.setGainSchedule(1, rates, gains) && scheduled.setGainSchedule(2, rates, gains);
+    float rate = scheduled.getAngularRate().norm();
+    scheduled.filter(scheduled.getQuaternion(), w_slow, dt, zero, zero, zero);
+    float u = (rate - rates[0]) / (rates[1] - rates[0]);
+    float interp_error = relativeDifference(scheduled.getGain(), (1 - u) * gains[0] + u * gains[1]);
+    passed &= (scheduled.isSteadyState() && interp_error < tolerance);
+    printf("Gain schedule | rate %f rad/s | interpolation error %e\n\r", rate, interp_error);
+
+    // Leaving the schedule: the covariance restarts from K R, the converged one for the converged gain
+    KalmanFilter leaving(I_sat, Matrix::zeros(3,3), p_init, kalman_q, kalman_r, q_init, w_hold);
+    gains[1] = K;
+    leaving.setGainSchedule(2, rates, gains);
+    for(int k = 0; k < 50; k++){
+        leaving.filter(leaving.getQuaternion(), w_hold, dt, zero, zero, zero);
+    }
+    leaving.setGainSchedule(0, 0, 0);
+    leaving.filter(leaving.getQuaternion(), w_hold, dt, zero, zero, zero);
+    float restore_error = relativeDifference(leaving.getCovariance(), P);
+    passed &= (!leaving.isSteadyState() && restore_error < tolerance);
+    printf("Gain schedule | removed | covariance error to the converged one %e (K R %e, initial %e)\n\r",
+            restore_error, relativeDifference(K * kalman_r, P), relativeDifference(p_init, P));
+
+    return passed;
+}
+
+int KalmanUKFTest(){
+    using namespace Filters;
+
+    #define UKF_TEST_STEPS 300          // Number of steps of the simulated run
+    const float dt = 0.1f;              // Time step of the filters (s)
+    const float sigma_q = 0.02f;        // Noise on the quaternion components
+    const float sigma_w = 0.05f;        // Noise on the angular rates (rad/s)
+
+    Timer t;
+    t.start();
+    printf("\n\r\n\r------------------------------\n\r");
+    printf("Connection OK\n\r");
+
+    // Asymmetric satellite tumbling at 3 rad/s without torque (17 deg per step)
+    float I_sat_coef[9] = {27, 0, 0, 0, 17, 0, 0, 0, 25};
+    float I_inv_coef[9] = {1/27.0f, 0, 0, 0, 1/17.0f, 0, 0, 0, 1/25.0f};
+    float h_rw[3] = {0, 0, 0};
+    float torque[3] = {0, 0, 0};
+    float x_init[7] = {1, 0, 0, 0, 2.0f, -1.3f, 1.8f};
+    float x[7];
+
+    Matrix q_measured(4,1), w_measured(3,1);
+    Matrix p_init = 1e-2f * Matrix::eye(7);
+    Matrix kalman_q = 1e-6f * Matrix::eye(7);
+    Matrix kalman_r = Matrix::eye(7);
+    for(int i = 1; i <= 7; i++){
+        kalman_r(i,i) = (i <= 4) ? sigma_q * sigma_q : sigma_w * sigma_w;
+    }
+    Matrix I_sat(3,3, I_sat_coef);
+    Matrix q_init(4,1, x_init);
+    Matrix w_init(3,1, x_init+4);
+    Matrix zero = Matrix::zeros(3,1);
+
+    // Same measurements for both filters, with the first order then the fourth order propagation
+    const char *name[2] = {"Euler", "RK4  "};
+    int integrator[2] = {INTEGRATOR_EULER, INTEGRATOR_RK4};
+    float ekf_error[2], ukf_error[2];
+    for(int m = 0; m < 2; m++){
+        KalmanFilter ekf(I_sat, Matrix::zeros(3,3), p_init, kalman_q, kalman_r, q_init, w_init);
+        UnscentedKalmanFilter ukf(I_sat, Matrix::zeros(3,3), p_init, kalman_q, kalman_r, q_init, w_init);
+        ekf.setIntegrator(integrator[m]);
+        ukf.setIntegrator(integrator[m]);
+        for(int i = 0; i < 7; i++){
+            x[i] = x_init[i];
+        }
+        float measured = 0;
+        int ekf_time = 0, ukf_time = 0, start;
+        ekf_error[m] = 0;
+        ukf_error[m] = 0;
+        srand(1);
+        for(int k = 0; k < UKF_TEST_STEPS; k++){
+            propagateState(x, dt, I_sat_coef, I_inv_coef, h_rw, torque, INTEGRATOR_RK4);
+            for(int i = 0; i < 4; i++){
+                q_measured(i+1) = x[i] + gaussian(sigma_q);
+            }
+            for(int i = 0; i < 3; i++){
+                w_measured(i+1) = x[4+i] + gaussian(sigma_w);
+            }
+            q_measured /= q_measured.norm();
+            measured += quatError(x, q_measured);
+
+            start = t.read_us();
+            ekf.filter(q_measured, w_measured, dt, zero, zero, zero);
+            ekf_time += t.read_us() - start;
+            ekf_error[m] += quatError(x, ekf.getQuaternion());
+
+            start = t.read_us();
+            ukf.filter(q_measured, w_measured, dt, zero, zero, zero);
+            ukf_time += t.read_us() - start;
+            ukf_error[m] += quatError(x, ukf.getQuaternion());
+        }
+        ekf_error[m] /= UKF_TEST_STEPS;
+        ukf_error[m] /= UKF_TEST_STEPS;
+        printf("UKF | %s | mean attitude error: measured %f deg | Extended %f deg, %7.1f us | Unscented %f deg, %7.1f us\n\r",
+                name[m], measured / UKF_TEST_STEPS, ekf_error[m], ekf_time / (float)UKF_TEST_STEPS,
+                ukf_error[m], ukf_time / (float)UKF_TEST_STEPS);
+    }
+
+    // With Euler steps the model error dominates both filters
+    return (ukf_error[1] < ekf_error[1]) ? 1 : 0;
+}
@@ -60,4 +60,63 @@
  * return 1 if successful, 0 otherwise
  */
 int KalmanFilterTest();
+
+/**
+ * @brief
+ * Verification and benchmark of the Jacobian of the Kalman filter process model
+ * 
+ * Compares the analytic Jacobian used to propagate the covariance to a central finite
+ * differences estimate over a set of random states, and times both computations.
+ * 
+ * return 1 if the Jacobian is correct, 0 otherwise
+ */
+int KalmanJacobianTest();
+
+/**
+ * @brief
+ * Accuracy and benchmark of the integration schemes of the Kalman filter predict step
+ * 
+ * Propagates an asymmetric tumbling satellite over 100 s with each scheme of
+ * Filters::Integrator at several time steps, and compares the attitude to a
+ * Runge-Kutta 4 reference with a fine step.
+ * 
+ * return 1 if the fourth order schemes stay within 0.1 deg at 1 s steps, 0 otherwise
+ */
+int KalmanIntegratorTest();
+
+/**
+ * @brief
+ * Test of the fixed-lag smoother on a simulated log
+ * 
+ * Filters the noisy measurements of a simulated tumbling satellite, smooths them
+ * (including the end of the log flushed from the buffer), and compares the mean
+ * attitude errors of the filtered and smoothed estimates.
+ * 
+ * return 1 if every step was output and the smoothed error is lower, 0 otherwise
+ */
+int KalmanSmootherTest();
+
+/**
+ * @brief
+ * Test of the steady-state mode and of the gain schedule of the Kalman filter
+ * 
+ * Checks the gain frozen at the convergence against the one of the full filter, its
+ * release by a new measurement noise, the interpolation of a gain schedule, and the
+ * covariance the full filter restarts from when leaving the schedule.
+ * 
+ * return 1 if all the checks pass, 0 otherwise
+ */
+int KalmanSteadyStateTest();
+
+/**
+ * @brief
+ * Comparison of the Extended and Unscented Kalman filters on a fast tumble
+ * 
+ * Filters the same noisy measurements of a satellite tumbling at 3 rad/s with both
+ * filters, for the Euler and Runge-Kutta 4 propagations, and reports their mean
+ * attitude errors and the time per step.
+ * 
+ * return 1 if the Unscented filter is more accurate with Runge-Kutta 4, 0 otherwise
+ */
+int KalmanUKFTest();
 #endif
\ No newline at end of file
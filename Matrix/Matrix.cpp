@@ -1048,6 +1048,86 @@
         }
     }
 
+    int Matrix::Eigen(Matrix *values, Matrix *vectors, int max_sweeps) const{
+        if( _nRows != _nCols ){
+            #ifdef MATRIX_USE_PRINTF
+            printf("Error in Matrix::Eigen > Matrix is not square\r\n");
+            #endif
+            return 0;
+        }
+        int n = _nRows;
+        Matrix a(*this);
+        Matrix v = eye(n);
+        float off, diag, theta, t, c, s, tau, apr;
+        int sweep;
+
+        // Symmetrize from the upper triangle
+        for(int p = 0; p < n; p++){
+            for(int r = p+1; r < n; r++){
+                a._matrix[r][p] = a._matrix[p][r];
+            }
+        }
+
+        for(sweep = 0; sweep < max_sweeps; sweep++){
+            off = 0;
+            diag = 0;
+            for(int p = 0; p < n; p++){
+                diag += a._matrix[p][p] * a._matrix[p][p];
+                for(int r = p+1; r < n; r++){
+                    off += a._matrix[p][r] * a._matrix[p][r];
+                }
+            }
+            if(off <= 1e-14f * diag || off == 0){
+                break;
+            }
+
+            for(int p = 0; p < n; p++){
+                for(int r = p+1; r < n; r++){
+                    apr = a._matrix[p][r];
+                    if(apr == 0){
+                        continue;
+                    }
+                    // Rotation angle zeroing a(p,r), the smaller root is taken for stability
+                    theta = (a._matrix[r][r] - a._matrix[p][p]) / (2 * apr);
+                    t = 1.0f / (fabs(theta) + sqrt(theta*theta + 1));
+                    if(theta < 0){
+                        t = -t;
+                    }
+                    c = 1.0f / sqrt(t*t + 1);
+                    s = t * c;
+                    tau = s / (1 + c);
+
+                    a._matrix[p][p] -= t * apr;
+                    a._matrix[r][r] += t * apr;
+                    a._matrix[p][r] = 0;
+                    a._matrix[r][p] = 0;
+                    for(int k = 0; k < n; k++){
+                        float akp, akr;
+                        if(k != p && k != r){
+                            akp = a._matrix[k][p];
+                            akr = a._matrix[k][r];
+                            a._matrix[k][p] = akp - s * (akr + tau * akp);
+                            a._matrix[k][r] = akr + s * (akp - tau * akr);
+                            a._matrix[p][k] = a._matrix[k][p];
+                            a._matrix[r][k] = a._matrix[k][r];
+                        }
+                        akp = v._matrix[k][p];
+                        akr = v._matrix[k][r];
+                        v._matrix[k][p] = akp - s * (akr + tau * akp);
+                        v._matrix[k][r] = akr + s * (akp - tau * akr);
+                    }
+                }
+            }
+        }
+
+        *values = Matrix(n, 1);
+        for(int i = 0; i < n; i++){
+            values->_matrix[i][0] = a._matrix[i][i];
+        }
+        *vectors = v;
+        return sweep;
+    }
+
     Matrix Matrix::cross(const Matrix& leftM, const Matrix& rightM){
         Matrix tmp;
         if(!leftM.isVector() || !rightM.isVector()){
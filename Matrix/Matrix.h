@@ -638,6 +638,23 @@ public:
      */
     float norm() const;
 
+    /**
+     * @brief
+     * Computes the eigen values and eigen vectors of a symmetric matrix using
+     * the cyclic Jacobi method
+     * @details
+     * Each Jacobi rotation zeroes one off-diagonal coefficient, the sweeps over all
+     * the off-diagonal coefficients are repeated until they are negligible compared
+     * to the diagonal. Accurate but slow, meant for small matrices and reference
+     * computations rather than for the control loop.
+     * Only the upper triangle of the matrix is used.
+     * @param values The (n x 1) vector of the eigen values (unsorted)
+     * @param vectors The (n x n) matrix whose columns are the eigen vectors (unit norm)
+     * @param max_sweeps The maximum number of sweeps
+     * @return The number of sweeps performed
+     */
+    int Eigen(Matrix *values, Matrix *vectors, int max_sweeps = 50) const;
+
     /**
      * @brief Compute the cross product of two (3x1) vectors
      * @param leftM The left hand side vector
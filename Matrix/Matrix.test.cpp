@@ -179,6 +179,15 @@ int MatrixTest(){
 
     printf("Inverse of B matrix inv(B) {{-1, 2, -1}, {2, -10.33, 7.33}, {-1, 8, -6}} \n\r");
     B.Inv().print();
+
+    printf("Eigen values of S = {{2, 1, 0}, {1, 2, 1}, {0, 1, 2}} (expected 0.5858, 2, 3.4142 in any order)\n\r");
+    float coefS[9] = {2, 1, 0, 1, 2, 1, 0, 1, 2};
+    Matrix S(3,3, coefS), eig_values, eig_vectors;
+    printf("%d sweeps\n\r", S.Eigen(&eig_values, &eig_vectors));
+    eig_values.print();
+    printf("Check S*V - V*diag(values) (expected zeros)\n\r");
+    float coefL[3] = {eig_values(1), eig_values(2), eig_values(3)};
+    (S*eig_vectors - eig_vectors*Matrix::diag(3, coefL)).print();
     
     printf("Test of vector packing\n\r");
     Matrix::ToPackedVector(A).print();
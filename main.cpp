@@ -13,7 +13,7 @@
 #ifdef TEST_QUEST
     #include "Estimators.test.h"
 #endif
-#ifdef TEST_FILTER
+#if defined(TEST_FILTER) || defined(TEST_FILTER_JACOBIAN) || defined(TEST_FILTER_INTEGRATOR) || defined(TEST_FILTER_SMOOTHER) || defined(TEST_FILTER_STEADY) || defined(TEST_FILTER_UKF)
     #include "Filters.test.h"
 #endif
 #ifdef TEST_IMU
@@ -41,6 +41,21 @@ int main(){
     #ifdef TEST_FILTER
         return KalmanFilterTest();
     #endif
+    #ifdef TEST_FILTER_JACOBIAN
+        return KalmanJacobianTest();
+    #endif
+    #ifdef TEST_FILTER_INTEGRATOR
+        return KalmanIntegratorTest();
+    #endif
+    #ifdef TEST_FILTER_SMOOTHER
+        return KalmanSmootherTest();
+    #endif
+    #ifdef TEST_FILTER_STEADY
+        return KalmanSteadyStateTest();
+    #endif
+    #ifdef TEST_FILTER_UKF
+        return KalmanUKFTest();
+    #endif
     #ifdef TEST_SUNSENSOR
         return SunSensorTest();
     #endif